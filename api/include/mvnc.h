@@ -24,6 +24,9 @@ extern "C"
 #endif
 
 #define MVNC_MAX_NAME_SIZE 28
+#define MVNC_MAX_STAGE_NAME_SIZE 100
+#define MVNC_MAX_TOP_K 1024
+#define MVNC_PRIORITY_AGING_MS 100	// Of waiting to send a tensor, worth one priority level
 
 typedef enum {
 	MVNC_OK = 0,
@@ -38,10 +41,13 @@ typedef enum {
 	MVNC_GONE = -9,                     // The graph or device has been closed during the operation
 	MVNC_UNSUPPORTED_GRAPH_FILE = -10,  // The graph file version is not supported
 	MVNC_MYRIAD_ERROR = -11,            // An error has been reported by the device, use MVNC_DEBUG_INFO
+	MVNC_CANCELLED = -12,               // The tensor was cancelled by mvncCancelTensors before being sent
+	MVNC_DROPPED = -13,                 // The tensor was dropped from a full queue for a newer one, see MVNC_QUEUE_POLICY
 } mvncStatus;
 
 typedef enum {
 	MVNC_LOG_LEVEL = 0, // Log level, int, 0 = nothing, 1 = errors, 2 = verbose
+	MVNC_TRACE = 1,     // Record API calls, transfers and lock waits for mvncDumpTrace, int, 0 = off
 } mvncGlobalOptions;
 
 typedef enum {
@@ -50,8 +56,24 @@ typedef enum {
 	MVNC_DONT_BLOCK = 2,        // LoadTensor will return BUSY instead of blocking, GetResult will return NO_DATA, int
 	MVNC_TIME_TAKEN = 1000,	    // Return time taken for inference (float *)
 	MVNC_DEBUG_INFO = 1001,     // Return debug info, string
+	MVNC_UPLOAD_THROUGHPUT = 1002,  // Return graph upload speed of the allocation in MB/s, float
+	MVNC_COMPLETION_FD = 1003,  // Return an eventfd signalled on each inference completion, int, see below
+	MVNC_HOST_TIMES = 1004,     // Return the host side phases of the last result, mvncHostTimes
+	MVNC_GRAPH_STATS = 1005,    // Return the counters of the graph, mvncStats; set to any int to reset them
+	MVNC_STAGE_STATS = 1006,    // Accumulate MVNC_TIME_TAKEN per stage if 1, int; setting it resets them
+	MVNC_GRAPH_WEIGHT = 1007,   // Return the MVNC_DISPATCH_WEIGHT of the device of the graph, float
+	MVNC_QUEUE_LIMIT = 1008,    // Tensors that may wait to be sent in mvncLoadTensor, int, 0 = no limit
+	MVNC_QUEUE_POLICY = 1009,   // What mvncLoadTensor does when they are reached, int, mvncQueuePolicy
+	MVNC_QUEUE_TIMEOUT = 1010,  // ms MVNC_QUEUE_BLOCK waits for room, int, 0 = no limit
+	MVNC_THERMAL_WAIT = 1011,   // Return the ms until MVNC_THERMAL_CONTROL lets the next tensor be sent, float
 } mvncGraphOptions;
 
+typedef enum {
+	MVNC_QUEUE_REJECT = 0,      // Return MVNC_BUSY at once, the default
+	MVNC_QUEUE_DROP_OLDEST = 1, // Make the oldest waiting call return MVNC_DROPPED and take its place
+	MVNC_QUEUE_BLOCK = 2,       // Wait for room up to MVNC_QUEUE_TIMEOUT, then return MVNC_BUSY
+} mvncQueuePolicy;
+
 typedef enum {
 	MVNC_TEMP_LIM_LOWER = 1,                // Temperature for short sleep, float, not for general use
 	MVNC_TEMP_LIM_HIGHER = 2,               // Temperature for long sleep, float, not for general use
@@ -62,21 +84,198 @@ typedef enum {
 	MVNC_THERMAL_STATS = 1000,              // Return temperatures, float *, not for general use
 	MVNC_OPTIMISATION_LIST = 1001,          // Return optimisations list, char *, not for general use
 	MVNC_THERMAL_THROTTLING_LEVEL = 1002,	// 1=TEMP_LIM_LOWER reached, 2=TEMP_LIM_HIGHER reached
+	MVNC_DEVICE_STATS = 1003,               // Return the counters of all the graphs of the device, mvncStats; set to any int to reset them
+	MVNC_THERMAL_FD = 1004,                 // Return an eventfd signalled on each new thermal history sample, int
+	MVNC_THERMAL_CONTROL = 1005,            // Pace the inferences to hold the temperature if 1, int; return mvncThermalControl
+	MVNC_THERMAL_TARGET = 1006,             // Temperature held by MVNC_THERMAL_CONTROL, float, 0 for TEMP_LIM_LOWER - 2
+	MVNC_DISPATCH_WEIGHT = 1007,            // Return the inferences/s to give the device, lowered as it heats up to its limits, float
+	MVNC_WATCHDOG = 1008,                   // Reset the device and replay its inferences when a result takes more than this many ms, int, 0 = off; set before allocating
 } mvncDeviceOptions;
 
+typedef struct {
+	unsigned int x, y, z;                   // Width, height and channels
+	unsigned int strideX, strideY, strideZ; // Strides in bytes
+} mvncTensorShape;
+
+typedef struct {
+	unsigned int version;
+	unsigned int stageCount;
+	unsigned int firstShave, lastShave;     // Range of SHAVE processors used by the graph
+	mvncTensorShape input;                  // Input of the first stage
+	mvncTensorShape output;                 // Output of the last stage
+	unsigned int inputLength;               // Bytes expected by mvncLoadTensor
+	unsigned int outputLength;              // Bytes returned by mvncGetResult
+} mvncGraphFileInfo;
+
+typedef struct {
+	char name[MVNC_MAX_STAGE_NAME_SIZE];
+	int type;                               // Operation type as encoded by the compiler
+	int dataType, precision, storageOrder;
+	mvncTensorShape input, taps, output;
+} mvncStageInfo;
+
+typedef struct {
+	int channelOrder[3];                    // Source channel of each tensor channel, {2, 1, 0} for RGB to BGR
+	float mean[3];                          // Subtracted from each tensor channel
+	float scale[3];                         // Then multiplied with each tensor channel
+} mvncPreprocessParams;
+
+// Options of mvncLoadTensorWithParams
+typedef struct {
+	double deadline;                        // Seconds of CLOCK_MONOTONIC (steady_clock, time.monotonic()), 0 for none
+	int priority;                           // Higher sent first, 0 by default
+} mvncLoadParams;
+
+typedef struct {
+	float xmin, ymin, xmax, ymax;           // Normalised to the image size, 0 to 1
+	float confidence;
+	int label;
+} mvncDetection;
+
+// Where the host spent the time of an inference. Durations are in ms; start is the
+// mvncLoadTensor call in seconds of the monotonic clock of the library. device runs from
+// the end of the upload to the output being ready, so it includes waiting for the
+// previous inference. lockWait is the time waiting for the library locks.
+typedef struct {
+	double start;
+	float slotWait;                         // For a free input in mvncLoadTensor or for MVNC_THERMAL_CONTROL
+	float lockWait;
+	float upload;                           // Sending the input
+	float device;
+	float download;                         // Receiving the output
+	float aux;                              // Receiving the aux buffer (times and temperatures)
+	unsigned int uploadBytes, downloadBytes, auxBytes;
+} mvncHostTimes;
+
+// Counters since the allocation of the graph, the opening of the device or the last reset.
+// latency is a histogram of the time from mvncLoadTensor to the result being ready, in
+// microsecond buckets: one per us up to 16 us, then 8 per power of 2 up to 16 s.
+#define MVNC_LATENCY_BUCKETS 176
+typedef struct {
+	double seconds;                         // Since the counters started
+	unsigned long long inferences;          // Results without error
+	unsigned long long bytesIn, bytesOut;   // Sent to the device and received from it
+	unsigned long long deviceMicroseconds;  // Sum of MVNC_TIME_TAKEN
+	unsigned long long busy;                // MVNC_BUSY returned by mvncLoadTensor
+	unsigned long long timeouts, myriadErrors, errors;
+	unsigned long long retries;             // Polls for a result not ready yet
+	unsigned long long throttled;           // Results with thermal throttling, and MVNC_BUSY from MVNC_THERMAL_CONTROL
+	unsigned long long resets;              // Recoveries of the device by MVNC_WATCHDOG
+	unsigned long long replays;             // Inferences uploaded again after a recovery
+	unsigned long long expired;             // Tensors dropped at their deadline before being sent
+	unsigned long long cancelled;           // Tensors cancelled by mvncCancelTensors
+	unsigned long long rejected;            // MVNC_BUSY at a full queue, at once or after blocking
+	unsigned long long dropped;             // MVNC_DROPPED by MVNC_QUEUE_DROP_OLDEST
+	unsigned long long blocked;             // Calls that waited for room with MVNC_QUEUE_BLOCK
+	unsigned long long latency[MVNC_LATENCY_BUCKETS];
+} mvncStats;
+
+// Times of a stage over the inferences since MVNC_STAGE_STATS was set, in the buckets of mvncStats
+typedef struct {
+	unsigned long long count;
+	float min, max, mean;                   // ms
+	unsigned long long time[MVNC_LATENCY_BUCKETS];
+} mvncStageStats;
+
+// Temperature and throttling level (as MVNC_THERMAL_THROTTLING_LEVEL) read with a result. The
+// device keeps the last 1024, one every 100 ms at most unless the level changes. time is in
+// seconds of the clock of mvncHostTimes and sequence counts the samples since the device opened.
+typedef struct {
+	double time;
+	unsigned long long sequence;
+	float temperature;
+	int throttle;
+} mvncThermalSample;
+
+// State of the host thermal controller of a device, which spaces the uploads to hold the
+// temperature of the results at target instead of letting the device reach its limits
+typedef struct {
+	int enabled;
+	float target;                           // C
+	float temperature;                      // Of the last result
+	float duty;                             // Share of the time the device may compute, 0.05 to 1
+	float deviceMs;                         // Smoothed compute time of an inference
+	float sustainedRate;                    // Inferences/s allowed at that duty
+	float rate;                             // Inferences/s completed, smoothed over about 10 s
+} mvncThermalControl;
+
 mvncStatus mvncGetDeviceName(int index, char *name, unsigned int nameSize);
 mvncStatus mvncOpenDevice(const char *name, void **deviceHandle);
 mvncStatus mvncCloseDevice(void *deviceHandle);
 mvncStatus mvncAllocateGraph(void *deviceHandle, void **graphHandle, const void *graphFile, unsigned int graphFileLength);
+// Allocates the same graph on deviceCount devices at once, uploading to all of them concurrently.
+// graphHandles receives one handle per device; on error no graph is allocated on any device.
+mvncStatus mvncAllocateGraphs(void **deviceHandles, void **graphHandles, unsigned int deviceCount, const void *graphFile, unsigned int graphFileLength);
 mvncStatus mvncDeallocateGraph(void *graphHandle);
 mvncStatus mvncSetGlobalOption(int option, const void *data, unsigned int dataLength);
 mvncStatus mvncGetGlobalOption(int option, void *data, unsigned int *dataLength);
+// Writes the last events of each thread recorded with MVNC_TRACE to path in the Chrome
+// trace format, with a process per device. Setting the environment variable MVNC_TRACE
+// to a file name enables tracing when the library is loaded and dumps it there at exit.
+mvncStatus mvncDumpTrace(const char *path);
 mvncStatus mvncSetGraphOption(void *graphHandle, int option, const void *data, unsigned int dataLength);
+// Options returning a struct take the size of data in *dataLength; when it is smaller, they
+// return MVNC_INVALID_PARAMETERS with the size needed in *dataLength
 mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data, unsigned int *dataLength);
 mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data, unsigned int dataLength);
 mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data, unsigned int *dataLength);
+// Copies up to *count thermal samples from number *sequence on, or from the oldest one held if
+// it was overwritten, sets *count to the number copied and *sequence to the next number. Start
+// from 0 for the history, then call it again with the same sequence to follow new samples.
+mvncStatus mvncGetThermalHistory(void *deviceHandle, unsigned long long *sequence, mvncThermalSample *samples, unsigned int *count);
+// Latency in ms at percentile (0 to 100) of the histogram, NO_DATA if it is empty
+mvncStatus mvncStatsPercentile(const mvncStats *stats, float percentile, float *ms);
+mvncStatus mvncHistogramPercentile(const unsigned long long *histogram, float percentile, float *ms);
+// Accumulated times of the stage index of the graph, NO_DATA if MVNC_STAGE_STATS is not set
+mvncStatus mvncGetStageStats(void *graphHandle, unsigned int index, mvncStageStats *stats);
+// Graph file inspection, no device needed
+mvncStatus mvncGetGraphFileInfo(const void *graphFile, unsigned int graphFileLength, mvncGraphFileInfo *info);
+mvncStatus mvncGetGraphFileStage(const void *graphFile, unsigned int graphFileLength, unsigned int index, mvncStageInfo *stage);
+// Page aligned buffers from a per-device pool, allocated by the USB driver when possible
+// so that tensors loaded from them are transferred without copies. Freed buffers are reused.
+mvncStatus mvncAllocTensorBuffer(void *deviceHandle, unsigned int length, void **buffer);
+mvncStatus mvncFreeTensorBuffer(void *deviceHandle, void *buffer);
+// Conversion between float and the half precision format of the tensors, vectorized when possible
+mvncStatus mvncFloatToHalf(void *dst, const float *src, unsigned int count);
+mvncStatus mvncHalfToFloat(float *dst, const void *src, unsigned int count);
+// Resizes an 8 bit image with 1, 3 or 4 interleaved channels and writes it as a half precision
+// tensor of tensorWidth x tensorHeight x 1 or 3 channels. Alpha is dropped. stride is in bytes,
+// 0 for packed rows. params can be NULL for no channel reordering, mean or scale.
+mvncStatus mvncPreprocessImage(const unsigned char *image, unsigned int width, unsigned int height, unsigned int stride,
+                               unsigned int channels, void *tensor, unsigned int tensorWidth, unsigned int tensorHeight,
+                               const mvncPreprocessParams *params);
+// Post-processing working directly on half precision results, count is the number of elements.
+// mvncTopK returns the k largest sorted from the largest, mvncThreshold the indices of the
+// elements not below threshold, in order, up to maxIndices of them.
+mvncStatus mvncArgMax(const void *tensor, unsigned int count, unsigned int *index, float *value);
+mvncStatus mvncTopK(const void *tensor, unsigned int count, unsigned int k, unsigned int *indices, float *values);
+mvncStatus mvncSoftmax(const void *tensor, unsigned int count, float *probabilities);
+mvncStatus mvncThreshold(const void *tensor, unsigned int count, float threshold, unsigned int *indices,
+                         unsigned int maxIndices, unsigned int *found);
+// Decodes the result of an SSD graph, keeping boxes with at least minConfidence and suppressing
+// the less confident of two boxes of the same label overlapping more than maxOverlap (intersection
+// over union, 1 for no suppression). Detections are sorted from the most confident.
+mvncStatus mvncDecodeDetections(const void *tensor, unsigned int count, float minConfidence, float maxOverlap,
+                                mvncDetection *detections, unsigned int maxDetections, unsigned int *found);
 mvncStatus mvncLoadTensor(void *graphHandle, const void *inputTensor, unsigned int inputTensorLength, void *userParam);
+// Waiting tensors are sent by priority, raised one level every MVNC_PRIORITY_AGING_MS waited,
+// then earliest deadline, then arrival; one whose deadline passes first returns MVNC_TIMEOUT.
+mvncStatus mvncLoadTensorWithParams(void *graphHandle, const void *inputTensor, unsigned int inputTensorLength,
+                                    void *userParam, const mvncLoadParams *params);
+// Makes the calls waiting with userParam return MVNC_CANCELLED, MVNC_NO_DATA if there are none
+mvncStatus mvncCancelTensors(void *graphHandle, void *userParam);
+// Once MVNC_COMPLETION_FD has been read, which must be done before loading any tensor, a library
+// thread fetches results as soon as they are ready and signals each on the returned eventfd, so
+// that an event loop can wait for it and call mvncGetResult with MVNC_DONT_BLOCK set.
 mvncStatus mvncGetResult(void *graphHandle, void **outputData, unsigned int *outputDataLength, void **userParam);
+// Same as mvncGetResult, but the result is read directly into buffer, which must hold the whole
+// output, instead of into a buffer owned by the graph that the next call overwrites
+mvncStatus mvncGetResultToBuffer(void *graphHandle, void *buffer, unsigned int bufferLength,
+                                 unsigned int *outputDataLength, void **userParam);
+// Same, returning MVNC_NO_DATA at deadline, as with MVNC_DONT_BLOCK, if the result is not ready;
+// the inference stays in flight and its result is returned by the next call
+mvncStatus mvncGetResultWithDeadline(void *graphHandle, void *buffer, unsigned int bufferLength,
+                                     unsigned int *outputDataLength, void **userParam, double deadline);
 
 #include "mvnc_deprecated.h"
 #ifdef __cplusplus
@@ -0,0 +1,826 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// C++11 interface on top of mvnc.h. Devices, graphs and pool buffers are
+// move-only owners released by their destructors, errors are thrown as
+// mvnc::Error and tensors are passed as Span views of half precision data.
+//
+//     mvnc::Device device(0);
+//     mvnc::Graph graph(device, mvnc::loadGraphFile("graph"));
+//     mvnc::TensorBuffer input = device.allocTensorBuffer(graph.inputSize());
+//     mvnc::TensorBuffer output = device.allocTensorBuffer(graph.outputSize());
+//     mvncPreprocessImage(..., input.data(), ...);
+//     graph.infer(input, output).get();
+//
+// infer() keeps two inferences in flight per graph and completes them from
+// a thread per graph woken by MVNC_COMPLETION_FD. Results are read directly
+// into the output span. Once started, it allocates no memory per call, unless
+// a callback is larger than MVNC_CALLBACK_SIZE. Do not mix infer() with
+// loadTensor()/getResult() on the same graph.
+
+#ifndef __MVNC_HPP_INCLUDED__
+#define __MVNC_HPP_INCLUDED__
+
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "mvnc.h"
+
+#ifndef MVNC_CALLBACK_SIZE
+#define MVNC_CALLBACK_SIZE 64
+#endif
+
+namespace mvnc {
+
+typedef uint16_t half;
+
+class Error : public std::runtime_error {
+public:
+	explicit Error(mvncStatus status)
+		: std::runtime_error("mvnc error " + std::to_string(static_cast<int>(status))), status_(status) {}
+	mvncStatus status() const { return status_; }
+private:
+	mvncStatus status_;
+};
+
+inline void check(mvncStatus status)
+{
+	if (status != MVNC_OK)
+		throw Error(status);
+}
+
+// Deadlines are on the steady clock, CLOCK_MONOTONIC as in the library,
+// default constructed for none
+typedef std::chrono::steady_clock::time_point Deadline;
+
+inline double deadlineSeconds(Deadline deadline)
+{
+	return std::chrono::duration<double>(deadline.time_since_epoch()).count();
+}
+
+// Non-owning view of count elements, as std::span
+template <typename T>
+class Span {
+public:
+	Span() : data_(nullptr), size_(0) {}
+	Span(T *data, size_t size) : data_(data), size_(size) {}
+	template <size_t N>
+	Span(T (&array)[N]) : data_(array), size_(N) {}
+	template <typename C, typename = decltype(std::declval<C &>().data())>
+	Span(C &container) : data_(container.data()), size_(container.size()) {}
+	template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	Span(const Span<U> &other) : data_(other.data()), size_(other.size()) {}
+
+	T *data() const { return data_; }
+	size_t size() const { return size_; }
+	size_t size_bytes() const { return size_ * sizeof(T); }
+	bool empty() const { return !size_; }
+	T *begin() const { return data_; }
+	T *end() const { return data_ + size_; }
+	T &operator[](size_t i) const { return data_[i]; }
+private:
+	T *data_;
+	size_t size_;
+};
+
+inline std::vector<std::string> deviceNames()
+{
+	std::vector<std::string> names;
+	char name[MVNC_MAX_NAME_SIZE];
+	for (int i = 0; mvncGetDeviceName(i, name, sizeof(name)) == MVNC_OK; i++)
+		names.push_back(name);
+	return names;
+}
+
+inline std::vector<char> loadGraphFile(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("cannot open " + path);
+	return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Page aligned buffer from the pool of a device, see mvncAllocTensorBuffer.
+// It must not outlive the device.
+class TensorBuffer {
+public:
+	TensorBuffer() : device_(nullptr), data_(nullptr), size_(0) {}
+	TensorBuffer(void *device, size_t size) : device_(device), data_(nullptr), size_(size)
+	{
+		void *data;
+		check(mvncAllocTensorBuffer(device, static_cast<unsigned>(size * sizeof(half)), &data));
+		data_ = static_cast<half *>(data);
+	}
+	TensorBuffer(TensorBuffer &&other) noexcept : device_(other.device_), data_(other.data_), size_(other.size_)
+	{
+		other.data_ = nullptr;
+	}
+	TensorBuffer &operator=(TensorBuffer &&other) noexcept
+	{
+		std::swap(device_, other.device_);
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		return *this;
+	}
+	TensorBuffer(const TensorBuffer &) = delete;
+	TensorBuffer &operator=(const TensorBuffer &) = delete;
+	~TensorBuffer()
+	{
+		if (data_)
+			mvncFreeTensorBuffer(device_, data_);
+	}
+
+	half *data() const { return data_; }
+	size_t size() const { return size_; }
+private:
+	void *device_;
+	half *data_;
+	size_t size_;
+};
+
+class Device {
+public:
+	Device() : handle_(nullptr) {}
+	explicit Device(const std::string &name) : handle_(nullptr), name_(name)
+	{
+		check(mvncOpenDevice(name.c_str(), &handle_));
+	}
+	explicit Device(int index) : handle_(nullptr)
+	{
+		char name[MVNC_MAX_NAME_SIZE];
+		check(mvncGetDeviceName(index, name, sizeof(name)));
+		name_ = name;
+		check(mvncOpenDevice(name, &handle_));
+	}
+	Device(Device &&other) noexcept : handle_(other.handle_), name_(std::move(other.name_))
+	{
+		other.handle_ = nullptr;
+	}
+	Device &operator=(Device &&other) noexcept
+	{
+		std::swap(handle_, other.handle_);
+		std::swap(name_, other.name_);
+		return *this;
+	}
+	Device(const Device &) = delete;
+	Device &operator=(const Device &) = delete;
+	~Device()
+	{
+		if (handle_)
+			mvncCloseDevice(handle_);
+	}
+
+	void *handle() const { return handle_; }
+	const std::string &name() const { return name_; }
+	explicit operator bool() const { return handle_ != nullptr; }
+
+	TensorBuffer allocTensorBuffer(size_t size) { return TensorBuffer(handle_, size); }
+
+	void close()
+	{
+		void *handle = handle_;
+		handle_ = nullptr;
+		check(mvncCloseDevice(handle));
+	}
+private:
+	void *handle_;
+	std::string name_;
+};
+
+namespace detail {
+
+// Recycles the blocks of the shared states of the futures returned by infer()
+struct Arena {
+	std::mutex mutex;
+	std::vector<void *> blocks;
+	size_t size = 0;
+
+	~Arena()
+	{
+		for (void *block : blocks)
+			::operator delete(block);
+	}
+	void *get(size_t n)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!size)
+			size = n;
+		if (n == size && !blocks.empty()) {
+			void *block = blocks.back();
+			blocks.pop_back();
+			return block;
+		}
+		return ::operator new(n);
+	}
+	void put(void *block, size_t n)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (n == size)
+			blocks.push_back(block);
+		else
+			::operator delete(block);
+	}
+};
+
+template <typename T>
+struct ArenaAllocator {
+	typedef T value_type;
+	std::shared_ptr<Arena> arena;
+
+	explicit ArenaAllocator(const std::shared_ptr<Arena> &arena) : arena(arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+	T *allocate(size_t n) { return static_cast<T *>(arena->get(n * sizeof(T))); }
+	void deallocate(T *p, size_t n) { arena->put(p, n * sizeof(T)); }
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+// Callable taking the status of an inference, stored in place when it fits
+class Callback {
+public:
+	Callback() : call_(nullptr), manage_(nullptr) {}
+	template <typename F, typename = typename std::enable_if<
+		!std::is_same<typename std::decay<F>::type, Callback>::value>::type>
+	explicit Callback(F &&f) : Callback()
+	{
+		typedef typename std::decay<F>::type Fn;
+		store<Fn>(std::forward<F>(f), std::integral_constant<bool, sizeof(Fn) <= sizeof(storage_) &&
+			  alignof(Fn) <= alignof(std::max_align_t)>());
+	}
+	Callback(Callback &&other) noexcept : Callback() { *this = std::move(other); }
+	Callback &operator=(Callback &&other) noexcept
+	{
+		reset();
+		if (other.call_) {
+			other.manage_(&storage_, &other.storage_);
+			call_ = other.call_;
+			manage_ = other.manage_;
+			other.reset();
+		}
+		return *this;
+	}
+	~Callback() { reset(); }
+
+	explicit operator bool() const { return call_ != nullptr; }
+	void operator()(mvncStatus status) { call_(&storage_, status); }
+	void reset()
+	{
+		if (call_)
+			manage_(nullptr, &storage_);
+		call_ = nullptr;
+	}
+private:
+	template <typename Fn, typename F>
+	void store(F &&f, std::true_type)
+	{
+		new (&storage_) Fn(std::forward<F>(f));
+		call_ = [](void *s, mvncStatus status) { (*static_cast<Fn *>(s))(status); };
+		// Moves from src to dst, or destroys src when dst is NULL
+		manage_ = [](void *dst, void *src) {
+			if (dst)
+				new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+			else
+				static_cast<Fn *>(src)->~Fn();
+		};
+	}
+	template <typename Fn, typename F>
+	void store(F &&f, std::false_type)
+	{
+		new (&storage_) Fn *(new Fn(std::forward<F>(f)));
+		call_ = [](void *s, mvncStatus status) { (**static_cast<Fn **>(s))(status); };
+		manage_ = [](void *dst, void *src) {
+			if (dst)
+				new (dst) Fn *(*static_cast<Fn **>(src));
+			else
+				delete *static_cast<Fn **>(src);
+		};
+	}
+
+	typename std::aligned_storage<MVNC_CALLBACK_SIZE, alignof(std::max_align_t)>::type storage_;
+	void (*call_)(void *, mvncStatus);
+	void (*manage_)(void *, void *);
+};
+
+// Place of a request waiting to be sent, ordered as in the library: higher
+// priority first, raised by one every MVNC_PRIORITY_AGING_MS of waiting,
+// then earlier deadline, then arrival
+struct Ticket {
+	int priority;
+	Deadline deadline;
+	std::chrono::steady_clock::time_point since;
+
+	long level(std::chrono::steady_clock::time_point now) const
+	{
+		return priority + static_cast<long>((now - since) / std::chrono::milliseconds(MVNC_PRIORITY_AGING_MS));
+	}
+	// Whether this goes before other, which came earlier
+	bool before(const Ticket &other, std::chrono::steady_clock::time_point now) const
+	{
+		long l = level(now), o = other.level(now);
+		return l > o || (l == o && deadline != Deadline() &&
+				 (other.deadline == Deadline() || deadline < other.deadline));
+	}
+};
+
+} // namespace detail
+
+class Graph {
+public:
+	Graph() : handle_(nullptr), inputSize_(0), outputSize_(0) {}
+	Graph(Device &device, const void *graphFile, size_t length) : handle_(nullptr)
+	{
+		setSizes(graphFile, length);
+		check(mvncAllocateGraph(device.handle(), &handle_, graphFile, static_cast<unsigned>(length)));
+	}
+	Graph(Device &device, const std::vector<char> &graphFile) : Graph(device, graphFile.data(), graphFile.size()) {}
+	Graph(Graph &&other) noexcept : Graph() { swap(other); }
+	Graph &operator=(Graph &&other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+	Graph(const Graph &) = delete;
+	Graph &operator=(const Graph &) = delete;
+	~Graph() { release(); }
+
+	// Allocates the graph on all the devices concurrently, see mvncAllocateGraphs
+	static std::vector<Graph> allocate(std::vector<Device> &devices, const void *graphFile, size_t length)
+	{
+		std::vector<void *> deviceHandles, graphHandles(devices.size());
+		for (Device &device : devices)
+			deviceHandles.push_back(device.handle());
+		check(mvncAllocateGraphs(deviceHandles.data(), graphHandles.data(), static_cast<unsigned>(devices.size()),
+					 graphFile, static_cast<unsigned>(length)));
+		std::vector<Graph> graphs(devices.size());
+		for (size_t i = 0; i < devices.size(); i++) {
+			graphs[i].handle_ = graphHandles[i];
+			graphs[i].setSizes(graphFile, length);
+		}
+		return graphs;
+	}
+	static std::vector<Graph> allocate(std::vector<Device> &devices, const std::vector<char> &graphFile)
+	{
+		return allocate(devices, graphFile.data(), graphFile.size());
+	}
+
+	void *handle() const { return handle_; }
+	explicit operator bool() const { return handle_ != nullptr; }
+	size_t inputSize() const { return inputSize_; }	// In halves
+	size_t outputSize() const { return outputSize_; }
+
+	// Blocking interface, as mvncLoadTensor and mvncGetResult
+	void loadTensor(Span<const half> input, void *userParam = nullptr)
+	{
+		check(mvncLoadTensor(handle_, input.data(), static_cast<unsigned>(input.size_bytes()), userParam));
+	}
+	// Throws MVNC_TIMEOUT when the input cannot be sent by deadline, or MVNC_CANCELLED
+	void loadTensor(Span<const half> input, void *userParam, Deadline deadline, int priority = 0)
+	{
+		mvncLoadParams params = { deadlineSeconds(deadline), priority };
+		check(mvncLoadTensorWithParams(handle_, input.data(), static_cast<unsigned>(input.size_bytes()),
+					       userParam, &params));
+	}
+	// Cancels the loadTensor() calls waiting with userParam, false when there are none
+	bool cancel(void *userParam)
+	{
+		mvncStatus rc = mvncCancelTensors(handle_, userParam);
+		if (rc == MVNC_NO_DATA)
+			return false;
+		check(rc);
+		return true;
+	}
+	// The result stays valid until the next call
+	Span<const half> getResult(void **userParam = nullptr)
+	{
+		void *data, *param;
+		unsigned length;
+		check(mvncGetResult(handle_, &data, &length, &param));
+		if (userParam)
+			*userParam = param;
+		return Span<const half>(static_cast<const half *>(data), length / sizeof(half));
+	}
+	void getResult(Span<half> output, void **userParam = nullptr)
+	{
+		void *param;
+		unsigned length;
+		check(mvncGetResultToBuffer(handle_, output.data(), static_cast<unsigned>(output.size_bytes()), &length, &param));
+		if (userParam)
+			*userParam = param;
+	}
+	// False when the result is not ready by deadline, the inference staying in flight
+	bool getResult(Span<half> output, Deadline deadline, void **userParam = nullptr)
+	{
+		void *param;
+		unsigned length;
+		mvncStatus rc = mvncGetResultWithDeadline(handle_, output.data(), static_cast<unsigned>(output.size_bytes()),
+							  &length, &param, deadlineSeconds(deadline));
+		if (rc == MVNC_NO_DATA)
+			return false;
+		check(rc);
+		if (userParam)
+			*userParam = param;
+		return true;
+	}
+
+	// Starts an inference, blocking while two are in flight, and returns a
+	// future set when its result is in output. With a deadline, throws
+	// MVNC_TIMEOUT instead when the input cannot be sent by then. The calls
+	// blocked are served by priority as mvncLoadTensorWithParams.
+	std::future<void> infer(Span<const half> input, Span<half> output, Deadline deadline = Deadline(),
+				int priority = 0)
+	{
+		if (!async_)
+			startAsync();
+		std::promise<void> promise(std::allocator_arg, detail::ArenaAllocator<char>(async_->arena));
+		std::future<void> future = promise.get_future();
+		Pending *p = start(input, output, deadline, priority);
+		p->promise = std::move(promise);
+		load(p, input, deadline, priority);
+		return future;
+	}
+	// Same, calling callback with the status from the completion thread instead.
+	// The callback may start other inferences.
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, F &&callback)
+	{
+		infer(input, output, Deadline(), 0, std::forward<F>(callback));
+	}
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, Deadline deadline, F &&callback)
+	{
+		infer(input, output, deadline, 0, std::forward<F>(callback));
+	}
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, Deadline deadline, int priority, F &&callback)
+	{
+		detail::Callback c(std::forward<F>(callback));
+		Pending *p = start(input, output, deadline, priority);
+		p->callback = std::move(c);
+		load(p, input, deadline, priority);
+	}
+
+	// MVNC_DISPATCH_WEIGHT of the device, inferences/s it should be given
+	float weight() const
+	{
+		float weight;
+		unsigned length;
+		check(mvncGetGraphOption(handle_, MVNC_GRAPH_WEIGHT, &weight, &length));
+		return weight;
+	}
+
+	// ms until MVNC_THERMAL_CONTROL lets the next tensor be sent
+	float thermalWait() const
+	{
+		float ms;
+		unsigned length;
+		check(mvncGetGraphOption(handle_, MVNC_THERMAL_WAIT, &ms, &length));
+		return ms;
+	}
+
+	// Inferences started by infer() and not completed
+	unsigned pending() const
+	{
+		if (!async_)
+			return 0;
+		std::lock_guard<std::mutex> lock(async_->mutex);
+		return async_->count;
+	}
+
+	void deallocate()
+	{
+		void *handle = handle_;
+		release(false);
+		check(mvncDeallocateGraph(handle));
+	}
+private:
+	struct Pending {
+		Span<half> output;
+		std::promise<void> promise;
+		detail::Callback callback;
+	};
+
+	// State of infer(), on the heap so that the thread survives moves of the graph
+	struct Async {
+		void *handle;
+		int fd;
+		std::atomic<bool> stop;
+		mutable std::mutex mutex;
+		bool loading;			// Orders the loads with the pending slots
+		std::vector<detail::Ticket *> waiting;	// Calls blocked in start()
+		std::condition_variable freed;
+		Pending pending[2];
+		unsigned first, count;
+		std::shared_ptr<detail::Arena> arena;
+		std::thread thread;
+	};
+
+	void swap(Graph &other) noexcept
+	{
+		std::swap(handle_, other.handle_);
+		std::swap(inputSize_, other.inputSize_);
+		std::swap(outputSize_, other.outputSize_);
+		std::swap(async_, other.async_);
+	}
+
+	void setSizes(const void *graphFile, size_t length)
+	{
+		mvncGraphFileInfo info;
+		check(mvncGetGraphFileInfo(graphFile, static_cast<unsigned>(length), &info));
+		inputSize_ = info.inputLength / sizeof(half);
+		outputSize_ = info.outputLength / sizeof(half);
+	}
+
+	// Waits for a free slot and the turn of the call, leaving the others
+	// blocked until load()
+	Pending *start(Span<const half> input, Span<half> output, Deadline deadline, int priority)
+	{
+		if (input.size() != inputSize_ || output.size() < outputSize_)
+			throw Error(MVNC_INVALID_PARAMETERS);
+		if (!async_)
+			startAsync();
+		Async *a = async_.get();
+		detail::Ticket ticket = { priority, deadline, std::chrono::steady_clock::now() };
+		auto ready = [a, &ticket] {
+			if (a->loading || a->count >= 2)
+				return false;
+			auto now = std::chrono::steady_clock::now();
+			detail::Ticket *first = a->waiting.front();
+			for (detail::Ticket *t : a->waiting)
+				if (t->before(*first, now))
+					first = t;
+			return first == &ticket;
+		};
+		std::unique_lock<std::mutex> lock(a->mutex);
+		a->waiting.push_back(&ticket);
+		bool ok = true;
+		if (deadline == Deadline())
+			a->freed.wait(lock, ready);
+		else
+			ok = a->freed.wait_until(lock, deadline, ready);
+		a->waiting.erase(std::find(a->waiting.begin(), a->waiting.end(), &ticket));
+		if (!ok) {
+			lock.unlock();
+			a->freed.notify_all();
+			throw Error(MVNC_TIMEOUT);
+		}
+		a->loading = true;
+		Pending *p = &a->pending[(a->first + a->count) % 2];
+		p->output = output;
+		return p;
+	}
+
+	void load(Pending *p, Span<const half> input, Deadline deadline, int priority)
+	{
+		Async *a = async_.get();
+		mvncLoadParams params = { deadlineSeconds(deadline), priority };
+		{
+			std::lock_guard<std::mutex> lock(a->mutex);
+			a->count++;
+		}
+		mvncStatus rc;
+		unsigned length;
+		float ms;
+		// The graph does not block, so this thread waits out MVNC_THERMAL_CONTROL
+		while ((rc = mvncLoadTensorWithParams(handle_, input.data(), static_cast<unsigned>(input.size_bytes()),
+						      p, &params)) == MVNC_BUSY &&
+		       mvncGetGraphOption(handle_, MVNC_THERMAL_WAIT, &ms, &length) == MVNC_OK && ms > 0)
+			std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(ms));
+		{
+			std::lock_guard<std::mutex> lock(a->mutex);
+			if (rc != MVNC_OK)
+				a->count--;
+			a->loading = false;
+		}
+		a->freed.notify_all();
+		if (rc != MVNC_OK) {
+			p->promise = std::promise<void>();
+			p->callback.reset();
+			throw Error(rc);
+		}
+	}
+
+	void startAsync()
+	{
+		std::unique_ptr<Async> a(new Async);
+		unsigned length;
+		int dontBlock = 1;
+		check(mvncGetGraphOption(handle_, MVNC_COMPLETION_FD, &a->fd, &length));
+		check(mvncSetGraphOption(handle_, MVNC_DONT_BLOCK, &dontBlock, sizeof(dontBlock)));
+		a->handle = handle_;
+		a->stop = false;
+		a->loading = false;
+		a->first = a->count = 0;
+		a->arena = std::make_shared<detail::Arena>();
+		a->thread = std::thread(complete, a.get());
+		async_ = std::move(a);
+	}
+
+	static void complete(Async *a)
+	{
+		for (;;) {
+			pollfd p = { a->fd, POLLIN, 0 };
+			uint64_t n;
+			if (poll(&p, 1, -1) < 0 || read(a->fd, &n, sizeof(n)) < 0)
+				continue;
+			if (a->stop)
+				return;
+			for (;;) {
+				Pending *p;
+				{
+					std::lock_guard<std::mutex> lock(a->mutex);
+					if (!a->count)
+						break;
+					p = &a->pending[a->first];
+				}
+				void *param;
+				unsigned length;
+				mvncStatus rc = mvncGetResultToBuffer(a->handle, p->output.data(),
+					static_cast<unsigned>(p->output.size_bytes()), &length, &param);
+				if (rc == MVNC_NO_DATA)
+					break;
+				std::promise<void> promise(std::move(p->promise));
+				detail::Callback callback(std::move(p->callback));
+				{
+					std::lock_guard<std::mutex> lock(a->mutex);
+					a->first = (a->first + 1) % 2;
+					a->count--;
+				}
+				a->freed.notify_all();
+				finish(promise, callback, rc);
+			}
+		}
+	}
+
+	static void finish(std::promise<void> &promise, detail::Callback &callback, mvncStatus rc)
+	{
+		if (callback)
+			callback(rc);
+		else if (rc == MVNC_OK)
+			promise.set_value();
+		else
+			promise.set_exception(std::make_exception_ptr(Error(rc)));
+	}
+
+	// Stops the completion thread, failing what is still pending, then
+	// deallocates the graph unless told otherwise
+	void release(bool deallocate = true)
+	{
+		if (async_) {
+			uint64_t one = 1;
+			async_->stop = true;
+			if (write(async_->fd, &one, sizeof(one)) == sizeof(one))
+				async_->thread.join();
+			else
+				async_->thread.detach();
+			while (async_->count) {
+				Pending &p = async_->pending[async_->first];
+				async_->first = (async_->first + 1) % 2;
+				async_->count--;
+				finish(p.promise, p.callback, MVNC_GONE);
+			}
+			async_.reset();
+		}
+		if (handle_ && deallocate)
+			mvncDeallocateGraph(handle_);
+		handle_ = nullptr;
+	}
+
+	void *handle_;
+	size_t inputSize_, outputSize_;
+	std::unique_ptr<Async> async_;
+};
+
+// One graph on each of a set of devices, inferences going to the one expected
+// to finish them first, from its inferences in flight and MVNC_GRAPH_WEIGHT,
+// which moves them away from the devices about to throttle and from those
+// that failed or are being recovered
+class Pool {
+public:
+	// Opens count devices, all when 0, and allocates the graph on them, with
+	// MVNC_WATCHDOG set to watchdogMs
+	Pool(const std::vector<char> &graphFile, unsigned count = 0, int watchdogMs = 0)
+		: next_(0), refreshed_(0)
+	{
+		std::vector<std::string> names = deviceNames();
+		if (names.empty() || count > names.size())
+			throw Error(MVNC_DEVICE_NOT_FOUND);
+		for (size_t i = 0; i < (count ? count : names.size()); i++) {
+			devices_.emplace_back(names[i]);
+			if (watchdogMs)
+				check(mvncSetDeviceOption(devices_.back().handle(), MVNC_WATCHDOG,
+							  &watchdogMs, sizeof(watchdogMs)));
+		}
+		graphs_ = Graph::allocate(devices_, graphFile);
+		weights_.reset(new std::atomic<float>[graphs_.size()]);
+		for (size_t i = 0; i < graphs_.size(); i++)
+			weights_[i] = 1;
+	}
+	~Pool()
+	{
+		// Graphs before their devices
+		graphs_.clear();
+	}
+
+	size_t size() const { return graphs_.size(); }
+	Graph &operator[](size_t i) { return graphs_[i]; }
+	Device &device(size_t i) { return devices_[i]; }
+	size_t inputSize() const { return graphs_[0].inputSize(); }
+	size_t outputSize() const { return graphs_[0].outputSize(); }
+
+	std::future<void> infer(Span<const half> input, Span<half> output, Deadline deadline = Deadline(),
+				int priority = 0)
+	{
+		return pick().infer(input, output, deadline, priority);
+	}
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, F &&callback)
+	{
+		pick().infer(input, output, std::forward<F>(callback));
+	}
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, Deadline deadline, F &&callback)
+	{
+		pick().infer(input, output, deadline, std::forward<F>(callback));
+	}
+	template <typename F>
+	void infer(Span<const half> input, Span<half> output, Deadline deadline, int priority, F &&callback)
+	{
+		pick().infer(input, output, deadline, priority, std::forward<F>(callback));
+	}
+private:
+	// The graph with the lowest (pending + 1) / weight, so that devices get work
+	// in proportion to their weight and none while a cooler one finishes sooner
+	Graph &pick()
+	{
+		refreshWeights();
+		size_t start = next_++ % graphs_.size(), best = start;
+		unsigned bestPending = graphs_[best].pending();
+		float bestWeight = weights_[best];
+		for (size_t i = 1; i < graphs_.size(); i++) {
+			size_t j = (start + i) % graphs_.size();
+			unsigned pending = graphs_[j].pending();
+			float weight = weights_[j];
+			if ((pending + 1) * bestWeight < (bestPending + 1) * weight) {
+				best = j;
+				bestPending = pending;
+				bestWeight = weight;
+			}
+		}
+		return graphs_[best];
+	}
+
+	// Every 100 ms, by the first thread to see them stale
+	void refreshWeights()
+	{
+		int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		int64_t refreshed = refreshed_;
+		if (now - refreshed < 100 || !refreshed_.compare_exchange_strong(refreshed, now))
+			return;
+		for (size_t i = 0; i < graphs_.size(); i++)
+			weights_[i] = graphs_[i].weight();
+	}
+
+	std::vector<Device> devices_;
+	std::vector<Graph> graphs_;
+	std::unique_ptr<std::atomic<float>[]> weights_;
+	std::atomic<size_t> next_;
+	std::atomic<int64_t> refreshed_;
+};
+
+} // namespace mvnc
+
+#endif
@@ -0,0 +1,643 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// C++20 coroutine interface on top of mvnc.hpp. An Executor runs an epoll
+// loop on the MVNC_COMPLETION_FD of the graphs, and AsyncGraph::infer() is
+// awaited from coroutines running on it:
+//
+//     mvnc::Executor executor;
+//     mvnc::Pool pool(mvnc::loadGraphFile("graph"));
+//     mvnc::AsyncGraph graph(executor, pool);
+//
+//     mvnc::Detached request(mvnc::AsyncGraph &graph, ...)
+//     {
+//         co_await graph.infer(input, output);
+//     }
+//
+//     executor.run();
+//
+// Requests are queued in the awaiters, inside the coroutine frames, and
+// sent to the graph expected to finish them first, from its inferences in
+// flight and MVNC_GRAPH_WEIGHT, as inputs become free. The next one sent is
+// chosen by priority, deadline and arrival as mvncLoadTensorWithParams
+// does, scanning the queue. Any number of them
+// can wait for a few devices without threads or allocations. A request
+// failed by a device goes back to the front of the queue for another one,
+// as long as one has a weight, so that the others take over the work of a
+// device that failed or is being recovered by MVNC_WATCHDOG. A request
+// given a deadline or a stop token leaves the queue with MVNC_TIMEOUT or
+// MVNC_CANCELLED when it passes or is stopped before the request is sent,
+// so that the devices only compute the results still wanted. With
+// setQueueLimit(), a request finding the queue full is rejected, drops the
+// oldest one or waits for room as MVNC_QUEUE_POLICY, so that the latency
+// stays bounded when the requests outrun the devices. Coroutines
+// are resumed from the thread running the executor. The graphs must not be
+// used with Graph::infer() at the same time.
+
+#ifndef __MVNC_CORO_HPP_INCLUDED__
+#define __MVNC_CORO_HPP_INCLUDED__
+
+#if __cplusplus < 202002L
+#error "mvnc_coro.hpp needs C++20"
+#endif
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stop_token>
+#include <system_error>
+#include "mvnc.hpp"
+
+namespace mvnc {
+
+// Waits for file descriptors with epoll and calls their watchers, single threaded
+class Executor {
+public:
+	struct Watcher {
+		virtual void ready() = 0;
+	protected:
+		~Watcher() = default;
+	};
+
+	Executor() : stopped_(false)
+	{
+		epoll_ = epoll_create1(EPOLL_CLOEXEC);
+		wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (epoll_ < 0 || wake_ < 0)
+			throw std::system_error(errno, std::system_category());
+		watch(wake_, nullptr);
+	}
+	Executor(const Executor &) = delete;
+	Executor &operator=(const Executor &) = delete;
+	~Executor()
+	{
+		close(wake_);
+		close(epoll_);
+	}
+
+	void watch(int fd, Watcher *watcher)
+	{
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = watcher;
+		if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) < 0)
+			throw std::system_error(errno, std::system_category());
+	}
+	void unwatch(int fd) { epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr); }
+
+	// Runs until stop(), which can be called from any thread
+	void run()
+	{
+		while (!stopped_.exchange(false))
+			runOnce(-1);
+	}
+	void stop()
+	{
+		uint64_t one = 1;
+		stopped_ = true;
+		if (write(wake_, &one, sizeof(one)) < 0)
+			return;
+	}
+
+	// Waits up to timeout ms, -1 for ever, and dispatches the ready events
+	void runOnce(int timeout)
+	{
+		epoll_event events[16];
+		int n = epoll_wait(epoll_, events, 16, timeout);
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr) {
+				static_cast<Watcher *>(events[i].data.ptr)->ready();
+			} else {
+				uint64_t count;
+				if (read(wake_, &count, sizeof(count)) < 0)
+					continue;
+			}
+		}
+	}
+private:
+	int epoll_, wake_;
+	std::atomic<bool> stopped_;
+};
+
+// Coroutine started immediately and destroyed when it returns, to spawn
+// requests from the executor thread. Exceptions must be caught inside.
+struct Detached {
+	struct promise_type {
+		Detached get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+// One or several allocations of the same graph driven by an Executor
+class AsyncGraph {
+	// Wakes the executor to drop a stopped request, from the thread stopping it
+	struct Wake {
+		AsyncGraph *owner;
+		void operator()() const noexcept { owner->wake(); }
+	};
+public:
+	class Awaiter {
+	public:
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = handle;
+			return owner_->submit(this);
+		}
+		void await_resume() const { check(rc_); }
+	private:
+		friend class AsyncGraph;
+		Awaiter(AsyncGraph *owner, Span<const half> input, Span<half> output, Deadline deadline,
+			std::stop_token stop, int priority)
+			: owner_(owner), input_(input), output_(output), rc_(MVNC_OK), tries_(0),
+			  ticket_{priority, deadline, {}}, stop_(std::move(stop)), next_(nullptr) {}
+
+		AsyncGraph *owner_;
+		Span<const half> input_;
+		Span<half> output_;
+		std::coroutine_handle<> handle_;
+		mvncStatus rc_;
+		unsigned tries_;	// Devices that failed it
+		detail::Ticket ticket_;
+		std::stop_token stop_;
+		std::optional<std::stop_callback<Wake>> onStop_;	// Once queued
+		Deadline admitBy_;	// While blocked by a full queue, MVNC_QUEUE_TIMEOUT
+		Awaiter *next_;
+	};
+
+	AsyncGraph(Executor &executor, Graph &graph) : executor_(executor)
+	{
+		init();
+		add(graph);
+	}
+	AsyncGraph(Executor &executor, std::vector<Graph> &graphs) : executor_(executor)
+	{
+		init();
+		for (Graph &graph : graphs)
+			add(graph);
+	}
+	AsyncGraph(Executor &executor, Pool &pool) : executor_(executor)
+	{
+		init();
+		for (size_t i = 0; i < pool.size(); i++)
+			add(pool[i]);
+	}
+	AsyncGraph(const AsyncGraph &) = delete;
+	AsyncGraph &operator=(const AsyncGraph &) = delete;
+	// No request may be pending
+	~AsyncGraph()
+	{
+		for (auto &slot : slots_)
+			executor_.unwatch(slot->fd);
+	}
+
+	// Completes when the result is in output, throwing mvnc::Error on failure
+	Awaiter infer(Span<const half> input, Span<half> output, Deadline deadline = Deadline(),
+		      std::stop_token stop = std::stop_token(), int priority = 0)
+	{
+		return Awaiter(this, input, output, deadline, std::move(stop), priority);
+	}
+
+	// Bounds the requests waiting for a free input to limit, 0 for none. The
+	// others are handled by policy as MVNC_QUEUE_POLICY, MVNC_QUEUE_BLOCK
+	// waiting up to timeout, 0 for no limit, before failing with MVNC_BUSY.
+	void setQueueLimit(size_t limit, mvncQueuePolicy policy = MVNC_QUEUE_REJECT,
+			   std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+	{
+		limit_ = limit;
+		policy_ = policy;
+		timeout_ = timeout;
+	}
+
+	// As the counters of mvncStats
+	struct QueueCounters {
+		unsigned long long rejected = 0, dropped = 0, blocked = 0;
+	};
+	const QueueCounters &queueCounters() const { return counters_; }
+
+	// Requests sent to the devices and waiting for them
+	unsigned pending() const { return pending_; }
+	// Requests waiting for a free input, and blocked by a full queue
+	size_t queued() const { return waiting_.size + blocked_.size; }
+private:
+	struct List {
+		Awaiter *first = nullptr, *last = nullptr;
+		size_t size = 0;
+
+		bool empty() const { return !first; }
+		void push(Awaiter *a)
+		{
+			size++;
+			a->next_ = nullptr;
+			if (last)
+				last->next_ = a;
+			else
+				first = a;
+			last = a;
+		}
+		Awaiter *pop()
+		{
+			Awaiter *a = first;
+			size--;
+			first = a->next_;
+			if (!first)
+				last = nullptr;
+			return a;
+		}
+		void remove(Awaiter *prev, Awaiter *a)
+		{
+			size--;
+			(prev ? prev->next_ : first) = a->next_;
+			if (last == a)
+				last = prev;
+		}
+		// Removes the request to send next: the first failed by a device,
+		// else the first in the order of detail::Ticket
+		Awaiter *popNext(std::chrono::steady_clock::time_point now)
+		{
+			Awaiter *best = first, *bestPrev = nullptr;
+			for (Awaiter *prev = first, *a = first->next_; a; prev = a, a = a->next_)
+				if (!best->tries_ && (a->tries_ || a->ticket_.before(best->ticket_, now))) {
+					best = a;
+					bestPrev = prev;
+				}
+			remove(bestPrev, best);
+			return best;
+		}
+		// Moves the requests of other in front of these
+		void prepend(List &other)
+		{
+			if (other.empty())
+				return;
+			other.last->next_ = first;
+			if (!last)
+				last = other.last;
+			first = other.first;
+			size += other.size;
+			other.first = other.last = nullptr;
+			other.size = 0;
+		}
+	};
+
+	struct Slot final : Executor::Watcher {
+		AsyncGraph *owner;
+		void *handle;
+		int fd;
+		unsigned inflight;
+		float weight;	// MVNC_GRAPH_WEIGHT
+		List loaded;
+
+		void ready() override { owner->completed(this); }
+	};
+
+	// Timer of the earliest deadline of the queue, or eventfd of the stop requests
+	struct Sweeper final : Executor::Watcher {
+		AsyncGraph *owner = nullptr;
+		int fd = -1;
+
+		~Sweeper()
+		{
+			if (fd >= 0)
+				close(fd);
+		}
+		void ready() override
+		{
+			uint64_t count;
+			if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+				return;
+			owner->sweep();
+		}
+	};
+
+	void init()
+	{
+		timer_.owner = stopped_.owner = this;
+		timer_.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		stopped_.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (timer_.fd < 0 || stopped_.fd < 0)
+			throw std::system_error(errno, std::system_category());
+		executor_.watch(timer_.fd, &timer_);
+		executor_.watch(stopped_.fd, &stopped_);
+	}
+
+	void add(Graph &graph)
+	{
+		unsigned length;
+		int fd, dontBlock = 1;
+		check(mvncGetGraphOption(graph.handle(), MVNC_COMPLETION_FD, &fd, &length));
+		check(mvncSetGraphOption(graph.handle(), MVNC_DONT_BLOCK, &dontBlock, sizeof(dontBlock)));
+		std::unique_ptr<Slot> slot(new Slot);
+		slot->owner = this;
+		slot->handle = graph.handle();
+		slot->fd = fd;
+		slot->inflight = 0;
+		slot->weight = graph.weight();
+		slots_.push_back(std::move(slot));
+		executor_.watch(fd, slots_.back().get());
+		inputSize_ = graph.inputSize();
+		outputSize_ = graph.outputSize();
+	}
+
+	// The slot with the lowest (inflight + 1) / weight if it has a free input,
+	// so that requests wait for a cooler device rather than go to a hot one
+	Slot *freeSlot()
+	{
+		Slot *best = nullptr;
+		for (auto &slot : slots_)
+			if (!best || (slot->inflight + 1) * best->weight < (best->inflight + 1) * slot->weight)
+				best = slot.get();
+		return best && best->inflight < 2 ? best : nullptr;
+	}
+
+	// Every 100 ms, also for the slots without completions, or when forced
+	void refreshWeights(bool force = false)
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (!force && now - refreshed_ < std::chrono::milliseconds(100))
+			return;
+		refreshed_ = now;
+		for (auto &slot : slots_) {
+			float weight;
+			unsigned length;
+			if (mvncGetGraphOption(slot->handle, MVNC_GRAPH_WEIGHT, &weight, &length) == MVNC_OK)
+				slot->weight = weight;
+		}
+	}
+
+	mvncStatus load(Slot *slot, Awaiter *a)
+	{
+		if (a->input_.size() != inputSize_ || a->output_.size() < outputSize_)
+			return MVNC_INVALID_PARAMETERS;
+		mvncLoadParams params = { deadlineSeconds(a->ticket_.deadline), a->ticket_.priority };
+		mvncStatus rc = mvncLoadTensorWithParams(slot->handle, a->input_.data(),
+							 static_cast<unsigned>(a->input_.size_bytes()), a, &params);
+		if (rc == MVNC_OK) {
+			slot->loaded.push(a);
+			slot->inflight++;
+			pending_++;
+		}
+		return rc;
+	}
+
+	// Whether a request failed by a device can go to another one, trying each
+	// once, while any has a weight
+	bool retry(Awaiter *a, mvncStatus rc)
+	{
+		if ((rc != MVNC_ERROR && rc != MVNC_TIMEOUT && rc != MVNC_MYRIAD_ERROR) ||
+		    ++a->tries_ >= slots_.size())
+			return false;
+		refreshWeights(true);
+		for (auto &slot : slots_)
+			if (slot->weight > 0)
+				return true;
+		return false;
+	}
+
+	// MVNC_CANCELLED or MVNC_TIMEOUT for a request that must not be sent anymore
+	static mvncStatus dropped(Awaiter *a, Deadline now)
+	{
+		if (a->stop_.stop_requested())
+			return MVNC_CANCELLED;
+		if (a->ticket_.deadline != Deadline() && now >= a->ticket_.deadline)
+			return MVNC_TIMEOUT;
+		return MVNC_OK;
+	}
+
+	// When a queued request must be resumed if still waiting, none if never
+	static Deadline expiry(const Awaiter *a)
+	{
+		if (a->admitBy_ != Deadline() && (a->ticket_.deadline == Deadline() || a->admitBy_ < a->ticket_.deadline))
+			return a->admitBy_;
+		return a->ticket_.deadline;
+	}
+
+	void arm(Deadline deadline)
+	{
+		itimerspec spec = {};
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+		armed_ = deadline;
+		spec.it_value.tv_sec = ns / 1000000000;
+		spec.it_value.tv_nsec = ns % 1000000000;
+		timerfd_settime(timer_.fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+	}
+
+	// Sets the timer to when MVNC_THERMAL_CONTROL lets the slot take a
+	// request, no completion coming to dispatch it before
+	void pace(Slot *slot)
+	{
+		float ms;
+		unsigned length;
+		if (mvncGetGraphOption(slot->handle, MVNC_THERMAL_WAIT, &ms, &length) != MVNC_OK || ms <= 0)
+			return;
+		paced_ = std::chrono::steady_clock::now() +
+			 std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				 std::chrono::duration<float, std::milli>(ms));
+		if (armed_ == Deadline() || paced_ < armed_)
+			arm(paced_);
+	}
+
+	void wake()
+	{
+		uint64_t one = 1;
+		if (write(stopped_.fd, &one, sizeof(one)) < 0)
+			return;
+	}
+
+	// Returns false when the request failed at once and must not suspend.
+	// The devices of a MVNC_BUSY graph are being recovered.
+	bool submit(Awaiter *a)
+	{
+		Slot *slot;
+		a->ticket_.since = std::chrono::steady_clock::now();
+		if ((a->rc_ = dropped(a, a->ticket_.since)) != MVNC_OK)
+			return false;
+		if (waiting_.empty() && (slot = freeSlot())) {
+			a->rc_ = load(slot, a);
+			if (a->rc_ != MVNC_BUSY)
+				return a->rc_ == MVNC_OK;
+			pace(slot);
+		}
+		if (limit_ && waiting_.size >= limit_) {
+			if (policy_ == MVNC_QUEUE_DROP_OLDEST) {
+				Awaiter *oldest = waiting_.pop();
+				oldest->rc_ = MVNC_DROPPED;
+				shed_.push(oldest);
+				counters_.dropped++;
+				wake();
+			} else if (policy_ == MVNC_QUEUE_BLOCK) {
+				counters_.blocked++;
+				if (timeout_.count())
+					a->admitBy_ = a->ticket_.since + timeout_;
+				blocked_.push(a);
+				watch(a);
+				return true;
+			} else {
+				counters_.rejected++;
+				a->rc_ = MVNC_BUSY;
+				return false;
+			}
+		}
+		waiting_.push(a);
+		watch(a);
+		return true;
+	}
+
+	// Resumes a queued request when stopped or at its expiry()
+	void watch(Awaiter *a)
+	{
+		Deadline deadline = expiry(a);
+		if (a->stop_.stop_possible())
+			a->onStop_.emplace(a->stop_, Wake{this});
+		if (deadline != Deadline() && (armed_ == Deadline() || deadline < armed_))
+			arm(deadline);
+	}
+
+	// Moves the blocked requests to the queue while it has room
+	void admit()
+	{
+		while (!blocked_.empty() && (!limit_ || waiting_.size < limit_)) {
+			Awaiter *a = blocked_.pop();
+			a->admitBy_ = Deadline();
+			waiting_.push(a);
+		}
+	}
+
+	// Loads the waiting requests into the free inputs, adding those that
+	// fail or must not be sent anymore to done
+	void dispatch(List &done)
+	{
+		auto now = std::chrono::steady_clock::now();
+		Slot *slot;
+		admit();
+		while (!waiting_.empty() && (slot = freeSlot())) {
+			Awaiter *a = waiting_.popNext(now);
+			if ((a->rc_ = dropped(a, now)) == MVNC_OK)
+				a->rc_ = load(slot, a);
+			if (a->rc_ == MVNC_BUSY) {
+				List busy;
+				busy.push(a);
+				waiting_.prepend(busy);
+				pace(slot);
+				break;
+			}
+			if (a->rc_ != MVNC_OK)
+				done.push(a);
+			admit();
+		}
+	}
+
+	// Moves the requests of list past their expiry() or stopped to done
+	void expire(List &list, Deadline now, List &done)
+	{
+		List kept;
+		while (!list.empty()) {
+			Awaiter *a = list.pop();
+			if ((a->rc_ = dropped(a, now)) == MVNC_OK && a->admitBy_ != Deadline() && now >= a->admitBy_) {
+				a->rc_ = MVNC_BUSY;
+				counters_.rejected++;
+			}
+			(a->rc_ == MVNC_OK ? kept : done).push(a);
+		}
+		list = kept;
+	}
+
+	// Resumes the queued requests past their expiry(), stopped or dropped
+	// from a full queue, and sets the timer to the earliest expiry() of the
+	// others or to the end of the thermal pacing
+	void sweep()
+	{
+		auto now = std::chrono::steady_clock::now();
+		Deadline earliest;
+		List done;
+		paced_ = Deadline();
+		done.prepend(shed_);
+		expire(waiting_, now, done);
+		expire(blocked_, now, done);
+		dispatch(done);
+		for (List *list : { &waiting_, &blocked_ })
+			for (Awaiter *a = list->first; a; a = a->next_) {
+				Deadline deadline = expiry(a);
+				if (deadline != Deadline() && (earliest == Deadline() || deadline < earliest))
+					earliest = deadline;
+			}
+		if (paced_ != Deadline() && (earliest == Deadline() || paced_ < earliest))
+			earliest = paced_;
+		arm(earliest);
+		while (!done.empty())
+			done.pop()->handle_.resume();
+	}
+
+	void completed(Slot *slot)
+	{
+		uint64_t count;
+		List done, retried;
+
+		if (read(slot->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+			return;
+		while (!slot->loaded.empty()) {
+			Awaiter *a = slot->loaded.first;
+			void *param;
+			unsigned length;
+			mvncStatus rc = mvncGetResultToBuffer(slot->handle, a->output_.data(),
+				static_cast<unsigned>(a->output_.size_bytes()), &length, &param);
+			if (rc == MVNC_NO_DATA)
+				break;
+			slot->loaded.pop();
+			slot->inflight--;
+			pending_--;
+			if (rc != MVNC_OK && retry(a, rc)) {
+				retried.push(a);
+				continue;
+			}
+			a->rc_ = rc;
+			done.push(a);
+		}
+		waiting_.prepend(retried);
+		// Keep the device busy before running the requests
+		refreshWeights();
+		dispatch(done);
+		while (!done.empty())
+			done.pop()->handle_.resume();
+	}
+
+	Executor &executor_;
+	std::vector<std::unique_ptr<Slot>> slots_;
+	Sweeper timer_, stopped_;
+	Deadline armed_;	// Of timer_, none when disarmed
+	Deadline paced_;	// When MVNC_THERMAL_CONTROL lets the request at the head go
+	List waiting_;
+	List blocked_;		// By a full queue, MVNC_QUEUE_BLOCK
+	List shed_;		// Dropped from a full queue, to resume
+	size_t limit_ = 0;
+	mvncQueuePolicy policy_ = MVNC_QUEUE_REJECT;
+	std::chrono::milliseconds timeout_{0};
+	QueueCounters counters_;
+	unsigned pending_ = 0;
+	std::chrono::steady_clock::time_point refreshed_;
+	size_t inputSize_ = 0, outputSize_ = 0;
+};
+
+} // namespace mvnc
+
+#endif
@@ -0,0 +1,99 @@
+# Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# asyncio interface. A library thread fetches the results as soon as they are
+# ready and signals them on a file descriptor watched by the event loop, so no
+# thread blocks in the API and one loop can keep many devices busy:
+#
+#     graphs = [AsyncGraph(g) for g in AllocateGraphs(devices, graphfile)]
+#     output, userobj = await graphs[0].infer(tensor, userobj)
+
+import asyncio
+import collections
+import os
+from .mvncapi import GraphOption, Status
+
+
+class AsyncGraph:
+    def __init__(self, graph, loop=None):
+        """Wraps a Graph on which no tensor has been loaded yet. The graph is put in non-blocking mode."""
+        self.graph = graph
+        self.loop = loop or asyncio.get_event_loop()
+        self.fd = graph.GetGraphOption(GraphOption.COMPLETION_FD)
+        graph.SetGraphOption(GraphOption.DONT_BLOCK, 1)
+        self.results = collections.deque()      # Futures of the loaded tensors, oldest first
+        self.unclaimed = collections.deque()    # Those loaded by load_tensor, for get_result
+        self.waiters = collections.deque()      # Loads waiting for a free input
+        self.loop.add_reader(self.fd, self._completed)
+
+    def close(self):
+        """Stops watching the graph, to be called before deallocating it."""
+        self.loop.remove_reader(self.fd)
+        for future in list(self.results) + list(self.waiters):
+            future.cancel()
+        self.results.clear()
+        self.unclaimed.clear()
+        self.waiters.clear()
+
+    def _completed(self):
+        try:
+            os.read(self.fd, 8)
+        except BlockingIOError:
+            pass
+        while self.results:
+            try:
+                output, userobj = self.graph.GetResult()
+            except Exception as e:
+                future = self.results.popleft()
+                if not future.done():
+                    future.set_exception(e)
+                continue
+            if output is None:
+                break
+            future = self.results.popleft()
+            if not future.done():
+                future.set_result((output, userobj))
+        while self.waiters:
+            self._wake(self.waiters.popleft())
+
+    def _wake(self, waiter):
+        if not waiter.done():
+            waiter.set_result(None)
+
+    async def _load(self, tensor, userobj):
+        while not self.graph.LoadTensor(tensor, userobj):
+            waiter = self.loop.create_future()
+            self.waiters.append(waiter)
+            # When paced by THERMAL_CONTROL, no completion may come before the pace is over
+            wait = self.graph.GetGraphOption(GraphOption.THERMAL_WAIT)
+            if wait > 0:
+                self.loop.call_later(wait * 1e-3, self._wake, waiter)
+            await waiter
+        future = self.loop.create_future()
+        self.results.append(future)
+        return future
+
+    async def load_tensor(self, tensor, userobj=None):
+        """Loads a tensor, waiting for an input of the device to be free."""
+        self.unclaimed.append(await self._load(tensor, userobj))
+
+    async def get_result(self):
+        """Returns the result and user object of the oldest tensor loaded with load_tensor."""
+        if not self.unclaimed:
+            raise Exception(Status.NO_DATA)
+        return await self.unclaimed.popleft()
+
+    async def infer(self, tensor, userobj=None):
+        """Loads a tensor and returns its result and user object."""
+        return await (await self._load(tensor, userobj))
@@ -57,6 +57,8 @@ class mvncStatus(Enum):
     GONE = -9
     UNSUPPORTED_GRAPH_FILE = -10
     MYRIAD_ERROR = -11
+    CANCELLED = -12
+    DROPPED = -13
 
 Status = EnumDeprecationHelper(mvncStatus, {"MVCMDNOTFOUND": "MVCMD_NOT_FOUND",
                                             "NODATA": "NO_DATA",
@@ -66,6 +68,7 @@ Status = EnumDeprecationHelper(mvncStatus, {"MVCMDNOTFOUND": "MVCMD_NOT_FOUND",
 
 class mvncGlobalOption(Enum):
     LOG_LEVEL = 0
+    TRACE = 1
 
 GlobalOption = EnumDeprecationHelper(mvncGlobalOption, {"LOGLEVEL": "LOG_LEVEL"})
 
@@ -80,6 +83,12 @@ class mvncDeviceOption(Enum):
     THERMAL_STATS = 1000
     OPTIMISATION_LIST = 1001
     THERMAL_THROTTLING_LEVEL = 1002
+    DEVICE_STATS = 1003
+    THERMAL_FD = 1004
+    THERMAL_CONTROL = 1005
+    THERMAL_TARGET = 1006
+    DISPATCH_WEIGHT = 1007
+    WATCHDOG = 1008
 
 DeviceOption = EnumDeprecationHelper(mvncDeviceOption, {"THERMALSTATS": "THERMAL_STATS",
                                                         "OPTIMISATIONLIST": "OPTIMISATION_LIST"})
@@ -91,12 +100,241 @@ class mvncGraphOption(Enum):
     DONT_BLOCK = 2
     TIME_TAKEN = 1000
     DEBUG_INFO = 1001
+    UPLOAD_THROUGHPUT = 1002
+    COMPLETION_FD = 1003
+    HOST_TIMES = 1004
+    GRAPH_STATS = 1005
+    STAGE_STATS = 1006
+    GRAPH_WEIGHT = 1007
+    QUEUE_LIMIT = 1008
+    QUEUE_POLICY = 1009
+    QUEUE_TIMEOUT = 1010
+    THERMAL_WAIT = 1011
 
 GraphOption = EnumDeprecationHelper(mvncGraphOption, {"DONTBLOCK": "DONT_BLOCK",
                                                       "TIMETAKEN": "TIME_TAKEN",
                                                       "DEBUGINFO": "DEBUG_INFO"})
 
 
+class QueuePolicy(Enum):
+    REJECT = 0
+    DROP_OLDEST = 1
+    BLOCK = 2
+
+
+class mvncTensorShape(Structure):
+    _fields_ = [('x', c_uint), ('y', c_uint), ('z', c_uint),
+                ('strideX', c_uint), ('strideY', c_uint), ('strideZ', c_uint)]
+
+    def todict(self):
+        return {'dims': (self.x, self.y, self.z),
+                'strides': (self.strideX, self.strideY, self.strideZ)}
+
+
+class mvncGraphFileInfo(Structure):
+    _fields_ = [('version', c_uint), ('stageCount', c_uint),
+                ('firstShave', c_uint), ('lastShave', c_uint),
+                ('input', mvncTensorShape), ('output', mvncTensorShape),
+                ('inputLength', c_uint), ('outputLength', c_uint)]
+
+
+class mvncStageInfo(Structure):
+    _fields_ = [('name', c_char * 100), ('type', c_int),
+                ('dataType', c_int), ('precision', c_int), ('storageOrder', c_int),
+                ('input', mvncTensorShape), ('taps', mvncTensorShape), ('output', mvncTensorShape)]
+
+
+class mvncHostTimes(Structure):
+    _fields_ = [('start', c_double), ('slotWait', c_float), ('lockWait', c_float),
+                ('upload', c_float), ('device', c_float), ('download', c_float), ('aux', c_float),
+                ('uploadBytes', c_uint), ('downloadBytes', c_uint), ('auxBytes', c_uint)]
+
+    def todict(self):
+        return {name: getattr(self, name) for name, _ in self._fields_}
+
+
+LATENCY_BUCKETS = 176
+
+
+class mvncStats(Structure):
+    _fields_ = [('seconds', c_double), ('inferences', c_ulonglong),
+                ('bytesIn', c_ulonglong), ('bytesOut', c_ulonglong), ('deviceMicroseconds', c_ulonglong),
+                ('busy', c_ulonglong), ('timeouts', c_ulonglong), ('myriadErrors', c_ulonglong),
+                ('errors', c_ulonglong), ('retries', c_ulonglong), ('throttled', c_ulonglong),
+                ('resets', c_ulonglong), ('replays', c_ulonglong), ('expired', c_ulonglong),
+                ('cancelled', c_ulonglong), ('rejected', c_ulonglong), ('dropped', c_ulonglong),
+                ('blocked', c_ulonglong), ('latency', c_ulonglong * LATENCY_BUCKETS)]
+
+    def todict(self):
+        """Returns the counters, the latency histogram as an array and its main percentiles in ms."""
+        d = {name: getattr(self, name) for name, _ in self._fields_ if name != 'latency'}
+        d['latency'] = numpy.array(self.latency, dtype=numpy.uint64)
+        d['latency_ms'] = {}
+        ms = c_float()
+        for p in (50, 90, 99, 99.9):
+            if f.mvncStatsPercentile(byref(self), c_float(p), byref(ms)) == Status.OK.value:
+                d['latency_ms'][p] = ms.value
+        return d
+
+
+class mvncStageStats(Structure):
+    _fields_ = [('count', c_ulonglong), ('min', c_float), ('max', c_float), ('mean', c_float),
+                ('time', c_ulonglong * LATENCY_BUCKETS)]
+
+    def todict(self):
+        """Returns the times of the stage in ms, with the histogram as an array and its main percentiles."""
+        d = {name: getattr(self, name) for name, _ in self._fields_ if name != 'time'}
+        d['time'] = numpy.array(self.time, dtype=numpy.uint64)
+        ms = c_float()
+        for p in (50, 90, 99):
+            if f.mvncHistogramPercentile(self.time, c_float(p), byref(ms)) == Status.OK.value:
+                d['p%d' % p] = ms.value
+        return d
+
+
+class mvncThermalSample(Structure):
+    _fields_ = [('time', c_double), ('sequence', c_ulonglong), ('temperature', c_float), ('throttle', c_int)]
+
+    def todict(self):
+        return {name: getattr(self, name) for name, _ in self._fields_}
+
+
+class mvncThermalControl(Structure):
+    _fields_ = [('enabled', c_int), ('target', c_float), ('temperature', c_float), ('duty', c_float),
+                ('deviceMs', c_float), ('sustainedRate', c_float), ('rate', c_float)]
+
+    def todict(self):
+        return {name: getattr(self, name) for name, _ in self._fields_}
+
+
+class mvncPreprocessParams(Structure):
+    _fields_ = [('channelOrder', c_int * 3), ('mean', c_float * 3), ('scale', c_float * 3)]
+
+
+class mvncLoadParams(Structure):
+    _fields_ = [('deadline', c_double), ('priority', c_int)]
+
+
+def PreprocessImage(image, width, height, mean=(0, 0, 0), scale=(1, 1, 1), order=(2, 1, 0), out=None):
+    """Resizes an uint8 HxWxC image to width x height, reorders the channels (RGB to BGR by
+    default), subtracts mean, multiplies by scale and returns the float16 tensor."""
+    image = numpy.asarray(image, dtype=numpy.uint8)
+    if image.ndim == 2:
+        image = image[:, :, numpy.newaxis]
+    channels = image.shape[2]
+    if image.strides[2] != 1 or image.strides[1] != channels:
+        image = numpy.ascontiguousarray(image)
+    if numpy.isscalar(mean):
+        mean = (mean,) * 3
+    if numpy.isscalar(scale):
+        scale = (scale,) * 3
+    shape = (height, width, 1 if channels == 1 else 3)
+    if out is None:
+        out = numpy.empty(shape, dtype=numpy.float16)
+    elif out.dtype != numpy.float16 or out.size != shape[0] * shape[1] * shape[2] or not out.flags['C_CONTIGUOUS']:
+        raise Exception(Status.INVALID_PARAMETERS)
+    params = mvncPreprocessParams((c_int * 3)(*order), (c_float * 3)(*mean), (c_float * 3)(*scale))
+    status = f.mvncPreprocessImage(c_void_p(image.ctypes.data), image.shape[1], image.shape[0], image.strides[0],
+                                   channels, c_void_p(out.ctypes.data), width, height, byref(params))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return out
+
+
+def GetGraphFileInfo(graphfile):
+    info = mvncGraphFileInfo()
+    status = f.mvncGetGraphFileInfo(graphfile, len(graphfile), byref(info))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    stages = []
+    for i in range(info.stageCount):
+        stage = mvncStageInfo()
+        status = f.mvncGetGraphFileStage(graphfile, len(graphfile), i, byref(stage))
+        if status != Status.OK.value:
+            raise Exception(Status(status))
+        stages.append({'name': stage.name.decode('utf-8', 'replace'), 'type': stage.type,
+                       'input': stage.input.todict(), 'taps': stage.taps.todict(),
+                       'output': stage.output.todict()})
+    return {'version': info.version,
+            'shaves': (info.firstShave, info.lastShave),
+            'input': info.input.todict(), 'output': info.output.todict(),
+            'input_length': info.inputLength, 'output_length': info.outputLength,
+            'stages': stages}
+
+
+def _halves(tensor):
+    tensor = numpy.ascontiguousarray(tensor, dtype=numpy.float16)
+    return tensor, c_void_p(tensor.ctypes.data), tensor.size
+
+
+def ArgMax(tensor):
+    """Returns the index and value of the largest element of a float16 result."""
+    tensor, data, count = _halves(tensor)
+    index = c_uint()
+    value = c_float()
+    status = f.mvncArgMax(data, count, byref(index), byref(value))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return index.value, value.value
+
+
+def TopK(tensor, k):
+    """Returns the indices and values of the k largest elements, largest first."""
+    tensor, data, count = _halves(tensor)
+    k = min(k, count)
+    indices = numpy.empty(k, dtype=numpy.uint32)
+    values = numpy.empty(k, dtype=numpy.float32)
+    status = f.mvncTopK(data, count, k, c_void_p(indices.ctypes.data), c_void_p(values.ctypes.data))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return indices, values
+
+
+def Softmax(tensor):
+    tensor, data, count = _halves(tensor)
+    probabilities = numpy.empty(count, dtype=numpy.float32)
+    status = f.mvncSoftmax(data, count, c_void_p(probabilities.ctypes.data))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return probabilities
+
+
+def Threshold(tensor, threshold):
+    """Returns the indices of the elements not below threshold."""
+    tensor, data, count = _halves(tensor)
+    indices = numpy.empty(count, dtype=numpy.uint32)
+    found = c_uint()
+    status = f.mvncThreshold(data, count, c_float(threshold), c_void_p(indices.ctypes.data), count, byref(found))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return indices[:found.value]
+
+
+Detection = numpy.dtype([('xmin', numpy.float32), ('ymin', numpy.float32), ('xmax', numpy.float32),
+                         ('ymax', numpy.float32), ('confidence', numpy.float32), ('label', numpy.int32)])
+
+
+def DecodeDetections(tensor, min_confidence=0.5, max_overlap=0.45, max_detections=100):
+    """Decodes the result of an SSD graph into an array of Detection, the most confident first.
+    Coordinates are normalised to the image size. max_overlap=1 disables suppression."""
+    tensor, data, count = _halves(tensor)
+    detections = numpy.empty(max_detections, dtype=Detection)
+    found = c_uint()
+    status = f.mvncDecodeDetections(data, count, c_float(min_confidence), c_float(max_overlap),
+                                    c_void_p(detections.ctypes.data), max_detections, byref(found))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return detections[:found.value]
+
+
+def _output_length(graphfile):
+    info = mvncGraphFileInfo()
+    status = f.mvncGetGraphFileInfo(graphfile, len(graphfile), byref(info))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return info.outputLength
+
+
 def EnumerateDevices():
     name = create_string_buffer(28)
     i = 0
@@ -116,8 +354,15 @@ def SetGlobalOption(opt, data):
         raise Exception(Status(status))
 
 
+def DumpTrace(path):
+    """Writes the events recorded with GlobalOption.TRACE to path as a Chrome trace."""
+    status = f.mvncDumpTrace(path.encode('utf-8'))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+
+
 def GetGlobalOption(opt):
-    if opt == GlobalOption.LOG_LEVEL:
+    if opt == GlobalOption.LOG_LEVEL or opt == GlobalOption.TRACE:
         optsize = c_uint()
         optvalue = c_uint()
         status = f.mvncGetGlobalOption(opt.value, byref(optvalue), byref(optsize))
@@ -134,6 +379,25 @@ def GetGlobalOption(opt):
     return v.raw
 
 
+def AllocateGraphs(devices, graphfile):
+    n = len(devices)
+    hdevices = (c_void_p * n)(*[d.handle.value for d in devices])
+    hgraphs = (c_void_p * n)()
+    status = f.mvncAllocateGraphs(hdevices, hgraphs, n, graphfile, len(graphfile))
+    if status != Status.OK.value:
+        raise Exception(Status(status))
+    return [Graph(c_void_p(h), _output_length(graphfile)) for h in hgraphs]
+
+
+class _TensorBuffer:
+    def __init__(self, device, buffer):
+        self.device = device
+        self.buffer = buffer
+
+    def __del__(self):
+        f.mvncFreeTensorBuffer(self.device, self.buffer)
+
+
 class Device:
     def __init__(self, name):
         self.handle = c_void_p()
@@ -151,7 +415,8 @@ class Device:
             raise Exception(Status(status))
 
     def SetDeviceOption(self, opt, data):
-        if opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER:
+        if (opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER or
+                opt == DeviceOption.THERMAL_TARGET):
             data = c_float(data)
         else:
             data = c_int(data)
@@ -160,23 +425,33 @@ class Device:
             raise Exception(Status(status))
 
     def GetDeviceOption(self, opt):
-        if opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER:
+        if (opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER or
+                opt == DeviceOption.THERMAL_TARGET or opt == DeviceOption.DISPATCH_WEIGHT):
             optdata = c_float()
         elif (opt == DeviceOption.BACKOFF_TIME_NORMAL or opt == DeviceOption.BACKOFF_TIME_HIGH or
               opt == DeviceOption.BACKOFF_TIME_CRITICAL or opt == DeviceOption.TEMPERATURE_DEBUG or
-              opt == DeviceOption.THERMAL_THROTTLING_LEVEL):
+              opt == DeviceOption.THERMAL_THROTTLING_LEVEL or opt == DeviceOption.THERMAL_FD or
+              opt == DeviceOption.WATCHDOG):
             optdata = c_int()
+        elif opt == DeviceOption.DEVICE_STATS:
+            optdata = mvncStats()
+        elif opt == DeviceOption.THERMAL_CONTROL:
+            optdata = mvncThermalControl()
         else:
             optdata = POINTER(c_byte)()
-        optsize = c_uint()
+        optsize = c_uint(sizeof(optdata))
         status = f.mvncGetDeviceOption(self.handle, opt.value, byref(optdata), byref(optsize))
         if status != Status.OK.value:
             raise Exception(Status(status))
-        if opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER:
+        if opt == DeviceOption.DEVICE_STATS or opt == DeviceOption.THERMAL_CONTROL:
+            return optdata.todict()
+        if (opt == DeviceOption.TEMP_LIM_HIGHER or opt == DeviceOption.TEMP_LIM_LOWER or
+                opt == DeviceOption.THERMAL_TARGET or opt == DeviceOption.DISPATCH_WEIGHT):
             return optdata.value
         elif (opt == DeviceOption.BACKOFF_TIME_NORMAL or opt == DeviceOption.BACKOFF_TIME_HIGH or
               opt == DeviceOption.BACKOFF_TIME_CRITICAL or opt == DeviceOption.TEMPERATURE_DEBUG or
-              opt == DeviceOption.THERMAL_THROTTLING_LEVEL):
+              opt == DeviceOption.THERMAL_THROTTLING_LEVEL or opt == DeviceOption.THERMAL_FD or
+              opt == DeviceOption.WATCHDOG):
             return optdata.value
         v = create_string_buffer(optsize.value)
         memmove(v, optdata, optsize.value)
@@ -194,36 +469,79 @@ class Device:
             return numpy.frombuffer(v.raw, dtype=numpy.float32)
         return int.from_bytes(v.raw, byteorder='little')
 
+    def GetThermalHistory(self, sequence=0, count=1024):
+        """Returns up to count thermal samples from number sequence on as a list of dicts, and the
+        sequence to pass to the next call to get the samples taken since."""
+        samples = (mvncThermalSample * count)()
+        seq = c_ulonglong(sequence)
+        n = c_uint(count)
+        status = f.mvncGetThermalHistory(self.handle, byref(seq), samples, byref(n))
+        if status != Status.OK.value:
+            raise Exception(Status(status))
+        return [samples[i].todict() for i in range(n.value)], seq.value
+
     def AllocateGraph(self, graphfile):
         hgraph = c_void_p()
         status = f.mvncAllocateGraph(self.handle, byref(hgraph), graphfile, len(graphfile))
         if status != Status.OK.value:
             raise Exception(Status(status))
-        return Graph(hgraph)
+        return Graph(hgraph, _output_length(graphfile))
+
+    def AllocTensorBuffer(self, shape, dtype=numpy.float16):
+        """Returns an array in page aligned memory from the buffer pool of the device, which tensors
+        can be loaded from and results read into without copies. It must not be used after CloseDevice."""
+        dtype = numpy.dtype(dtype)
+        length = int(numpy.prod(shape)) * dtype.itemsize
+        buffer = c_void_p()
+        status = f.mvncAllocTensorBuffer(self.handle, length, byref(buffer))
+        if status != Status.OK.value:
+            raise Exception(Status(status))
+        memory = (c_byte * length).from_address(buffer.value)
+        memory.owner = _TensorBuffer(c_void_p(self.handle.value), buffer)
+        return numpy.frombuffer(memory, dtype=dtype).reshape(shape)
 
 
 class Graph:
-    def __init__(self, handle):
+    def __init__(self, handle, outputlength):
         self.handle = handle
+        self.outputlength = outputlength
         self.userobjs = {}
 
     def SetGraphOption(self, opt, data):
-        data = c_int(data)
+        data = c_int(data.value if isinstance(data, QueuePolicy) else data)
         status = f.mvncSetGraphOption(self.handle, opt.value, pointer(data), sizeof(data))
         if status != Status.OK.value:
             raise Exception(Status(status))
 
     def GetGraphOption(self, opt):
-        if opt == GraphOption.ITERATIONS or opt == GraphOption.NETWORK_THROTTLE or opt == GraphOption.DONT_BLOCK:
+        if (opt == GraphOption.ITERATIONS or opt == GraphOption.NETWORK_THROTTLE or opt == GraphOption.DONT_BLOCK or
+                opt == GraphOption.COMPLETION_FD or opt == GraphOption.STAGE_STATS or
+                opt == GraphOption.QUEUE_LIMIT or opt == GraphOption.QUEUE_POLICY or
+                opt == GraphOption.QUEUE_TIMEOUT):
             optdata = c_int()
+        elif (opt == GraphOption.UPLOAD_THROUGHPUT or opt == GraphOption.GRAPH_WEIGHT or
+              opt == GraphOption.THERMAL_WAIT):
+            optdata = c_float()
+        elif opt == GraphOption.HOST_TIMES:
+            optdata = mvncHostTimes()
+        elif opt == GraphOption.GRAPH_STATS:
+            optdata = mvncStats()
         else:
             optdata = POINTER(c_byte)()
-        optsize = c_uint()
+        optsize = c_uint(sizeof(optdata))
         status = f.mvncGetGraphOption(self.handle, opt.value, byref(optdata), byref(optsize))
         if status != Status.OK.value:
             raise Exception(Status(status))
-        if opt == GraphOption.ITERATIONS or opt == GraphOption.NETWORK_THROTTLE or opt == GraphOption.DONT_BLOCK:
+        if (opt == GraphOption.ITERATIONS or opt == GraphOption.NETWORK_THROTTLE or opt == GraphOption.DONT_BLOCK or
+                opt == GraphOption.UPLOAD_THROUGHPUT or opt == GraphOption.COMPLETION_FD or
+                opt == GraphOption.STAGE_STATS or opt == GraphOption.GRAPH_WEIGHT or
+                opt == GraphOption.QUEUE_LIMIT or opt == GraphOption.QUEUE_TIMEOUT or
+                opt == GraphOption.THERMAL_WAIT):
             return optdata.value
+        if opt == GraphOption.QUEUE_POLICY:
+            return QueuePolicy(optdata.value)
+        if opt == GraphOption.HOST_TIMES or opt == GraphOption.GRAPH_STATS:
+            return optdata.todict()
         v = create_string_buffer(optsize.value)
         memmove(v, optdata, optsize.value)
         if opt == GraphOption.TIME_TAKEN:
@@ -232,18 +550,42 @@ class Graph:
             return v.raw[0:v.raw.find(0)].decode()
         return int.from_bytes(v.raw, byteorder='little')
 
+    def GetStageStats(self):
+        """Returns the accumulated times of each stage as a list of dicts, after
+        SetGraphOption(GraphOption.STAGE_STATS, 1)."""
+        stats = []
+        stage = mvncStageStats()
+        while True:
+            status = f.mvncGetStageStats(self.handle, len(stats), byref(stage))
+            if status == Status.INVALID_PARAMETERS.value and stats:
+                return stats
+            if status != Status.OK.value:
+                raise Exception(Status(status))
+            stats.append(stage.todict())
+
     def DeallocateGraph(self):
         status = f.mvncDeallocateGraph(self.handle)
         self.handle = 0
         if status != Status.OK.value:
             raise Exception(Status(status))
 
-    def LoadTensor(self, tensor, userobj):
-        tensor = tensor.tostring()
+    def LoadTensor(self, tensor, userobj, deadline=None, priority=0):
+        """Loads a float16 tensor from an array or any object supporting the buffer protocol,
+        without copying it unless it is not contiguous. With a deadline in seconds of
+        time.monotonic(), the tensor is dropped with Status.TIMEOUT if it cannot be sent by then.
+        Threads waiting to send are served by priority, higher first, then by deadline."""
+        if not isinstance(tensor, numpy.ndarray):
+            tensor = numpy.frombuffer(tensor, dtype=numpy.uint8)
+        tensor = numpy.ascontiguousarray(tensor)
         userobj = py_object(userobj)
         key = c_long(addressof(userobj))
         self.userobjs[key.value] = userobj
-        status = f.mvncLoadTensor(self.handle, tensor, len(tensor), key)
+        if deadline is None and not priority:
+            status = f.mvncLoadTensor(self.handle, c_void_p(tensor.ctypes.data), tensor.nbytes, key)
+        else:
+            params = mvncLoadParams(deadline or 0, priority)
+            status = f.mvncLoadTensorWithParams(self.handle, c_void_p(tensor.ctypes.data), tensor.nbytes,
+                                                key, byref(params))
         if status == Status.BUSY.value:
             return False
         if status != Status.OK.value:
@@ -251,18 +593,40 @@ class Graph:
             raise Exception(Status(status))
         return True
 
-    def GetResult(self):
-        tensor = c_void_p()
+    def CancelTensors(self, userobj):
+        """Makes the LoadTensor calls of other threads waiting to send a tensor with userobj raise
+        Status.CANCELLED, returning whether there were any."""
+        found = False
+        for key, obj in list(self.userobjs.items()):
+            if obj.value is userobj:
+                status = f.mvncCancelTensors(self.handle, c_void_p(key))
+                if status not in (Status.OK.value, Status.NO_DATA.value):
+                    raise Exception(Status(status))
+                found = found or status == Status.OK.value
+        return found
+
+    def GetResult(self, out=None, deadline=None):
+        """Returns the result and user object of the oldest loaded tensor. The result is read directly
+        into out when given, a writable contiguous array holding the whole output, else into a new
+        float16 array. With a deadline in seconds of time.monotonic(), returns (None, None) if the
+        result is not ready by then, the inference staying in flight."""
+        if out is None:
+            out = numpy.empty(self.outputlength // 2, dtype=numpy.float16)
+        elif not out.flags['C_CONTIGUOUS'] or not out.flags['WRITEABLE'] or out.nbytes < self.outputlength:
+            raise Exception(Status.INVALID_PARAMETERS)
         tensorlen = c_uint()
         userobj = c_long()
-        status = f.mvncGetResult(self.handle, byref(tensor), byref(tensorlen), byref(userobj))
+        if deadline is None:
+            status = f.mvncGetResultToBuffer(self.handle, c_void_p(out.ctypes.data), out.nbytes,
+                                             byref(tensorlen), byref(userobj))
+        else:
+            status = f.mvncGetResultWithDeadline(self.handle, c_void_p(out.ctypes.data), out.nbytes,
+                                                 byref(tensorlen), byref(userobj), c_double(deadline))
         if status == Status.NO_DATA.value:
             return None, None
         if status != Status.OK.value:
             raise Exception(Status(status))
-        v = create_string_buffer(tensorlen.value)
-        memmove(v, tensor, tensorlen.value)
-        tensor = numpy.frombuffer(v.raw, dtype=numpy.float16)
+        tensor = out
         retuserobj = self.userobjs[userobj.value]
         del self.userobjs[userobj.value]
         return tensor, retuserobj.value
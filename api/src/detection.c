@@ -0,0 +1,208 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Decoding of the DetectionOutput result of SSD graphs.
+// The result holds the number of boxes in its first element, then from
+// element 7 one record of 7 halves per box: image id, label, confidence,
+// xmin, ymin, xmax, ymax, with coordinates normalised to the image size.
+// An image id below 0 ends the list early. Boxes are then suppressed per
+// class, keeping the most confident of boxes overlapping more than
+// maxOverlap (intersection over union).
+
+#include <stdlib.h>
+#include <math.h>
+#include "mvnc.h"
+#include "fp16.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define RECORD_SIZE 7
+
+struct rank {
+	float confidence;
+	unsigned index;
+};
+
+// Candidates sorted by confidence, as arrays so that the suppression
+// loop can test four boxes at a time
+struct candidates {
+	unsigned n;
+	float *xmin, *ymin, *xmax, *ymax, *area, *label, *confidence;
+	int *suppressed;
+	struct rank *rank;
+};
+
+static float clamp01(float v)
+{
+	return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+static int by_confidence(const void *a, const void *b)
+{
+	const struct rank *x = a, *y = b;
+
+	if (x->confidence != y->confidence)
+		return x->confidence < y->confidence ? 1 : -1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static int alloc_candidates(struct candidates *c, unsigned n)
+{
+	// One block, seven float arrays padded to a multiple of four, then the
+	// suppressed flags and the sort order
+	unsigned padded = (n + 3) & ~3u;
+	float *f = malloc(padded * (7 * sizeof(float) + sizeof(int) + sizeof(struct rank)));
+
+	if (!f)
+		return -1;
+	c->xmin = f;
+	c->ymin = f + padded;
+	c->xmax = f + 2 * padded;
+	c->ymax = f + 3 * padded;
+	c->area = f + 4 * padded;
+	c->label = f + 5 * padded;
+	c->confidence = f + 6 * padded;
+	c->suppressed = (int *) (f + 7 * padded);
+	c->rank = (struct rank *) (c->suppressed + padded);
+	c->n = 0;
+	return 0;
+}
+
+// Reads the boxes above minConfidence, sorted by decreasing confidence
+static void read_candidates(struct candidates *c, const uint16_t *h, unsigned boxes, float minConfidence)
+{
+	unsigned i, k;
+
+	for (i = 0; i < boxes; i++) {
+		const uint16_t *r = h + RECORD_SIZE * (i + 1);
+		float confidence = fp16_to_float(r[2]);
+
+		if (fp16_to_float(r[0]) < 0)
+			break;
+		if (!(confidence >= minConfidence))
+			continue;
+		for (k = 3; k < RECORD_SIZE; k++)
+			if (!isfinite(fp16_to_float(r[k])))
+				break;
+		if (k < RECORD_SIZE)
+			continue;
+		c->rank[c->n].confidence = confidence;
+		c->rank[c->n++].index = i;
+	}
+	qsort(c->rank, c->n, sizeof(struct rank), by_confidence);
+	for (i = 0; i < c->n; i++) {
+		const uint16_t *r = h + RECORD_SIZE * (c->rank[i].index + 1);
+
+		c->label[i] = fp16_to_float(r[1]);
+		c->confidence[i] = c->rank[i].confidence;
+		c->xmin[i] = clamp01(fp16_to_float(r[3]));
+		c->ymin[i] = clamp01(fp16_to_float(r[4]));
+		c->xmax[i] = clamp01(fp16_to_float(r[5]));
+		c->ymax[i] = clamp01(fp16_to_float(r[6]));
+		c->suppressed[i] = 0;
+	}
+	for (i = 0; i < c->n; i++) {
+		float w = c->xmax[i] - c->xmin[i], h = c->ymax[i] - c->ymin[i];
+
+		c->area[i] = w > 0 && h > 0 ? w * h : 0;
+	}
+}
+
+// Suppresses the boxes after i with the same label overlapping it more than
+// maxOverlap. The overlap test is intersection > maxOverlap * union, which
+// needs no division.
+static void suppress(struct candidates *c, unsigned i, float maxOverlap)
+{
+	unsigned j = i + 1;
+
+#ifdef __SSE2__
+	__m128 label = _mm_set1_ps(c->label[i]);
+	__m128 xmin = _mm_set1_ps(c->xmin[i]), ymin = _mm_set1_ps(c->ymin[i]);
+	__m128 xmax = _mm_set1_ps(c->xmax[i]), ymax = _mm_set1_ps(c->ymax[i]);
+	__m128 area = _mm_set1_ps(c->area[i]), overlap = _mm_set1_ps(maxOverlap);
+	__m128 zero = _mm_setzero_ps();
+
+	for (; j + 4 <= c->n; j += 4) {
+		__m128 w = _mm_sub_ps(_mm_min_ps(xmax, _mm_loadu_ps(c->xmax + j)),
+		                      _mm_max_ps(xmin, _mm_loadu_ps(c->xmin + j)));
+		__m128 h = _mm_sub_ps(_mm_min_ps(ymax, _mm_loadu_ps(c->ymax + j)),
+		                      _mm_max_ps(ymin, _mm_loadu_ps(c->ymin + j)));
+		__m128 inter = _mm_mul_ps(_mm_max_ps(w, zero), _mm_max_ps(h, zero));
+		__m128 uni = _mm_sub_ps(_mm_add_ps(area, _mm_loadu_ps(c->area + j)), inter);
+		__m128 hit = _mm_and_ps(_mm_cmpeq_ps(label, _mm_loadu_ps(c->label + j)),
+		                        _mm_cmpgt_ps(inter, _mm_mul_ps(overlap, uni)));
+		int mask = _mm_movemask_ps(hit), k;
+
+		for (k = 0; k < 4; k++)
+			if (mask & (1 << k))
+				c->suppressed[j + k] = 1;
+	}
+#endif
+	for (; j < c->n; j++) {
+		float w, h, inter;
+
+		if (c->label[j] != c->label[i])
+			continue;
+		w = fminf(c->xmax[i], c->xmax[j]) - fmaxf(c->xmin[i], c->xmin[j]);
+		h = fminf(c->ymax[i], c->ymax[j]) - fmaxf(c->ymin[i], c->ymin[j]);
+		inter = (w > 0 ? w : 0) * (h > 0 ? h : 0);
+		if (inter > maxOverlap * (c->area[i] + c->area[j] - inter))
+			c->suppressed[j] = 1;
+	}
+}
+
+mvncStatus mvncDecodeDetections(const void *tensor, unsigned int count, float minConfidence, float maxOverlap,
+                                mvncDetection *detections, unsigned int maxDetections, unsigned int *found)
+{
+	const uint16_t *h = tensor;
+	struct candidates c;
+	unsigned boxes, i, n = 0;
+	float declared;
+
+	if (!tensor || !found || (maxDetections && !detections) || count < RECORD_SIZE)
+		return MVNC_INVALID_PARAMETERS;
+
+	boxes = count / RECORD_SIZE - 1;
+	declared = fp16_to_float(h[0]);
+	if (!(declared >= 0))
+		boxes = 0;
+	else if (declared < boxes)
+		boxes = (unsigned) declared;
+
+	if (alloc_candidates(&c, boxes ? boxes : 1))
+		return MVNC_OUT_OF_MEMORY;
+	read_candidates(&c, h, boxes, minConfidence);
+
+	for (i = 0; i < c.n && n < maxDetections; i++) {
+		if (c.suppressed[i])
+			continue;
+		detections[n].xmin = c.xmin[i];
+		detections[n].ymin = c.ymin[i];
+		detections[n].xmax = c.xmax[i];
+		detections[n].ymax = c.ymax[i];
+		detections[n].confidence = c.confidence[i];
+		detections[n].label = (int) c.label[i];
+		n++;
+		if (maxOverlap < 1)
+			suppress(&c, i, maxOverlap);
+	}
+	free(c.xmin);
+	*found = n;
+	return MVNC_OK;
+}
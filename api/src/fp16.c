@@ -0,0 +1,300 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Conversion between float and the half precision floats used by the device.
+// The branch free formulation follows the one used in numpy and in
+// Fabian Giesen's public domain half conversion code.
+
+#include <string.h>
+#include "mvnc.h"
+#include "fp16.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_VARIANTS
+#endif
+
+static uint32_t as_bits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float as_float(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+uint16_t fp16_from_float(float f)
+{
+	uint32_t u = as_bits(f);
+	uint32_t sign = (u >> 16) & 0x8000;
+	uint32_t o;
+
+	u &= 0x7fffffff;
+	if (u >= 0x47800000) {
+		// Overflow to inf, NaNs keep the top of their payload and become quiet
+		o = u > 0x7f800000 ? 0x7e00 | ((u >> 13) & 0x3ff) : 0x7c00;
+	} else if (u < 0x38800000) {
+		// Subnormal or zero: let the FPU round the mantissa at the right place
+		o = as_bits(as_float(u) + as_float(0x3f000000)) - 0x3f000000;
+	} else {
+		// Normal: rebias the exponent and round to nearest even
+		o = (u + 0xc8000fff + ((u >> 13) & 1)) >> 13;
+	}
+	return o | sign;
+}
+
+float fp16_to_float(uint16_t h)
+{
+	uint32_t u = (uint32_t) (h & 0x7fff) << 13;
+	uint32_t exp = u & 0x0f800000;
+
+	u += 0x38000000;
+	if (exp == 0x0f800000) {
+		// Inf or NaN, NaNs become quiet
+		u += 0x38000000;
+		if (u & 0x007fffff)
+			u |= 0x00400000;
+	} else if (exp == 0) {
+		// Zero or subnormal: renormalise
+		u = as_bits(as_float(u + 0x00800000) - as_float(0x38800000));
+	}
+	return as_float(u | (uint32_t) (h & 0x8000) << 16);
+}
+
+static int scalar_supported(void)
+{
+	return 1;
+}
+
+static void scalar_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = fp16_from_float(src[i]);
+}
+
+static void scalar_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = fp16_to_float(src[i]);
+}
+
+#ifdef HAVE_X86_VARIANTS
+// SSE2 is part of every x86_64 processor, so this is the baseline there.
+// Same algorithm as the scalar code with selects instead of branches.
+static int sse2_supported(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("sse2")))
+static __m128i sse2_from_float4(__m128 f)
+{
+	const __m128i abs_mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i denorm_magic = _mm_set1_epi32(0x3f000000);
+	__m128i u = _mm_castps_si128(f);
+	__m128i sign = _mm_and_si128(_mm_srli_epi32(u, 16), _mm_set1_epi32(0x8000));
+	__m128i a = _mm_and_si128(u, abs_mask);
+
+	// Overflow, inf and NaN
+	__m128i is_nan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7f800000));
+	__m128i nan = _mm_or_si128(_mm_set1_epi32(0x7e00),
+				   _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(0x3ff)));
+	__m128i special = _mm_or_si128(_mm_and_si128(is_nan, nan),
+				       _mm_andnot_si128(is_nan, _mm_set1_epi32(0x7c00)));
+	__m128i is_special = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x477fffff));
+
+	// Subnormal and zero
+	__m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a),
+					_mm_castsi128_ps(denorm_magic))), denorm_magic);
+	__m128i is_sub = _mm_cmplt_epi32(a, _mm_set1_epi32(0x38800000));
+
+	// Normal
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1));
+	__m128i norm = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a,
+					_mm_set1_epi32(0xc8000fff)), odd), 13);
+
+	__m128i o = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, norm));
+	o = _mm_or_si128(_mm_and_si128(is_special, special), _mm_andnot_si128(is_special, o));
+	return _mm_or_si128(o, sign);
+}
+
+__attribute__((target("sse2")))
+static __m128 sse2_to_float4(__m128i h)
+{
+	const __m128i exp_mask = _mm_set1_epi32(0x0f800000);
+	__m128i u = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+	__m128i exp = _mm_and_si128(u, exp_mask);
+	__m128i is_special = _mm_cmpeq_epi32(exp, exp_mask);
+	__m128i is_sub = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+
+	u = _mm_add_epi32(u, _mm_set1_epi32(0x38000000));
+
+	// Inf and NaN, NaNs become quiet
+	__m128i special = _mm_add_epi32(u, _mm_set1_epi32(0x38000000));
+	__m128i is_nan = _mm_cmpgt_epi32(_mm_and_si128(u, _mm_set1_epi32(0x007fffff)),
+					 _mm_setzero_si128());
+	special = _mm_or_si128(special, _mm_and_si128(is_nan, _mm_set1_epi32(0x00400000)));
+
+	// Zero and subnormal
+	__m128i sub = _mm_castps_si128(_mm_sub_ps(
+			_mm_castsi128_ps(_mm_add_epi32(u, _mm_set1_epi32(0x00800000))),
+			_mm_castsi128_ps(_mm_set1_epi32(0x38800000))));
+
+	u = _mm_or_si128(_mm_and_si128(is_special, special), _mm_andnot_si128(is_special, u));
+	u = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, u));
+	u = _mm_or_si128(u, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+	return _mm_castsi128_ps(u);
+}
+
+__attribute__((target("sse2")))
+static void sse2_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i lo = sse2_from_float4(_mm_loadu_ps(src + i));
+		__m128i hi = sse2_from_float4(_mm_loadu_ps(src + i + 4));
+		// Values fit in 16 bits, sign extend them so that the signed pack keeps them
+		lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+		hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(lo, hi));
+	}
+	scalar_float_to_half(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i h = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_ps(dst + i, sse2_to_float4(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+		_mm_storeu_ps(dst + i + 4, sse2_to_float4(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+	}
+	scalar_half_to_float(dst + i, src + i, n - i);
+}
+
+// F16C does the conversion in hardware, eight values per instruction in the
+// AVX registers. AVX2 adds nothing to it, so there is no AVX2 variant.
+static int f16c_supported(void)
+{
+	return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+__attribute__((target("avx,f16c")))
+static void f16c_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i a = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+		__m128i b = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i *) (dst + i), a);
+		_mm_storeu_si128((__m128i *) (dst + i + 8), b);
+	}
+	for (; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *) (dst + i),
+				 _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+	scalar_float_to_half(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void f16c_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256 a = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i)));
+		__m256 b = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i + 8)));
+		_mm256_storeu_ps(dst + i, a);
+		_mm256_storeu_ps(dst + i + 8, b);
+	}
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i))));
+	scalar_half_to_float(dst + i, src + i, n - i);
+}
+#endif
+
+const struct fp16_variant fp16_variants[] = {
+	{"scalar", scalar_supported, scalar_float_to_half, scalar_half_to_float},
+#ifdef HAVE_X86_VARIANTS
+	{"sse2", sse2_supported, sse2_float_to_half, sse2_half_to_float},
+	{"f16c", f16c_supported, f16c_float_to_half, f16c_half_to_float},
+#endif
+#if defined(__arm__) || defined(__aarch64__)
+	{"neon", fp16_neon_supported, fp16_neon_float_to_half, fp16_neon_half_to_float},
+#endif
+	{NULL, NULL, NULL, NULL}
+};
+
+static const struct fp16_variant *selected = &fp16_variants[0];
+
+void __attribute__ ((constructor)) fp16_select_variant()
+{
+	const struct fp16_variant *v;
+
+#ifdef HAVE_X86_VARIANTS
+	// Constructors may run before the one of libgcc filling the CPU model
+	__builtin_cpu_init();
+#endif
+	for (v = fp16_variants; v->name; v++)
+		if (v->supported())
+			selected = v;
+}
+
+void fp16_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+	selected->float_to_half(dst, src, n);
+}
+
+void fp16_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+	selected->half_to_float(dst, src, n);
+}
+
+const char *fp16_variant_name(void)
+{
+	return selected->name;
+}
+
+mvncStatus mvncFloatToHalf(void *dst, const float *src, unsigned int count)
+{
+	if (!dst || !src)
+		return MVNC_INVALID_PARAMETERS;
+
+	selected->float_to_half((uint16_t *) dst, src, count);
+	return MVNC_OK;
+}
+
+mvncStatus mvncHalfToFloat(float *dst, const void *src, unsigned int count)
+{
+	if (!dst || !src)
+		return MVNC_INVALID_PARAMETERS;
+
+	selected->half_to_float(dst, (const uint16_t *) src, count);
+	return MVNC_OK;
+}
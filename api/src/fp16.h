@@ -0,0 +1,48 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef _FP16_H
+#define _FP16_H
+#include <stdint.h>
+
+// All variants round to nearest even and quiet NaNs,
+// so they produce the same bits as the scalar one
+struct fp16_variant {
+	const char *name;
+	int (*supported)(void);
+	void (*float_to_half)(uint16_t *dst, const float *src, unsigned n);
+	void (*half_to_float)(float *dst, const uint16_t *src, unsigned n);
+};
+
+// Terminated by an entry with a NULL name, best variant last
+extern const struct fp16_variant fp16_variants[];
+
+uint16_t fp16_from_float(float f);
+float fp16_to_float(uint16_t h);
+
+// Best supported variant, selected when the library is loaded
+void fp16_float_to_half(uint16_t *dst, const float *src, unsigned n);
+void fp16_half_to_float(float *dst, const uint16_t *src, unsigned n);
+const char *fp16_variant_name(void);
+
+#if defined(__arm__) || defined(__aarch64__)
+int fp16_neon_supported(void);
+void fp16_neon_float_to_half(uint16_t *dst, const float *src, unsigned n);
+void fp16_neon_half_to_float(float *dst, const uint16_t *src, unsigned n);
+#endif
+
+#endif
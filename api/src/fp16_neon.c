@@ -0,0 +1,116 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// NEON half precision conversion. Kept apart from fp16.c because on 32 bit
+// ARM it has to be built with -mfpu=neon-fp16, which must not leak into the
+// scalar fallback used on processors without NEON.
+
+#if defined(__arm__) || defined(__aarch64__)
+#include "fp16.h"
+
+#if defined(__aarch64__) || (defined(__ARM_NEON) && (__ARM_FP & 2))
+#include <arm_neon.h>
+#ifdef __arm__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+int fp16_neon_supported(void)
+{
+#ifdef __arm__
+	unsigned long hwcap = getauxval(AT_HWCAP);
+	return (hwcap & HWCAP_NEON) && (hwcap & HWCAP_HALF) && (hwcap & HWCAP_VFPv4);
+#else
+	return 1;
+#endif
+}
+
+// 32 bit NEON always runs in default NaN mode, which drops the sign and
+// payload of NaNs. Patch those lanes so that the results match fp16.c.
+static uint16x4_t from_float4(float32x4_t f)
+{
+	uint16x4_t h = vreinterpret_u16_f16(vcvt_f16_f32(f));
+#ifdef __arm__
+	uint32x4_t u = vreinterpretq_u32_f32(f);
+	uint32x4_t a = vandq_u32(u, vdupq_n_u32(0x7fffffff));
+	uint32x4_t is_nan = vcgtq_u32(a, vdupq_n_u32(0x7f800000));
+	uint32x4_t nan = vorrq_u32(vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(0x8000)),
+				   vorrq_u32(vdupq_n_u32(0x7e00),
+					     vandq_u32(vshrq_n_u32(a, 13), vdupq_n_u32(0x3ff))));
+	h = vbsl_u16(vmovn_u32(is_nan), vmovn_u32(nan), h);
+#endif
+	return h;
+}
+
+static float32x4_t to_float4(uint16x4_t h)
+{
+	float32x4_t f = vcvt_f32_f16(vreinterpret_f16_u16(h));
+#ifdef __arm__
+	uint32x4_t w = vmovl_u16(h);
+	uint32x4_t is_nan = vcgtq_u32(vandq_u32(w, vdupq_n_u32(0x7fff)), vdupq_n_u32(0x7c00));
+	uint32x4_t nan = vorrq_u32(vshlq_n_u32(vandq_u32(w, vdupq_n_u32(0x8000)), 16),
+				   vorrq_u32(vdupq_n_u32(0x7fc00000),
+					     vshlq_n_u32(vandq_u32(w, vdupq_n_u32(0x3ff)), 13)));
+	f = vbslq_f32(is_nan, vreinterpretq_f32_u32(nan), f);
+#endif
+	return f;
+}
+
+void fp16_neon_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		uint16x4_t a = from_float4(vld1q_f32(src + i));
+		uint16x4_t b = from_float4(vld1q_f32(src + i + 4));
+		vst1q_u16(dst + i, vcombine_u16(a, b));
+	}
+	for (; i < n; i++)
+		dst[i] = fp16_from_float(src[i]);
+}
+
+void fp16_neon_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		uint16x8_t h = vld1q_u16(src + i);
+		vst1q_f32(dst + i, to_float4(vget_low_u16(h)));
+		vst1q_f32(dst + i + 4, to_float4(vget_high_u16(h)));
+	}
+	for (; i < n; i++)
+		dst[i] = fp16_to_float(src[i]);
+}
+
+#else
+
+// Built without NEON half precision support
+int fp16_neon_supported(void)
+{
+	return 0;
+}
+
+void fp16_neon_float_to_half(uint16_t *dst, const float *src, unsigned n)
+{
+}
+
+void fp16_neon_half_to_float(float *dst, const uint16_t *src, unsigned n)
+{
+}
+
+#endif
+#endif
@@ -0,0 +1,160 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Graph file parsing, usable without a device
+
+#include <string.h>
+#include "mvnc.h"
+
+// Graph file structure
+#define HEADER_LENGTH	264
+#define STAGE_LENGTH 	227
+#define VERSION_OFFSET 	36
+#define GRAPH_VERSION 	2
+#define N_STAGES_OFFSET 240
+#define FIRST_SHAVE_OFFSET 248
+#define LAST_SHAVE_OFFSET 252
+
+// Stage record structure, offsets from the start of the record
+#define OP_TYPE_OFFSET		100
+#define IN_DIM_OFFSET		112	// X, Y, Z
+#define TAP_DIM_OFFSET		124
+#define OUT_DIM_OFFSET		136
+#define IN_STRIDE_OFFSET	148
+#define TAP_STRIDE_OFFSET	160
+#define OUT_STRIDE_OFFSET	172
+#define DATA_TYPE_OFFSET	184
+#define PRECISION_OFFSET	185
+#define STORAGE_ORDER_OFFSET	186
+
+#define MAX_GRAPH_FILE_LENGTH	(512 * 1024 * 1024)
+#define MAX_OUTPUT_LENGTH	(128 * 1024 * 1024)
+
+static unsigned read_32bits(const unsigned char *ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (ptr[3] << 24);
+}
+
+static void read_dims(const unsigned char *dims, const unsigned char *strides,
+		      mvncTensorShape *shape)
+{
+	shape->x = read_32bits(dims);
+	shape->y = read_32bits(dims + 4);
+	shape->z = read_32bits(dims + 8);
+	shape->strideX = read_32bits(strides);
+	shape->strideY = read_32bits(strides + 4);
+	shape->strideZ = read_32bits(strides + 8);
+}
+
+// Tensors are stored with X as the outermost loop, so the
+// byte size of a tensor is X * Y * stride of X, saturated
+// over MAX_OUTPUT_LENGTH so that it cannot wrap around
+static unsigned long long tensor_length(const mvncTensorShape *shape)
+{
+	unsigned long long xy = (unsigned long long) shape->x * shape->y;
+
+	if (xy > MAX_OUTPUT_LENGTH || shape->strideX > MAX_OUTPUT_LENGTH)
+		return MAX_OUTPUT_LENGTH + 1ULL;
+	return xy * shape->strideX;
+}
+
+static mvncStatus check_graph_file(const unsigned char *graph,
+				   unsigned int graphFileLength, unsigned *nstages)
+{
+	if (graphFileLength < HEADER_LENGTH + STAGE_LENGTH ||
+	    graphFileLength > MAX_GRAPH_FILE_LENGTH)
+		return MVNC_UNSUPPORTED_GRAPH_FILE;
+
+	if (graph[VERSION_OFFSET] != GRAPH_VERSION)
+		return MVNC_UNSUPPORTED_GRAPH_FILE;
+
+	*nstages = graph[N_STAGES_OFFSET] + (graph[N_STAGES_OFFSET + 1] << 8);
+	if (*nstages == 0 ||
+	    HEADER_LENGTH + *nstages * STAGE_LENGTH > graphFileLength)
+		return MVNC_UNSUPPORTED_GRAPH_FILE;
+
+	return MVNC_OK;
+}
+
+mvncStatus mvncGetGraphFileInfo(const void *graphFile, unsigned int graphFileLength,
+				mvncGraphFileInfo *info)
+{
+	const unsigned char *graph = (const unsigned char *) graphFile;
+	const unsigned char *first, *last;
+	unsigned long long input_length, output_length;
+	unsigned nstages;
+	mvncStatus rc;
+
+	if (!graphFile || !info)
+		return MVNC_INVALID_PARAMETERS;
+
+	rc = check_graph_file(graph, graphFileLength, &nstages);
+	if (rc)
+		return rc;
+
+	first = graph + HEADER_LENGTH;
+	last = graph + HEADER_LENGTH + (nstages - 1) * STAGE_LENGTH;
+
+	memset(info, 0, sizeof(*info));
+	info->version = graph[VERSION_OFFSET];
+	info->stageCount = nstages;
+	info->firstShave = read_32bits(graph + FIRST_SHAVE_OFFSET);
+	info->lastShave = read_32bits(graph + LAST_SHAVE_OFFSET);
+	read_dims(first + IN_DIM_OFFSET, first + IN_STRIDE_OFFSET, &info->input);
+	read_dims(last + OUT_DIM_OFFSET, last + OUT_STRIDE_OFFSET, &info->output);
+
+	// A reasonable check on graph correctness
+	input_length = tensor_length(&info->input);
+	output_length = tensor_length(&info->output);
+	if (input_length > MAX_OUTPUT_LENGTH || output_length > MAX_OUTPUT_LENGTH)
+		return MVNC_UNSUPPORTED_GRAPH_FILE;
+
+	info->inputLength = input_length;
+	info->outputLength = output_length;
+	return MVNC_OK;
+}
+
+mvncStatus mvncGetGraphFileStage(const void *graphFile, unsigned int graphFileLength,
+				 unsigned int index, mvncStageInfo *stage)
+{
+	const unsigned char *graph = (const unsigned char *) graphFile;
+	const unsigned char *s;
+	unsigned nstages;
+	mvncStatus rc;
+
+	if (!graphFile || !stage)
+		return MVNC_INVALID_PARAMETERS;
+
+	rc = check_graph_file(graph, graphFileLength, &nstages);
+	if (rc)
+		return rc;
+
+	if (index >= nstages)
+		return MVNC_INVALID_PARAMETERS;
+
+	s = graph + HEADER_LENGTH + index * STAGE_LENGTH;
+	memset(stage, 0, sizeof(*stage));
+	memcpy(stage->name, s, MVNC_MAX_STAGE_NAME_SIZE - 1);
+	stage->type = s[OP_TYPE_OFFSET];
+	stage->dataType = s[DATA_TYPE_OFFSET];
+	stage->precision = s[PRECISION_OFFSET];
+	stage->storageOrder = s[STORAGE_ORDER_OFFSET];
+	read_dims(s + IN_DIM_OFFSET, s + IN_STRIDE_OFFSET, &stage->input);
+	read_dims(s + TAP_DIM_OFFSET, s + TAP_STRIDE_OFFSET, &stage->taps);
+	read_dims(s + OUT_DIM_OFFSET, s + OUT_STRIDE_OFFSET, &stage->output);
+	return MVNC_OK;
+}
@@ -22,24 +22,20 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <time.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
 #include "mvnc.h"
 #include "usb_link.h"
 #include "usb_boot.h"
+#include "usb_link_sim.h"
 #include "common.h"
-
-// Graph file structure
-#define HEADER_LENGTH	264
-#define STAGE_LENGTH 	227
-#define VERSION_OFFSET 	36
-#define GRAPH_VERSION 	2
-#define N_STAGES_OFFSET 240
-#define FIRST_SHAVE_OFFSET 248
-#define N_OUTPUTS_OFFSET (HEADER_LENGTH + 136)
-#define X_OUT_STRIDE_OFFSET (HEADER_LENGTH + 172)
+#include "trace.h"
+#include "stats.h"
 
 #define THERMAL_BUFFER_SIZE 100
 #define DEBUG_BUFFER_SIZE 	120
@@ -51,17 +47,73 @@
 #define MAX_PATH_LENGTH 		255
 #define STATUS_WAIT_TIMEOUT     15
 
+// Two results fetched by the completion thread and one returned to the user
+#define RESULT_SLOTS 3
+
+// Thermal history of each device, sampled from the results
+#define THERMAL_HISTORY 	1024
+#define THERMAL_SAMPLE_INTERVAL	0.1	// Seconds, unless the throttling level changes
+
+// Host thermal controller, proportional-integral on the duty share of the device
+#define THERMAL_MARGIN		2	// C under TEMP_LIM_LOWER by default
+#define THERMAL_KP		0.05	// Duty per C over the target
+#define THERMAL_KI		0.005	// Duty per C and second
+#define THERMAL_MIN_DUTY	0.05
+#define THERMAL_RATE_WINDOW	1.0	// Seconds of each rate measurement
+
+// Dispatch weight of the devices, MVNC_DISPATCH_WEIGHT
+#define DISPATCH_HORIZON	5.0	// Seconds the temperature trend is extrapolated
+#define DISPATCH_RAMP		5	// C under TEMP_LIM_LOWER where the weight starts to drop
+#define DISPATCH_MIN		0.05	// Of the weight, at TEMP_LIM_HIGHER or critical throttling
+
+// Recovery of the devices, MVNC_WATCHDOG
+#define WATCHDOG_ATTEMPTS	3	// Resets before the device is given up
+#define WATCHDOG_REPLAYS	2	// Of an inference, before its error is returned
+#define RESET_WAIT		500000	// us after a reset before booting, as in mvncCloseDevice
+
 static int initialized = 0;
 static pthread_mutex_t mm = PTHREAD_MUTEX_INITIALIZER;
+static int device_ids, graph_ids;	// Last ids given, for the trace
 
 int mvnc_loglevel = 0;
 
 /////////////////////////// Structs /////////////////////////////
 struct Graph;
 
+struct TensorBuffer {
+	void *data;
+	unsigned int size;	// Allocated size, multiple of the page size
+	int in_use;
+	int dev_mem;		// Allocated by the USB driver for zero-copy transfers
+	struct TensorBuffer *next;
+};
+
+// Result fetched by the completion thread
+struct Result {
+	void *output;
+	char *aux;
+	void *user_param;
+	mvncStatus rc;
+	mvncHostTimes times;
+};
+
+// Call of mvncLoadTensor waiting to send its tensor, on the stack of the
+// caller and in the queue of the graph under the global lock
+struct Waiter {
+	void *user_param;
+	int priority;
+	double deadline;	// Of monotonic_seconds, 0 for none
+	double since;		// Of time_in_seconds
+	int cancelled;		// By mvncCancelTensors
+	int dropped;		// For a newer call, MVNC_QUEUE_DROP_OLDEST
+	struct Waiter *next;
+};
+
 struct Device {
+	int id;
 	int backoff_time_normal, backoff_time_high, backoff_time_critical;
 	int temperature_debug, throttle_happened;
+	int allocating;		// A graph upload to this device is in progress
 	float temp_lim_upper, temp_lim_lower;
 	float *thermal_stats;
 	char *dev_addr;		// Device USB address as returned by usb_
@@ -70,12 +122,43 @@ struct Device {
 	void *usb_link;
 	struct Device *next;	// Next device in chain
 	struct Graph *graphs;	// List of associated graphs
+	struct TensorBuffer *buffers;	// Tensor buffer pool
+	struct stats stats;
+	int thermal_fd;		// eventfd of MVNC_THERMAL_FD, -1 until requested
+	unsigned long long thermal_count;	// Samples taken, thermal is a ring of the last ones
+	mvncThermalSample thermal[THERMAL_HISTORY];
+
+	// Measured from the results
+	float temperature;	// Of the last result
+	float device_ms;	// Smoothed compute time of an inference
+	float rate;		// Smoothed completions per second
+	unsigned window_count;	// Results since window_start
+	double window_start;
+
+	// Host thermal controller, MVNC_THERMAL_CONTROL
+	int thermal_control;
+	float thermal_target;	// 0 for temp_lim_lower - THERMAL_MARGIN
+	float duty, duty_integral;
+	double control_time;	// Of the last update, 0 for none
+	int64_t paced_until;	// No upload before, us of time_in_seconds, atomic
+
+	// Recovery, MVNC_WATCHDOG
+	int watchdog_ms;	// Result timeout, 0 when off
+	int recovering;		// The recovery thread is resetting the device
+	int lost;		// The recovery gave up, results fail
+	int closing;		// Stops the recovery thread, atomic
+	int recovery_started;	// recovery_thread is to be joined
+	char *boot_addr;	// Address of the device before booting
+	pthread_t recovery_thread;
 	pthread_mutex_t mm;
+	pthread_mutex_t pool_mm;
 } *devices;
 
 struct Graph {
+	int id;
 	int started;
 	int have_data;
+	int slots_used;		// Inputs taken by mvncLoadTensor and results not returned, atomic
 	int dont_block;
 	int input_idx;
 	int output_idx;
@@ -83,7 +166,9 @@ struct Graph {
 	int iterations;
 	int network_throttle;
 	unsigned noutputs;
+	unsigned ninputs;
 	unsigned nstages;
+	float upload_throughput;	// Blob upload speed in MB/s
 	struct Device *dev;
 	struct Graph *next;
 	char *aux_buffer;
@@ -91,17 +176,64 @@ struct Graph {
 	float *time_taken;
 	void *user_param[2];
 	void *output_data;
+	mvncHostTimes times[2];		// Of the inferences in flight, like user_param
+	double uploaded[2];
+	mvncHostTimes last_times;	// Of the last result returned
+	struct stats stats;
+	struct stage_stats *stage_stats;	// Per stage, NULL unless MVNC_STAGE_STATS
+	struct Waiter *waiters;		// Loads waiting to send, in the order they came
+	int nwaiters;
+	int queue_limit;		// MVNC_QUEUE_LIMIT, MVNC_QUEUE_POLICY and MVNC_QUEUE_TIMEOUT
+	int queue_policy;
+	int queue_timeout;
+
+	// Reloaded after a reset of the device, with MVNC_WATCHDOG
+	void *graph_file;
+	unsigned graph_file_length;
+	void *replay[2];	// Copies of the inputs in flight, like user_param
+	int replays[2];		// Uploads of the inferences in flight after the first
+
+	// Completion thread, fetching results as soon as they are ready and
+	// signalling them on completion_fd, started by MVNC_COMPLETION_FD
+	int completion_fd;	// eventfd, -1 when not started
+	int stop;
+	int completed;		// Results fetched and not returned yet, atomic
+	int first_completed;	// Queue of completed slots, oldest first
+	int queue[RESULT_SLOTS];
+	int held;		// Slot returned by the last mvncGetResult, -1 none
+	struct Result results[RESULT_SLOTS];
+	pthread_t thread;
+	pthread_mutex_t async_mm;
+	pthread_cond_t async_cond;	// Signalled on new tensors and on stop
 };
 
-static double time_in_seconds()
+// The clock of the deadlines
+static double monotonic_seconds()
 {
-	static double s;
 	struct timespec ts;
 
 	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double time_in_seconds()
+{
+	static double s;
+	double t = monotonic_seconds();
+
 	if (!s)
-		s = ts.tv_sec + ts.tv_nsec * 1e-9;
-	return ts.tv_sec + ts.tv_nsec * 1e-9 - s;
+		s = t;
+	return t - s;
+}
+
+static int expired(double deadline)
+{
+	return deadline > 0 && monotonic_seconds() >= deadline;
+}
+
+static float ms_between(double from, double to)
+{
+	return (to - from) * 1e3;
 }
 
 static void initialize()
@@ -116,7 +248,7 @@ mvncStatus mvncGetDeviceName(int index, char *name, unsigned int nameSize)
 	if (index < 0 || !name || nameSize < MVNC_MAX_NAME_SIZE)
 		return MVNC_INVALID_PARAMETERS;
 
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (!initialized)
 		initialize();
 	int rc = usb_find_device(index, name, nameSize, 0, 0, 0);
@@ -144,6 +276,14 @@ static mvncStatus load_fw_file(const char *name)
 	unsigned file_size;
 	char mv_cmd_file[MAX_PATH_LENGTH], *p;
 
+	// Software devices run without firmware
+	if (sim_is_device(name)) {
+		uint64_t start = trace_start();
+		rc = usb_boot(name, NULL, 0);
+		trace_record(TRACE_BOOT, "boot", start, 0, rc);
+		return rc;
+	}
+
 	// Search the mvnc executable in the same directory of this library, under mvnc
 	Dl_info info;
 	dladdr(mvncOpenDevice, &info);
@@ -159,7 +299,6 @@ static mvncStatus load_fw_file(const char *name)
 	if (fp == NULL) {
 		if (mvnc_loglevel)
 			perror(mv_cmd_file);
-		pthread_mutex_unlock(&mm);
 		return MVNC_MVCMD_NOT_FOUND;
 	}
 
@@ -170,7 +309,6 @@ static mvncStatus load_fw_file(const char *name)
 		if (mvnc_loglevel)
 			perror("buffer");
 		fclose(fp);
-		pthread_mutex_unlock(&mm);
 		return MVNC_OUT_OF_MEMORY;
 	}
 
@@ -179,27 +317,30 @@ static mvncStatus load_fw_file(const char *name)
 			perror(mv_cmd_file);
 		fclose(fp);
 		free(tx_buf);
-		pthread_mutex_unlock(&mm);
 		return MVNC_MVCMD_NOT_FOUND;
 	}
 	fclose(fp);
 
 	// Boot it
+	uint64_t start = trace_start();
 	rc = usb_boot(name, tx_buf, file_size);
+	trace_record(TRACE_BOOT, "boot", start, file_size, rc);
 	free(tx_buf);
-	if (rc) {
-		pthread_mutex_unlock(&mm);
+	if (rc)
 		return rc;
-	}
 
 	PRINT_DEBUG(stderr, "Boot successful, device address %s\n", name);
 	return MVNC_OK;
 }
 
-static void allocate_device(const char* name, void **deviceHandle, void* f)
+static void allocate_device(int id, const char* name, const char *boot_name,
+			    void **deviceHandle, void* f)
 {
 	struct Device *d = calloc(1, sizeof(*d));
+	d->id = id;
+	trace_device_name(id, name);
 	d->dev_addr = strdup(name);
+	d->boot_addr = strdup(boot_name);
 	d->usb_link = f;
 	d->next = devices;
 	d->temp_lim_upper = 95;
@@ -208,7 +349,11 @@ static void allocate_device(const char* name, void **deviceHandle, void* f)
 	d->backoff_time_high = 100;
 	d->backoff_time_critical = 10000;
 	d->temperature_debug = 0;
+	stats_reset(&d->stats);
+	d->thermal_fd = -1;
+	d->duty = d->duty_integral = 1;
 	pthread_mutex_init(&d->mm, 0);
+	pthread_mutex_init(&d->pool_mm, 0);
 	devices = d;
 	*deviceHandle = d;
 
@@ -218,11 +363,12 @@ static void allocate_device(const char* name, void **deviceHandle, void* f)
 		   d->dev_file ? d->dev_file : "VSC");
 }
 
-mvncStatus mvncOpenDevice(const char *name, void **deviceHandle)
+static mvncStatus open_device(const char *name, void **deviceHandle)
 {
-	int rc;
+	int rc, id;
 	char name2[MVNC_MAX_NAME_SIZE] = "";
 	char* device_name;
+	char* boot_name;
 	char* saved_name = NULL;
 	char* temp = NULL; //save to be able to free memory
 	int second_name_available = 0;
@@ -238,14 +384,18 @@ mvncStatus mvncOpenDevice(const char *name, void **deviceHandle)
 		return MVNC_INVALID_PARAMETERS;
 	}
 
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (!initialized)
 		initialize();
+	id = ++device_ids;
+	trace_context(id, 0);
+	trace_device_name(id, device_name);
 
-
+	boot_name = device_name;
 	rc = load_fw_file(device_name);
 	if (rc != MVNC_OK) {
 		free(temp);
+		pthread_mutex_unlock(&mm);
 		return rc;
 	}
 	if (saved_name && strlen(saved_name) > 0) {
@@ -283,7 +433,8 @@ mvncStatus mvncOpenDevice(const char *name, void **deviceHandle)
 			myriadStatus_t status;
 
 			if (!usblink_getmyriadstatus(f, &status) && status == MYRIAD_WAITING) {
-				allocate_device(strlen(name2) > 0 ? name2 : device_name, deviceHandle, f);
+				allocate_device(id, strlen(name2) > 0 ? name2 : device_name, boot_name,
+						deviceHandle, f);
 				free(temp);
 				pthread_mutex_unlock(&mm);
 				return MVNC_OK;
@@ -301,6 +452,14 @@ mvncStatus mvncOpenDevice(const char *name, void **deviceHandle)
 	return MVNC_ERROR;
 }
 
+mvncStatus mvncOpenDevice(const char *name, void **deviceHandle)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = open_device(name, deviceHandle);
+	trace_record(TRACE_API, "mvncOpenDevice", start, 0, rc);
+	return rc;
+}
+
 static int find_device(void *deviceHandle)
 {
 	struct Device *d = devices;
@@ -331,6 +490,700 @@ static int find_graph(void *graphHandle)
 	return -1;
 }
 
+// Returns a buffer of at least length bytes from the device pool, reusing
+// the smallest free one that fits before allocating a new one
+static void *get_tensor_buffer(struct Device *d, unsigned int length)
+{
+	struct TensorBuffer *b, *best = NULL;
+	unsigned int page = sysconf(_SC_PAGESIZE);
+
+	pthread_mutex_lock(&d->pool_mm);
+	for (b = d->buffers; b; b = b->next)
+		if (!b->in_use && b->size >= length &&
+		    (!best || b->size < best->size))
+			best = b;
+
+	if (!best && (best = calloc(1, sizeof(*best)))) {
+		best->size = (length + page - 1) / page * page;
+		if (!best->size)
+			best->size = page;
+		// Not with MVNC_WATCHDOG, the driver memory going with the handle
+		// that the recovery closes
+		best->data = d->usb_link && !d->watchdog_ms ?
+			     usblink_mem_alloc(d->usb_link, best->size) : NULL;
+		if (best->data)
+			best->dev_mem = 1;
+		else if (posix_memalign(&best->data, page, best->size))
+			best->data = NULL;
+		if (!best->data) {
+			free(best);
+			best = NULL;
+		} else {
+			best->next = d->buffers;
+			d->buffers = best;
+		}
+	}
+	if (best)
+		best->in_use = 1;
+	pthread_mutex_unlock(&d->pool_mm);
+	return best ? best->data : NULL;
+}
+
+static int put_tensor_buffer(struct Device *d, void *data)
+{
+	struct TensorBuffer *b;
+
+	pthread_mutex_lock(&d->pool_mm);
+	for (b = d->buffers; b; b = b->next)
+		if (b->data == data && b->in_use) {
+			b->in_use = 0;
+			break;
+		}
+	pthread_mutex_unlock(&d->pool_mm);
+	return b ? 0 : -1;
+}
+
+// Frees the free buffers allocated by the USB driver, returning how many
+// are still in use. Called with the pool lock.
+static int free_dev_mem_buffers(struct Device *d)
+{
+	struct TensorBuffer **p = &d->buffers, *b;
+	int in_use = 0;
+
+	while ((b = *p)) {
+		if (!b->dev_mem || b->in_use) {
+			in_use += b->dev_mem;
+			p = &b->next;
+			continue;
+		}
+		*p = b->next;
+		usblink_mem_free(d->usb_link, b->data, b->size);
+		free(b);
+	}
+	return in_use;
+}
+
+static void destroy_tensor_buffers(struct Device *d)
+{
+	while (d->buffers) {
+		struct TensorBuffer *b = d->buffers;
+		d->buffers = b->next;
+		if (b->dev_mem)
+			usblink_mem_free(d->usb_link, b->data, b->size);
+		else
+			free(b->data);
+		free(b);
+	}
+}
+
+static unsigned aux_length(struct Graph *g)
+{
+	return DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE + sizeof(int) +
+	       sizeof(*g->time_taken) * g->nstages;
+}
+
+// Adds n to a counter of the graph and of its device
+#define COUNT(g, counter, n) do { \
+		stats_add(&(g)->stats.counter, n); \
+		stats_add(&(g)->dev->stats.counter, n); \
+	} while (0)
+
+// Adds the temperature and throttling level of a result to the thermal
+// history of the device, called with the device lock
+static void sample_thermal(struct Device *d, const char *aux)
+{
+	float temperature = *(const float *) (aux + DEBUG_BUFFER_SIZE);
+	int throttle = *(const int *) (aux + DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE);
+	double t = time_in_seconds();
+	mvncThermalSample *s;
+	uint64_t one = 1;
+
+	if (d->thermal_count) {
+		s = &d->thermal[(d->thermal_count - 1) % THERMAL_HISTORY];
+		if (t - s->time < THERMAL_SAMPLE_INTERVAL && throttle == s->throttle)
+			return;
+	}
+	s = &d->thermal[d->thermal_count % THERMAL_HISTORY];
+	s->time = t;
+	s->sequence = d->thermal_count++;
+	s->temperature = temperature;
+	s->throttle = throttle;
+	if (d->thermal_fd >= 0 && write(d->thermal_fd, &one, sizeof(one)) != sizeof(one))
+		PRINT_INFO(stderr, "Cannot signal thermal sample: %s\n", strerror(errno));
+}
+
+static float clamp(float x, float min, float max)
+{
+	return x < min ? min : x > max ? max : x;
+}
+
+// Tracks the temperature, compute time and completion rate of the device
+// from a result that took device_ms to compute, called with the device lock
+static void measure_device(struct Device *d, const char *aux, float device_ms)
+{
+	double t = time_in_seconds();
+
+	d->temperature = *(const float *) (aux + DEBUG_BUFFER_SIZE);
+	d->device_ms = d->device_ms ? 0.9 * d->device_ms + 0.1 * device_ms : device_ms;
+	d->window_count++;
+	if (!d->window_start)
+		d->window_start = t;
+	else if (t - d->window_start >= THERMAL_RATE_WINDOW) {
+		float rate = d->window_count / (t - d->window_start);
+		d->rate = d->rate ? 0.9 * d->rate + 0.1 * rate : rate;
+		d->window_count = 0;
+		d->window_start = t;
+	}
+}
+
+// Updates the duty share of the device from the temperature of the last
+// result, called with the device lock
+static void control_thermal(struct Device *d)
+{
+	float target = d->thermal_target ? d->thermal_target : d->temp_lim_lower - THERMAL_MARGIN;
+	double t = time_in_seconds(), dt = d->control_time ? t - d->control_time : 0;
+	float error = d->temperature - target;
+
+	d->duty_integral = clamp(d->duty_integral - THERMAL_KI * error * dt, THERMAL_MIN_DUTY, 1);
+	d->duty = clamp(d->duty_integral - THERMAL_KP * error, THERMAL_MIN_DUTY, 1);
+	d->control_time = t;
+}
+
+// Inferences/s the device should be given: its compute rate, reduced as its
+// temperature extrapolated DISPATCH_HORIZON ahead goes from DISPATCH_RAMP under
+// the lower limit to the upper one and when it throttles, so that work moves
+// to cooler devices before it backs off. A device without recent samples has
+// cooled down, its penalty fades over 4 horizons. Called with the device lock.
+static float dispatch_weight(struct Device *d)
+{
+	float weight = d->device_ms ? 1e3 / d->device_ms : 1e3;
+	float temperature, span, factor;
+	const mvncThermalSample *last, *s;
+	unsigned long long i;
+	double age;
+
+	if (d->recovering || d->lost)
+		return 0;
+	if (d->thermal_control)
+		weight *= d->duty;
+	if (!d->thermal_count)
+		return weight;
+
+	// Trend since the oldest sample within the horizon
+	last = &d->thermal[(d->thermal_count - 1) % THERMAL_HISTORY];
+	for (i = d->thermal_count - 1; i > 0 && d->thermal_count - i < THERMAL_HISTORY; i--)
+		if (last->time - d->thermal[(i - 1) % THERMAL_HISTORY].time > DISPATCH_HORIZON)
+			break;
+	s = &d->thermal[i % THERMAL_HISTORY];
+	temperature = last->temperature;
+	age = time_in_seconds() - last->time;
+	if (age < DISPATCH_HORIZON && last->time > s->time && last->temperature > s->temperature)
+		temperature += (last->temperature - s->temperature) /
+			       (last->time - s->time) * DISPATCH_HORIZON;
+
+	span = d->temp_lim_upper - d->temp_lim_lower + DISPATCH_RAMP;
+	factor = span > 0 ? clamp((d->temp_lim_upper - temperature) / span, DISPATCH_MIN, 1) : 1;
+	if (last->throttle >= 2)
+		factor = DISPATCH_MIN;
+	else if (last->throttle == 1)
+		factor *= 0.5;
+	if (age > DISPATCH_HORIZON)
+		factor += (1 - factor) * clamp((age - DISPATCH_HORIZON) / (4 * DISPATCH_HORIZON), 0, 1);
+	return weight * factor;
+}
+
+// Spaces the uploads to the device by device_ms / duty when it is below 1,
+// called with the device lock after an upload
+static void pace_thermal(struct Device *d)
+{
+	int64_t until = 0;
+
+	if (d->duty < 1)
+		until = (time_in_seconds() + d->device_ms * 1e-3 / d->duty) * 1e6;
+	__atomic_store_n(&d->paced_until, until, __ATOMIC_RELAXED);
+}
+
+// Microseconds until the thermal controller lets the next upload go to the device
+static int64_t thermal_wait(struct Device *d)
+{
+	int64_t us;
+
+	if (!d->thermal_control)
+		return 0;
+	us = __atomic_load_n(&d->paced_until, __ATOMIC_RELAXED) - (int64_t) (time_in_seconds() * 1e6);
+	return us > 0 ? us : 0;
+}
+
+// Microseconds to wait before the next upload to the device, at most 100 ms
+static unsigned thermal_pace(struct Device *d)
+{
+	int64_t us = thermal_wait(d);
+
+	return us > 100000 ? 100000 : us;
+}
+
+// Counts the result of the oldest inference in flight, with aux its aux buffer,
+// called with the device lock when the result is read
+static void count_result(struct Graph *g, const char *aux, mvncStatus rc)
+{
+	const float *time_taken = (const float *) (aux + DEBUG_BUFFER_SIZE +
+						   THERMAL_BUFFER_SIZE + sizeof(int));
+	double latency;
+	float device = 0;
+	unsigned i;
+
+	switch (rc) {
+	case MVNC_OK:
+		latency = time_in_seconds() - g->times[g->output_idx].start;
+		stats_latency(&g->stats, latency);
+		stats_latency(&g->dev->stats, latency);
+		for (i = 0; i < g->nstages; i++) {
+			device += time_taken[i];
+			if (g->stage_stats)
+				stage_stats_add(&g->stage_stats[i], time_taken[i]);
+		}
+		COUNT(g, inferences, 1);
+		COUNT(g, device_us, device * 1e3);
+		if (*(int *) (aux + DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE) > 0)
+			COUNT(g, throttled, 1);
+		COUNT(g, bytes_out, 2 * g->noutputs + aux_length(g));
+		sample_thermal(g->dev, aux);
+		measure_device(g->dev, aux, device);
+		if (g->dev->thermal_control)
+			control_thermal(g->dev);
+		break;
+	case MVNC_MYRIAD_ERROR:
+		COUNT(g, myriad_errors, 1);
+		COUNT(g, bytes_out, 2 * g->noutputs + aux_length(g));
+		sample_thermal(g->dev, aux);
+		break;
+	case MVNC_TIMEOUT:
+		COUNT(g, timeouts, 1);
+		break;
+	default:
+		COUNT(g, errors, 1);
+	}
+}
+
+// Host times of the oldest inference in flight, whose output was read from
+// output_start and aux buffer from aux_start to end, called with the device lock
+static void finish_times(struct Graph *g, mvncHostTimes *times, double lock_wait,
+			 double output_start, double aux_start, double end)
+{
+	*times = g->times[g->output_idx];
+	times->lockWait += lock_wait * 1e3;
+	times->device = ms_between(g->uploaded[g->output_idx], output_start);
+	times->download = ms_between(output_start, aux_start);
+	times->aux = ms_between(aux_start, end);
+	times->downloadBytes = 2 * g->noutputs;
+	times->auxBytes = aux_length(g);
+}
+
+static int send_opt_data(struct Graph *g)
+{
+	int config[10];
+
+	config[0] = 1;		// Version
+	config[1] = 0;		// Query disable
+	config[2] = g->iterations;
+	config[3] = g->dev->temp_lim_upper;
+	config[4] = g->dev->temp_lim_lower;
+	config[5] = g->dev->backoff_time_normal;
+	config[6] = g->dev->backoff_time_high;
+	config[7] = g->dev->backoff_time_critical;
+	config[8] = g->dev->temperature_debug;
+	config[9] = g->network_throttle;
+
+	if (usblink_setdata(g->dev->usb_link, "config", config, sizeof(config), 0))
+		return MVNC_ERROR;
+
+	return MVNC_OK;
+}
+
+static double result_timeout(struct Device *d)
+{
+	return d->watchdog_ms ? d->watchdog_ms * 1e-3 : STATUS_WAIT_TIMEOUT;
+}
+
+static void swap_ptr(void **a, void **b)
+{
+	void *t = *a;
+	*a = *b;
+	*b = t;
+}
+
+// A fresh graph runs input1 first, so the oldest inference in flight moves to
+// slot 0 before the inputs are uploaded again
+static void reorder_slots(struct Graph *g)
+{
+	mvncHostTimes times = g->times[0];
+	double uploaded = g->uploaded[0];
+	int replays = g->replays[0];
+
+	if (!g->output_idx)
+		return;
+	g->times[0] = g->times[1];
+	g->times[1] = times;
+	g->uploaded[0] = g->uploaded[1];
+	g->uploaded[1] = uploaded;
+	g->replays[0] = g->replays[1];
+	g->replays[1] = replays;
+	swap_ptr(&g->user_param[0], &g->user_param[1]);
+	swap_ptr(&g->replay[0], &g->replay[1]);
+	g->output_idx = 0;
+	g->input_idx = g->have_data % 2;
+}
+
+// Uploads the graph file, a clear aux buffer and the configuration of a graph
+// to its device after a reset. Called without the device lock, recovering
+// keeps the other calls off the device and the graph from being deallocated.
+static int reload_graph(struct Graph *g)
+{
+	struct Device *d = g->dev;
+	char *aux = calloc(1, aux_length(g));
+	int rc;
+
+	rc = !aux || usblink_setdata(d->usb_link, "blobFile", g->graph_file,
+				     g->graph_file_length, 0) ||
+	     usblink_setdata(d->usb_link, "auxBuffer", aux, aux_length(g), 0) ||
+	     send_opt_data(g);
+	free(aux);
+	return rc ? -1 : 0;
+}
+
+// Then uploads the inputs in flight, those loaded meanwhile included, called
+// with the device lock
+static int replay_inputs(struct Graph *g)
+{
+	int i;
+
+	g->started = 1;
+	reorder_slots(g);
+	for (i = 0; i < g->have_data; i++) {
+		if (usblink_setdata(g->dev->usb_link, i ? "input2" : "input1", g->replay[i],
+				    2 * g->ninputs, i == 0))
+			return -1;
+		g->uploaded[i] = time_in_seconds();
+		COUNT(g, replays, 1);
+		COUNT(g, bytes_in, 2 * g->ninputs);
+	}
+	return 0;
+}
+
+static int closing(struct Device *d)
+{
+	return __atomic_load_n(&d->closing, __ATOMIC_RELAXED);
+}
+
+static void *open_waiting(const char *name)
+{
+	myriadStatus_t status;
+	void *f = usblink_open(name);
+
+	if (f && (usblink_getmyriadstatus(f, &status) || status != MYRIAD_WAITING)) {
+		usblink_close(f);
+		f = NULL;
+	}
+	return f;
+}
+
+// Opens the device booted again at its address, or looks for it under a new
+// one as open_device does. close_device joins the recovery with the global
+// lock, so the devices are only looked through when it is free.
+static void *reopen_device(struct Device *d)
+{
+	char name[MVNC_MAX_NAME_SIZE], *addr;
+	void *f = open_waiting(d->dev_addr);
+	int i;
+
+	if (f || pthread_mutex_trylock(&mm))
+		return f;
+	for (i = 0; !f && usb_find_device(i, name, sizeof(name), NULL, DEFAULT_OPEN_VID,
+					  DEFAULT_OPEN_PID) >= 0; i++)
+		if (is_device_opened(name) < 0 && (f = open_waiting(name)) && (addr = strdup(name))) {
+			free(d->dev_addr);
+			d->dev_addr = addr;
+		}
+	pthread_mutex_unlock(&mm);
+	return f;
+}
+
+// Resets the device, boots it again and reloads its graphs
+static int recover_device(struct Device *d)
+{
+	uint64_t start = trace_start();
+	struct Graph *g;
+	double timeout;
+	void *f = NULL;
+	int rc = -1;
+
+	trace_lock(&d->mm, "device lock");
+	if (d->usb_link) {
+		usblink_resetmyriad(d->usb_link);
+		pthread_mutex_lock(&d->pool_mm);
+		free_dev_mem_buffers(d);
+		usblink_close(d->usb_link);
+		d->usb_link = NULL;
+		pthread_mutex_unlock(&d->pool_mm);
+	}
+	pthread_mutex_unlock(&d->mm);
+
+	usleep(RESET_WAIT);
+	if (closing(d) || load_fw_file(d->boot_addr))
+		goto out;
+	timeout = time_in_seconds() + STATUS_WAIT_TIMEOUT;
+	while (!f && !closing(d) && time_in_seconds() < timeout)
+		if (!(f = reopen_device(d)))
+			usleep(10000);
+	if (!f)
+		goto out;
+
+	trace_lock(&d->mm, "device lock");
+	pthread_mutex_lock(&d->pool_mm);
+	d->usb_link = f;
+	pthread_mutex_unlock(&d->pool_mm);
+	pthread_mutex_unlock(&d->mm);
+	rc = 0;
+	for (g = d->graphs; g && !rc; g = g->next)
+		rc = reload_graph(g);
+out:
+	trace_record(TRACE_BOOT, "recovery", start, 0, rc ? MVNC_ERROR : MVNC_OK);
+	return rc;
+}
+
+// Runs without the global lock, so that the other devices keep working, and
+// gives the device up after WATCHDOG_ATTEMPTS
+static void *recovery_thread(void *arg)
+{
+	struct Device *d = (struct Device *) arg;
+	struct Graph *g;
+	int attempt, rc = -1;
+
+	// The inputs are replayed in the same locked section that clears
+	// recovering, after which the calls upload them again themselves
+	trace_context(d->id, 0);
+	for (attempt = 0; attempt < WATCHDOG_ATTEMPTS && !closing(d); attempt++) {
+		rc = recover_device(d);
+		trace_lock(&d->mm, "device lock");
+		for (g = d->graphs; g && !rc; g = g->next)
+			rc = replay_inputs(g);
+		if (!rc)
+			break;
+		pthread_mutex_unlock(&d->mm);
+	}
+	if (rc) {
+		trace_lock(&d->mm, "device lock");
+		PRINT_INFO(stderr, "Cannot recover %s, giving it up\n", d->dev_addr);
+		d->lost = 1;
+		for (g = d->graphs; g; g = g->next)
+			g->failed = 1;
+	} else {
+		PRINT_DEBUG(stderr, "Recovered %s\n", d->dev_addr);
+		stats_add(&d->stats.resets, 1);
+		for (g = d->graphs; g; g = g->next)
+			stats_add(&g->stats.resets, 1);
+	}
+	d->recovering = 0;
+	pthread_mutex_unlock(&d->mm);
+	return NULL;
+}
+
+// Starts the recovery thread unless it is running, called with the device lock
+static int start_recovery(struct Device *d)
+{
+	if (d->recovering)
+		return 0;
+	if (d->lost || closing(d))
+		return -1;
+	if (d->recovery_started)
+		pthread_join(d->recovery_thread, NULL);
+	d->recovery_started = 0;
+	d->recovering = 1;
+	if (pthread_create(&d->recovery_thread, NULL, recovery_thread, d)) {
+		d->recovering = 0;
+		return -1;
+	}
+	d->recovery_started = 1;
+	return 0;
+}
+
+// With the watchdog, a failed or late result starts the recovery of the
+// device, which uploads the inference again, WATCHDOG_REPLAYS times at most.
+// Returns 1 to wait for it, 0 to return rc. Called with the device lock.
+static int replay_result(struct Graph *g, mvncStatus rc)
+{
+	if (rc == MVNC_OK || !g->dev->watchdog_ms || start_recovery(g->dev))
+		return 0;
+	return g->replays[g->output_idx]++ < WATCHDOG_REPLAYS;
+}
+
+// Waits for the oldest inference to finish and reads its result as
+// mvncGetResult does. Only the device lock is taken, the graph cannot
+// be deallocated before the completion thread is joined.
+static int fetch_result(struct Graph *g, struct Result *r)
+{
+	struct Device *d = g->dev;
+	double timeout = time_in_seconds() + result_timeout(d);
+	double t, lock_wait, output_start, aux_start;
+
+	for (;;) {
+		if (g->stop)
+			return -1;
+		t = time_in_seconds();
+		trace_lock(&d->mm, "device lock");
+		output_start = time_in_seconds();
+		lock_wait = output_start - t;
+		r->rc = MVNC_TIMEOUT;
+		if (d->recovering)
+			timeout = output_start + result_timeout(d);
+		else if (d->lost) {
+			r->rc = MVNC_ERROR;
+			r->times = g->times[g->output_idx];
+			break;
+		} else if (!usblink_getdata(d->usb_link, "output", r->output,
+					    2 * g->noutputs, 0, 0)) {
+			aux_start = time_in_seconds();
+			if (usblink_getdata(d->usb_link, "auxBuffer", r->aux,
+					    aux_length(g), 0, g->have_data == 2))
+				r->rc = MVNC_ERROR;
+			else
+				r->rc = *r->aux ? MVNC_MYRIAD_ERROR : MVNC_OK;
+			finish_times(g, &r->times, lock_wait, output_start, aux_start,
+				     time_in_seconds());
+			if (!replay_result(g, r->rc))
+				break;
+		} else if (output_start >= timeout) {
+			r->times = g->times[g->output_idx];
+			if (!replay_result(g, r->rc))
+				break;
+		} else
+			COUNT(g, retries, 1);
+		pthread_mutex_unlock(&d->mm);
+		usleep(1000);
+	}
+	if (r->rc != MVNC_OK && !d->recovering)
+		g->failed = 1;
+	count_result(g, r->aux, r->rc);
+	r->user_param = g->user_param[g->output_idx];
+	g->output_idx = !g->output_idx;
+	g->have_data--;
+	pthread_mutex_unlock(&d->mm);
+	return 0;
+}
+
+static void *completion_thread(void *arg)
+{
+	struct Graph *g = (struct Graph *) arg;
+	uint64_t one = 1;
+	int slot;
+
+	trace_context(g->dev->id, g->id);
+	for (;;) {
+		pthread_mutex_lock(&g->async_mm);
+		while (!g->stop && !g->have_data)
+			pthread_cond_wait(&g->async_cond, &g->async_mm);
+		// At most two results are fetched or in flight, so with the held
+		// one there is always a free slot
+		for (slot = 0; slot < RESULT_SLOTS; slot++) {
+			int i;
+			for (i = 0; i < g->completed; i++)
+				if (g->queue[(g->first_completed + i) % RESULT_SLOTS] == slot)
+					break;
+			if (i == g->completed && slot != g->held)
+				break;
+		}
+		pthread_mutex_unlock(&g->async_mm);
+		if (g->stop || fetch_result(g, &g->results[slot]))
+			break;
+
+		pthread_mutex_lock(&g->async_mm);
+		g->queue[(g->first_completed + g->completed) % RESULT_SLOTS] = slot;
+		__atomic_add_fetch(&g->completed, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&g->async_mm);
+		if (write(g->completion_fd, &one, sizeof(one)) != sizeof(one))
+			PRINT_INFO(stderr, "Cannot signal completion: %s\n", strerror(errno));
+	}
+	return NULL;
+}
+
+// Called with the device lock held
+static mvncStatus start_completion_thread(struct Graph *g)
+{
+	int i;
+
+	if (g->have_data)
+		return MVNC_BUSY;
+	for (i = 0; i < RESULT_SLOTS; i++) {
+		g->results[i].output = get_tensor_buffer(g->dev, 2 * g->noutputs);
+		g->results[i].aux = calloc(1, aux_length(g));
+		if (!g->results[i].output || !g->results[i].aux)
+			goto fail;
+	}
+	g->completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (g->completion_fd < 0)
+		goto fail;
+	g->stop = 0;
+	g->completed = 0;
+	g->first_completed = 0;
+	g->held = -1;
+	pthread_mutex_init(&g->async_mm, 0);
+	pthread_cond_init(&g->async_cond, 0);
+	if (pthread_create(&g->thread, 0, completion_thread, g)) {
+		pthread_mutex_destroy(&g->async_mm);
+		pthread_cond_destroy(&g->async_cond);
+		close(g->completion_fd);
+		g->completion_fd = -1;
+		goto fail;
+	}
+	return MVNC_OK;
+
+fail:
+	for (i = 0; i < RESULT_SLOTS; i++) {
+		if (g->results[i].output)
+			put_tensor_buffer(g->dev, g->results[i].output);
+		free(g->results[i].aux);
+		g->results[i].output = 0;
+		g->results[i].aux = 0;
+	}
+	return MVNC_OUT_OF_MEMORY;
+}
+
+// Called with the global lock held and not the device one, which the
+// thread may be waiting for
+static void stop_completion_thread(struct Graph *g)
+{
+	if (g->completion_fd < 0 || g->stop)
+		return;
+	pthread_mutex_lock(&g->async_mm);
+	g->stop = 1;
+	pthread_cond_signal(&g->async_cond);
+	pthread_mutex_unlock(&g->async_mm);
+	pthread_join(g->thread, NULL);
+}
+
+static void free_graph(struct Graph *g)
+{
+	int i;
+
+	if (g->completion_fd >= 0) {
+		close(g->completion_fd);
+		pthread_mutex_destroy(&g->async_mm);
+		pthread_cond_destroy(&g->async_cond);
+		for (i = 0; i < RESULT_SLOTS; i++) {
+			put_tensor_buffer(g->dev, g->results[i].output);
+			free(g->results[i].aux);
+		}
+	}
+	free(g->aux_buffer);
+	free(g->stage_stats);
+	free(g->graph_file);
+	free(g->replay[0]);
+	free(g->replay[1]);
+	if (g->output_data)
+		put_tensor_buffer(g->dev, g->output_data);
+	free(g);
+}
+
 // Defined here as it will be used twice
 static int deallocate_graph(struct Graph *g)
 {
@@ -354,29 +1207,33 @@ static int deallocate_graph(struct Graph *g)
 
 	// Free it with all its data
 	if (found) {
-		free(g->aux_buffer);
-		free(g->output_data);
 		g->dev->thermal_stats = 0;
-		free(g);
+		free_graph(g);
 	}
 
 	return -!found;
 }
 
-mvncStatus mvncCloseDevice(void *deviceHandle)
+static mvncStatus close_device(void *deviceHandle)
 {
 	int found = 0;
 
 	if (!deviceHandle)
 		return MVNC_INVALID_PARAMETERS;
 
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_device(deviceHandle)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
 
 	struct Device *d = (struct Device *) deviceHandle;
+	trace_context(d->id, 0);
+	if (d->allocating) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_BUSY;
+	}
+
 	// Remove it from our list
 	if (devices == d) {
 		devices = d->next;
@@ -398,20 +1255,38 @@ mvncStatus mvncCloseDevice(void *deviceHandle)
 		return MVNC_INVALID_PARAMETERS;
 	}
 	// Deallocate all associated graphs
-	pthread_mutex_lock(&d->mm);
+	struct Graph *g;
+	for (g = d->graphs; g; g = g->next)
+		stop_completion_thread(g);
+	// The recovery thread takes only the device lock, which no new one can
+	// be started without
+	trace_lock(&d->mm, "device lock");
+	__atomic_store_n(&d->closing, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&d->mm);
+	if (d->recovery_started)
+		pthread_join(d->recovery_thread, NULL);
+	trace_lock(&d->mm, "device lock");
 	while (d->graphs)
 		deallocate_graph(d->graphs);
 
 	// Reset
-	usblink_resetmyriad(d->usb_link);
-	usblink_close(d->usb_link);
+	if (d->usb_link)
+		usblink_resetmyriad(d->usb_link);
+	destroy_tensor_buffers(d);
+	if (d->usb_link)
+		usblink_close(d->usb_link);
 	if (d->optimisation_list)
 		free(d->optimisation_list);
 
+	if (d->thermal_fd >= 0)
+		close(d->thermal_fd);
+
 	free(d->dev_addr);
+	free(d->boot_addr);
 	free(d->dev_file);
 	pthread_mutex_unlock(&d->mm);
 	pthread_mutex_destroy(&d->mm);
+	pthread_mutex_destroy(&d->pool_mm);
 	free(d);
 	pthread_mutex_unlock(&mm);
 
@@ -419,135 +1294,285 @@ mvncStatus mvncCloseDevice(void *deviceHandle)
 	return MVNC_OK;
 }
 
-static unsigned read_32bits(const unsigned char *ptr)
+mvncStatus mvncCloseDevice(void *deviceHandle)
 {
-	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (ptr[3] << 24);
+	uint64_t start = trace_call();
+	mvncStatus rc = close_device(deviceHandle);
+	trace_record(TRACE_API, "mvncCloseDevice", start, 0, rc);
+	return rc;
 }
 
+// Per-device state of a (possibly broadcast) graph allocation
+struct AllocJob {
+	struct Device *dev;
+	struct Graph *graph;
+	const void *graph_file;
+	unsigned graph_file_length;
+	unsigned nstages;
+	unsigned ninputs;
+	unsigned noutputs;
+	mvncStatus rc;
+	pthread_t thread;
+};
 
-mvncStatus mvncAllocateGraph(void *deviceHandle, void **graphHandle,
-                              const void *graphFile, unsigned int graphFileLength)
+// Uploads the blob and the aux buffer to one device. The caller has reserved
+// the device by setting its allocating flag, which keeps the other calls off
+// its link, so the upload runs without any lock: uploads to different devices
+// run concurrently and the queries of this one do not wait for it
+static void *allocate_on_device(void *arg)
 {
-	if (!deviceHandle || !graphHandle || !graphFile)
-		return MVNC_INVALID_PARAMETERS;
-
-	if (graphFileLength < HEADER_LENGTH + STAGE_LENGTH ||
-	    graphFileLength > 512 * 1024 * 1024)
-		return MVNC_UNSUPPORTED_GRAPH_FILE;
-
-	unsigned char *graph = (unsigned char *) graphFile;
-	if (graph[VERSION_OFFSET] != GRAPH_VERSION)
-		return MVNC_UNSUPPORTED_GRAPH_FILE;
-
-	unsigned nstages = graph[N_STAGES_OFFSET] + (graph[N_STAGES_OFFSET + 1] << 8);
-	unsigned noutputs = read_32bits(graph + N_OUTPUTS_OFFSET +
-                                    (nstages - 1) * STAGE_LENGTH) *
-						read_32bits(graph + N_OUTPUTS_OFFSET +
-                                    (nstages - 1) * STAGE_LENGTH + 4) *
-						read_32bits(graph + X_OUT_STRIDE_OFFSET +
-                                    (nstages - 1) * STAGE_LENGTH) / 2;
-
-	// A reasonable check on graph correctness
-	if (noutputs > 64 * 1024 * 1024)
-		return MVNC_UNSUPPORTED_GRAPH_FILE;
-
-	pthread_mutex_lock(&mm);
-	struct Device *d = devices;
-	while (d) {
-		if (d == deviceHandle)
-			break;
-		d = d->next;
-	}
-
-	if (!d) {
-		pthread_mutex_unlock(&mm);
-		return MVNC_INVALID_PARAMETERS;
-	}
-
-	if (d->graphs) {
-		pthread_mutex_unlock(&mm);
-		return MVNC_BUSY;
-	}
-
+	struct AllocJob *job = (struct AllocJob *) arg;
+	struct Device *d = job->dev;
 	myriadStatus_t status;
-	double timeout = time_in_seconds() + 10;
+	double t0, timeout;
+	uint64_t start;
+
+	// Waits for the calls that took the device lock before the reservation
+	trace_context(d->id, 0);
+	trace_lock(&d->mm, "device lock");
+	if (d->recovering || d->lost) {
+		job->rc = d->lost ? MVNC_ERROR : MVNC_BUSY;
+		pthread_mutex_unlock(&d->mm);
+		return NULL;
+	}
+	pthread_mutex_unlock(&d->mm);
+	timeout = time_in_seconds() + 10;
 	do {
 		if (usblink_getmyriadstatus(d->usb_link, &status)) {
-			pthread_mutex_unlock(&mm);
-			return MVNC_ERROR;
+			job->rc = MVNC_ERROR;
+			goto out;
 		}
 		usleep(10000);
 	} while (status != MYRIAD_WAITING && time_in_seconds() < timeout);
 
 	if (status != MYRIAD_WAITING) {
-		pthread_mutex_unlock(&mm);
-		return MVNC_ERROR;
+		job->rc = MVNC_ERROR;
+		goto out;
 	}
 
-	if (usblink_setdata(d->usb_link, "blobFile", graphFile, graphFileLength, 0)) {
-		pthread_mutex_unlock(&mm);
-		return MVNC_ERROR;
+	t0 = time_in_seconds();
+	start = trace_start();
+	if (usblink_setdata(d->usb_link, "blobFile", job->graph_file,
+			    job->graph_file_length, 0)) {
+		trace_record(TRACE_UPLOAD, "graph upload", start, job->graph_file_length, MVNC_ERROR);
+		job->rc = MVNC_ERROR;
+		goto out;
 	}
 
 	struct Graph *g = calloc(1, sizeof(*g));
+	if (!g) {
+		job->rc = MVNC_OUT_OF_MEMORY;
+		goto out;
+	}
+	g->id = __atomic_add_fetch(&graph_ids, 1, __ATOMIC_RELAXED);
+	stats_reset(&g->stats);
+	trace_context(d->id, g->id);
 	g->dev = d;
-	g->nstages = nstages;
-	g->noutputs = noutputs;
+	g->completion_fd = -1;
+	g->nstages = job->nstages;
+	g->ninputs = job->ninputs;
+	g->noutputs = job->noutputs;
 
 	// aux_buffer
-	g->aux_buffer = calloc(1, 224 + nstages * sizeof(*g->time_taken));
+	g->aux_buffer = calloc(1, 224 + job->nstages * sizeof(*g->time_taken));
 	if (!g->aux_buffer) {
 		free(g);
-		pthread_mutex_unlock(&mm);
-		return MVNC_OUT_OF_MEMORY;
+		job->rc = MVNC_OUT_OF_MEMORY;
+		goto out;
 	}
 
-	if (usblink_setdata(g->dev->usb_link, "auxBuffer", g->aux_buffer,
-			    224 + nstages * sizeof(*g->time_taken), 0)) {
+	if (usblink_setdata(d->usb_link, "auxBuffer", g->aux_buffer,
+			    224 + job->nstages * sizeof(*g->time_taken), 0)) {
 		free(g->aux_buffer);
 		free(g);
-		pthread_mutex_unlock(&mm);
-		return MVNC_ERROR;
+		trace_record(TRACE_UPLOAD, "graph upload", start, job->graph_file_length, MVNC_ERROR);
+		job->rc = MVNC_ERROR;
+		goto out;
 	}
+	trace_record(TRACE_UPLOAD, "graph upload", start, job->graph_file_length, MVNC_OK);
+	t0 = time_in_seconds() - t0;
+	if (t0 > 0)
+		g->upload_throughput = job->graph_file_length / (1048576.0 * t0);
 
 	g->debug_buffer = g->aux_buffer;
 	g->time_taken = (float *) (g->aux_buffer + 224);
 
-	// output_data
-	g->output_data = calloc(noutputs, 2);
-	if (!g->output_data) {
-		free(g->aux_buffer);
-		free(g);
-		pthread_mutex_unlock(&mm);
-		return MVNC_OUT_OF_MEMORY;
+	// Kept to reload it after a reset
+	if (d->watchdog_ms) {
+		g->graph_file = malloc(job->graph_file_length);
+		if (!g->graph_file) {
+			free_graph(g);
+			job->rc = MVNC_OUT_OF_MEMORY;
+			goto out;
+		}
+		memcpy(g->graph_file, job->graph_file, job->graph_file_length);
+		g->graph_file_length = job->graph_file_length;
 	}
 
-	g->dev->thermal_stats = (float *) (g->aux_buffer + DEBUG_BUFFER_SIZE);
+	// output_data, from the pool so results can be read without copies
+	g->output_data = get_tensor_buffer(d, 2 * job->noutputs);
+	if (!g->output_data) {
+		free_graph(g);
+		job->rc = MVNC_OUT_OF_MEMORY;
+		goto out;
+	}
 
 	g->iterations = 1;
 	g->network_throttle = 1;
-	if (d->graphs)
+	job->graph = g;
+	job->rc = MVNC_OK;
+	PRINT_DEBUG(stderr, "Graph uploaded to %s at %.1f MB/s\n",
+		    d->dev_addr, g->upload_throughput);
+out:
+	return NULL;
+}
+
+static mvncStatus allocate_graphs(void **deviceHandles, void **graphHandles,
+				  unsigned int deviceCount, const void *graphFile,
+				  unsigned int graphFileLength)
+{
+	unsigned i, j;
+	mvncStatus rc = MVNC_OK;
+
+	if (!deviceHandles || !graphHandles || !graphFile || !deviceCount)
+		return MVNC_INVALID_PARAMETERS;
+
+	mvncGraphFileInfo info;
+	rc = mvncGetGraphFileInfo(graphFile, graphFileLength, &info);
+	if (rc)
+		return rc;
+
+	struct AllocJob *jobs = calloc(deviceCount, sizeof(*jobs));
+	if (!jobs)
+		return MVNC_OUT_OF_MEMORY;
+
+	// Reserve all the devices first, so that the uploads themselves
+	// do not need the global lock
+	trace_lock(&mm, "global lock");
+	for (i = 0; i < deviceCount; i++) {
+		struct Device *d = (struct Device *) deviceHandles[i];
+		if (!d || find_device(d)) {
+			rc = MVNC_INVALID_PARAMETERS;
+			break;
+		}
+		if (d->graphs || d->allocating) {
+			rc = MVNC_BUSY;
+			break;
+		}
+		d->allocating = 1;
+		jobs[i].dev = d;
+		jobs[i].graph_file = graphFile;
+		jobs[i].graph_file_length = graphFileLength;
+		jobs[i].nstages = info.stageCount;
+		jobs[i].ninputs = info.inputLength / 2;
+		jobs[i].noutputs = info.outputLength / 2;
+		jobs[i].rc = MVNC_ERROR;
+	}
+	if (rc) {
+		for (j = 0; j < i; j++)
+			jobs[j].dev->allocating = 0;
+		pthread_mutex_unlock(&mm);
+		free(jobs);
+		return rc;
+	}
+	pthread_mutex_unlock(&mm);
+
+	// One upload per device, all of them in flight at the same time
+	if (deviceCount == 1)
+		allocate_on_device(&jobs[0]);
+	else {
+		for (i = 0; i < deviceCount; i++)
+			if (pthread_create(&jobs[i].thread, NULL,
+					   allocate_on_device, &jobs[i])) {
+				jobs[i].thread = 0;
+				allocate_on_device(&jobs[i]);
+			}
+		for (i = 0; i < deviceCount; i++)
+			if (jobs[i].thread)
+				pthread_join(jobs[i].thread, NULL);
+	}
+
+	for (i = 0; i < deviceCount; i++)
+		if (jobs[i].rc) {
+			rc = jobs[i].rc;
+			break;
+		}
+
+	// Either every device gets the graph or none of them does
+	trace_lock(&mm, "global lock");
+	for (i = 0; i < deviceCount; i++) {
+		struct Device *d = jobs[i].dev;
+		struct Graph *g = jobs[i].graph;
+
+		d->allocating = 0;
+		if (rc) {
+			if (g)
+				free_graph(g);
+			graphHandles[i] = NULL;
+			continue;
+		}
+		d->thermal_stats = (float *) (g->aux_buffer + DEBUG_BUFFER_SIZE);
 		g->next = d->graphs;
-	d->graphs = g;
-	*graphHandle = g;
+		d->graphs = g;
+		graphHandles[i] = g;
+	}
 	pthread_mutex_unlock(&mm);
-	return MVNC_OK;
+	free(jobs);
+	return rc;
 }
 
-mvncStatus mvncDeallocateGraph(void *graphHandle)
+mvncStatus mvncAllocateGraphs(void **deviceHandles, void **graphHandles,
+			      unsigned int deviceCount, const void *graphFile,
+			      unsigned int graphFileLength)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = allocate_graphs(deviceHandles, graphHandles, deviceCount,
+					graphFile, graphFileLength);
+	trace_record(TRACE_API, "mvncAllocateGraphs", start, graphFileLength, rc);
+	return rc;
+}
+
+mvncStatus mvncAllocateGraph(void *deviceHandle, void **graphHandle,
+                              const void *graphFile, unsigned int graphFileLength)
+{
+	if (!deviceHandle || !graphHandle || !graphFile)
+		return MVNC_INVALID_PARAMETERS;
+
+	uint64_t start = trace_call();
+	mvncStatus rc = allocate_graphs(&deviceHandle, graphHandle, 1, graphFile,
+					graphFileLength);
+	trace_record(TRACE_API, "mvncAllocateGraph", start, graphFileLength, rc);
+	return rc;
+}
+
+static mvncStatus deallocate_graph_handle(void *graphHandle)
 {
 	if (!graphHandle)
 		return MVNC_INVALID_PARAMETERS;
 
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_graph(graphHandle)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
 
 	struct Device *d = ((struct Graph *) graphHandle)->dev;
+	trace_context(d->id, ((struct Graph *) graphHandle)->id);
 
-	pthread_mutex_lock(&d->mm);
+	stop_completion_thread((struct Graph *) graphHandle);
+	trace_lock(&d->mm, "device lock");
+	// The recovery thread reloads the graph without the device lock
+	while (d->recovering) {
+		pthread_mutex_unlock(&d->mm);
+		pthread_mutex_unlock(&mm);
+		usleep(1000);
+		trace_lock(&mm, "global lock");
+		if (find_graph(graphHandle)) {
+			pthread_mutex_unlock(&mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		trace_lock(&d->mm, "device lock");
+	}
 	if (deallocate_graph((struct Graph *) graphHandle)) {
 		pthread_mutex_unlock(&d->mm);
 		pthread_mutex_unlock(&mm);
@@ -559,20 +1584,72 @@ mvncStatus mvncDeallocateGraph(void *graphHandle)
 	return MVNC_OK;
 }
 
-mvncStatus mvncSetGraphOption(void *graphHandle, int option, const void *data,
-			      unsigned int dataLength)
+mvncStatus mvncDeallocateGraph(void *graphHandle)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = deallocate_graph_handle(graphHandle);
+	trace_record(TRACE_API, "mvncDeallocateGraph", start, 0, rc);
+	return rc;
+}
+
+mvncStatus mvncAllocTensorBuffer(void *deviceHandle, unsigned int length, void **buffer)
+{
+	if (!deviceHandle || !buffer || !length)
+		return MVNC_INVALID_PARAMETERS;
+
+	struct Device *d = (struct Device *) deviceHandle;
+	trace_lock(&mm, "global lock");
+	if (find_device(d)) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_INVALID_PARAMETERS;
+	}
+
+	*buffer = get_tensor_buffer(d, length);
+	pthread_mutex_unlock(&mm);
+	return *buffer ? MVNC_OK : MVNC_OUT_OF_MEMORY;
+}
+
+mvncStatus mvncFreeTensorBuffer(void *deviceHandle, void *buffer)
+{
+	if (!deviceHandle || !buffer)
+		return MVNC_INVALID_PARAMETERS;
+
+	struct Device *d = (struct Device *) deviceHandle;
+	trace_lock(&mm, "global lock");
+	if (find_device(d) || put_tensor_buffer(d, buffer)) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_INVALID_PARAMETERS;
+	}
+
+	pthread_mutex_unlock(&mm);
+	return MVNC_OK;
+}
+
+// Options returning a struct get the size of data in *dataLength, and set it to
+// the size needed when it is too small
+static int too_small(unsigned int *dataLength, unsigned int size)
+{
+	if (*dataLength >= size)
+		return 0;
+	*dataLength = size;
+	return 1;
+}
+
+static mvncStatus set_graph_option(void *graphHandle, int option, const void *data,
+				   unsigned int dataLength)
 {
 	if (!graphHandle || !data || dataLength != 4)
 		return MVNC_INVALID_PARAMETERS;
 
 	struct Graph *g = (struct Graph *) graphHandle;
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_graph(graphHandle)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	trace_context(g->dev->id, g->id);
 
-	pthread_mutex_lock(&g->dev->mm);
+	trace_lock(&g->dev->mm, "device lock");
 	pthread_mutex_unlock(&mm);
 	switch (option) {
 	case MVNC_ITERATIONS:
@@ -584,6 +1661,41 @@ mvncStatus mvncSetGraphOption(void *graphHandle, int option, const void *data,
 	case MVNC_DONT_BLOCK:
 		g->dont_block = *(int *) data;
 		break;
+	case MVNC_QUEUE_LIMIT:
+		if (*(int *) data < 0) {
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		g->queue_limit = *(int *) data;
+		break;
+	case MVNC_QUEUE_POLICY:
+		if (*(int *) data < MVNC_QUEUE_REJECT || *(int *) data > MVNC_QUEUE_BLOCK) {
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		g->queue_policy = *(int *) data;
+		break;
+	case MVNC_QUEUE_TIMEOUT:
+		if (*(int *) data < 0) {
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		g->queue_timeout = *(int *) data;
+		break;
+	case MVNC_GRAPH_STATS:
+		stats_reset(&g->stats);
+		break;
+	case MVNC_STAGE_STATS:
+		free(g->stage_stats);
+		g->stage_stats = 0;
+		if (*(int *) data) {
+			g->stage_stats = calloc(g->nstages, sizeof(*g->stage_stats));
+			if (!g->stage_stats) {
+				pthread_mutex_unlock(&g->dev->mm);
+				return MVNC_OUT_OF_MEMORY;
+			}
+		}
+		break;
 	default:
 		pthread_mutex_unlock(&g->dev->mm);
 		return MVNC_INVALID_PARAMETERS;
@@ -593,20 +1705,30 @@ mvncStatus mvncSetGraphOption(void *graphHandle, int option, const void *data,
 	return MVNC_OK;
 }
 
-mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data,
-			      unsigned int *dataLength)
+mvncStatus mvncSetGraphOption(void *graphHandle, int option, const void *data,
+			      unsigned int dataLength)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = set_graph_option(graphHandle, option, data, dataLength);
+	trace_record(TRACE_API, "mvncSetGraphOption", start, option, rc);
+	return rc;
+}
+
+static mvncStatus get_graph_option(void *graphHandle, int option, void *data,
+				   unsigned int *dataLength)
 {
 	if (!graphHandle || !data || !dataLength)
 		return MVNC_INVALID_PARAMETERS;
 
 	struct Graph *g = (struct Graph *) graphHandle;
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_graph(graphHandle)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	trace_context(g->dev->id, g->id);
 
-	pthread_mutex_lock(&g->dev->mm);
+	trace_lock(&g->dev->mm, "device lock");
 	pthread_mutex_unlock(&mm);
 	switch (option) {
 	case MVNC_ITERATIONS:
@@ -620,6 +1742,18 @@ mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data,
 	case MVNC_DONT_BLOCK:
 		*(int *) data = g->dont_block;
 
+		*dataLength = sizeof(int);
+		break;
+	case MVNC_QUEUE_LIMIT:
+		*(int *) data = g->queue_limit;
+		*dataLength = sizeof(int);
+		break;
+	case MVNC_QUEUE_POLICY:
+		*(int *) data = g->queue_policy;
+		*dataLength = sizeof(int);
+		break;
+	case MVNC_QUEUE_TIMEOUT:
+		*(int *) data = g->queue_timeout;
 		*dataLength = sizeof(int);
 		break;
 	case MVNC_TIME_TAKEN:
@@ -630,6 +1764,49 @@ mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data,
 		*(char **) data = g->debug_buffer;
 		*dataLength = DEBUG_BUFFER_SIZE;
 		break;
+	case MVNC_UPLOAD_THROUGHPUT:
+		*(float *) data = g->upload_throughput;
+		*dataLength = sizeof(float);
+		break;
+	case MVNC_HOST_TIMES:
+		if (too_small(dataLength, sizeof(mvncHostTimes))) {
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		*(mvncHostTimes *) data = g->last_times;
+		*dataLength = sizeof(mvncHostTimes);
+		break;
+	case MVNC_GRAPH_STATS:
+		if (too_small(dataLength, sizeof(mvncStats))) {
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		stats_read(&g->stats, data);
+		*dataLength = sizeof(mvncStats);
+		break;
+	case MVNC_STAGE_STATS:
+		*(int *) data = g->stage_stats != 0;
+		*dataLength = sizeof(int);
+		break;
+	case MVNC_GRAPH_WEIGHT:
+		*(float *) data = g->failed ? 0 : dispatch_weight(g->dev);
+		*dataLength = sizeof(float);
+		break;
+	case MVNC_THERMAL_WAIT:
+		*(float *) data = thermal_wait(g->dev) * 1e-3;
+		*dataLength = sizeof(float);
+		break;
+	case MVNC_COMPLETION_FD:
+		if (g->completion_fd < 0) {
+			mvncStatus rc = start_completion_thread(g);
+			if (rc) {
+				pthread_mutex_unlock(&g->dev->mm);
+				return rc;
+			}
+		}
+		*(int *) data = g->completion_fd;
+		*dataLength = sizeof(int);
+		break;
 	default:
 		pthread_mutex_unlock(&g->dev->mm);
 		return MVNC_INVALID_PARAMETERS;
@@ -639,6 +1816,15 @@ mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data,
 	return MVNC_OK;
 }
 
+mvncStatus mvncGetGraphOption(void *graphHandle, int option, void *data,
+			      unsigned int *dataLength)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = get_graph_option(graphHandle, option, data, dataLength);
+	trace_record(TRACE_API, "mvncGetGraphOption", start, option, rc);
+	return rc;
+}
+
 mvncStatus mvncSetGlobalOption(int option, const void *data,
 			       unsigned int dataLength)
 {
@@ -649,6 +1835,9 @@ mvncStatus mvncSetGlobalOption(int option, const void *data,
 	case MVNC_LOG_LEVEL:
 		mvnc_loglevel = *(int *) data;
 		break;
+	case MVNC_TRACE:
+		__atomic_store_n(&trace_enabled, *(int *) data != 0, __ATOMIC_RELAXED);
+		break;
 	default:
 		return MVNC_INVALID_PARAMETERS;
 	}
@@ -666,14 +1855,51 @@ mvncStatus mvncGetGlobalOption(int option, void *data, unsigned int *dataLength)
 		*(int *) data = mvnc_loglevel;
 		*dataLength = sizeof(mvnc_loglevel);
 		break;
+	case MVNC_TRACE:
+		*(int *) data = trace_enabled;
+		*dataLength = sizeof(trace_enabled);
+		break;
 	default:
 		return MVNC_INVALID_PARAMETERS;
 	}
 	return MVNC_OK;
 }
 
-mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data,
-			       unsigned int dataLength)
+static mvncStatus get_stage_stats(void *graphHandle, unsigned int index,
+				   mvncStageStats *stats)
+{
+	if (!graphHandle || !stats)
+		return MVNC_INVALID_PARAMETERS;
+
+	struct Graph *g = (struct Graph *) graphHandle;
+	trace_lock(&mm, "global lock");
+	if (find_graph(graphHandle) || index >= g->nstages) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_INVALID_PARAMETERS;
+	}
+	trace_context(g->dev->id, g->id);
+
+	trace_lock(&g->dev->mm, "device lock");
+	pthread_mutex_unlock(&mm);
+	if (!g->stage_stats) {
+		pthread_mutex_unlock(&g->dev->mm);
+		return MVNC_NO_DATA;
+	}
+	stage_stats_read(&g->stage_stats[index], stats);
+	pthread_mutex_unlock(&g->dev->mm);
+	return MVNC_OK;
+}
+
+mvncStatus mvncGetStageStats(void *graphHandle, unsigned int index, mvncStageStats *stats)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = get_stage_stats(graphHandle, index, stats);
+	trace_record(TRACE_API, "mvncGetStageStats", start, index, rc);
+	return rc;
+}
+
+static mvncStatus set_device_option(void *deviceHandle, int option, const void *data,
+				    unsigned int dataLength)
 {
 	if (deviceHandle == 0 && option == MVNC_LOG_LEVEL) {
 		PRINT("Warning: MVNC_LOG_LEVEL is not a Device Option, \
@@ -685,13 +1911,14 @@ mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data,
 		return MVNC_INVALID_PARAMETERS;
 
 	struct Device *d = (struct Device *) deviceHandle;
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_device(d)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	trace_context(d->id, 0);
 
-	pthread_mutex_lock(&d->mm);
+	trace_lock(&d->mm, "device lock");
 	pthread_mutex_unlock(&mm);
 	switch (option) {
 	case MVNC_TEMP_LIM_LOWER:
@@ -712,6 +1939,34 @@ mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data,
 	case MVNC_TEMPERATURE_DEBUG:
 		d->temperature_debug = *(int *) data;
 		break;
+	case MVNC_DEVICE_STATS:
+		stats_reset(&d->stats);
+		break;
+	case MVNC_THERMAL_CONTROL:
+		d->thermal_control = *(int *) data != 0;
+		d->duty = d->duty_integral = 1;
+		d->control_time = 0;
+		__atomic_store_n(&d->paced_until, 0, __ATOMIC_RELAXED);
+		break;
+	case MVNC_THERMAL_TARGET:
+		d->thermal_target = *(float *) data;
+		break;
+	case MVNC_WATCHDOG:
+		// The graphs keep their graph file only when it is set first, and
+		// the tensor buffers must not be allocated by the driver
+		if (*(int *) data < 0 || d->graphs || d->allocating) {
+			pthread_mutex_unlock(&d->mm);
+			return *(int *) data < 0 ? MVNC_INVALID_PARAMETERS : MVNC_BUSY;
+		}
+		pthread_mutex_lock(&d->pool_mm);
+		if (*(int *) data && free_dev_mem_buffers(d)) {
+			pthread_mutex_unlock(&d->pool_mm);
+			pthread_mutex_unlock(&d->mm);
+			return MVNC_BUSY;
+		}
+		d->watchdog_ms = *(int *) data;
+		pthread_mutex_unlock(&d->pool_mm);
+		break;
 	default:
 		pthread_mutex_unlock(&d->mm);
 		return MVNC_INVALID_PARAMETERS;
@@ -721,6 +1976,15 @@ mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data,
 	return MVNC_OK;
 }
 
+mvncStatus mvncSetDeviceOption(void *deviceHandle, int option, const void *data,
+			       unsigned int dataLength)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = set_device_option(deviceHandle, option, data, dataLength);
+	trace_record(TRACE_API, "mvncSetDeviceOption", start, option, rc);
+	return rc;
+}
+
 static mvncStatus get_optimisation_list(struct Device *d)
 {
 	int i, config[10];
@@ -730,6 +1994,8 @@ static mvncStatus get_optimisation_list(struct Device *d)
 
 	if (d->optimisation_list)
 		return MVNC_OK;
+	if (d->recovering || d->lost)
+		return MVNC_BUSY;
 
 	d->optimisation_list = calloc(OPTIMISATION_LIST_BUFFER_SIZE, 1);
 	if (!d->optimisation_list)
@@ -768,10 +2034,11 @@ static mvncStatus get_optimisation_list(struct Device *d)
 	return MVNC_OK;
 }
 
-mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
-			       unsigned int *dataLength)
+static mvncStatus get_device_option(void *deviceHandle, int option, void *data,
+				    unsigned int *dataLength)
 {
 	mvncStatus rc;
+	int allocating;
 
 	if (deviceHandle == 0 && option == MVNC_LOG_LEVEL) {
 		PRINT("Warning: MVNC_LOG_LEVEL is not a Device Option, \
@@ -783,13 +2050,16 @@ mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
 		return MVNC_INVALID_PARAMETERS;
 
 	struct Device *d = (struct Device *) deviceHandle;
-	pthread_mutex_lock(&mm);
+	trace_lock(&mm, "global lock");
 	if (find_device(d)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	trace_context(d->id, 0);
 
-	pthread_mutex_lock(&d->mm);
+	trace_lock(&d->mm, "device lock");
+	// A graph upload uses the link without the device lock
+	allocating = d->allocating;
 	pthread_mutex_unlock(&mm);
 	switch (option) {
 	case MVNC_TEMP_LIM_LOWER:
@@ -825,7 +2095,7 @@ mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
 		*dataLength = THERMAL_BUFFER_SIZE;
 		break;
 	case MVNC_OPTIMISATION_LIST:
-		rc = get_optimisation_list(d);
+		rc = allocating ? MVNC_BUSY : get_optimisation_list(d);
 		if (rc) {
 			pthread_mutex_unlock(&d->mm);
 			return rc;
@@ -837,6 +2107,54 @@ mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
 		*(int *) data = d->throttle_happened;
 		*dataLength = sizeof(int);
 		break;
+	case MVNC_DEVICE_STATS:
+		if (too_small(dataLength, sizeof(mvncStats))) {
+			pthread_mutex_unlock(&d->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		stats_read(&d->stats, data);
+		*dataLength = sizeof(mvncStats);
+		break;
+	case MVNC_THERMAL_FD:
+		if (d->thermal_fd < 0) {
+			d->thermal_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (d->thermal_fd < 0) {
+				pthread_mutex_unlock(&d->mm);
+				return MVNC_ERROR;
+			}
+		}
+		*(int *) data = d->thermal_fd;
+		*dataLength = sizeof(int);
+		break;
+	case MVNC_THERMAL_CONTROL: {
+		mvncThermalControl *c = (mvncThermalControl *) data;
+		if (too_small(dataLength, sizeof(mvncThermalControl))) {
+			pthread_mutex_unlock(&d->mm);
+			return MVNC_INVALID_PARAMETERS;
+		}
+		c->enabled = d->thermal_control;
+		c->target = d->thermal_target ? d->thermal_target : d->temp_lim_lower - THERMAL_MARGIN;
+		c->temperature = d->temperature;
+		c->duty = d->duty;
+		c->deviceMs = d->device_ms;
+		c->sustainedRate = d->device_ms ? d->duty * 1e3 / d->device_ms : 0;
+		c->rate = d->rate;
+		*dataLength = sizeof(mvncThermalControl);
+		break;
+	}
+	case MVNC_THERMAL_TARGET:
+		*(float *) data = d->thermal_target ? d->thermal_target :
+				  d->temp_lim_lower - THERMAL_MARGIN;
+		*dataLength = sizeof(float);
+		break;
+	case MVNC_DISPATCH_WEIGHT:
+		*(float *) data = dispatch_weight(d);
+		*dataLength = sizeof(float);
+		break;
+	case MVNC_WATCHDOG:
+		*(int *) data = d->watchdog_ms;
+		*dataLength = sizeof(int);
+		break;
 	default:
 		pthread_mutex_unlock(&d->mm);
 		return MVNC_INVALID_PARAMETERS;
@@ -846,155 +2164,504 @@ mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
 	return MVNC_OK;
 }
 
-static int send_opt_data(struct Graph *g)
+mvncStatus mvncGetDeviceOption(void *deviceHandle, int option, void *data,
+			       unsigned int *dataLength)
 {
-	int config[10];
+	uint64_t start = trace_call();
+	mvncStatus rc = get_device_option(deviceHandle, option, data, dataLength);
+	trace_record(TRACE_API, "mvncGetDeviceOption", start, option, rc);
+	return rc;
+}
 
-	config[0] = 1;		// Version
-	config[1] = 0;		// Query disable
-	config[2] = g->iterations;
-	config[3] = g->dev->temp_lim_upper;
-	config[4] = g->dev->temp_lim_lower;
-	config[5] = g->dev->backoff_time_normal;
-	config[6] = g->dev->backoff_time_high;
-	config[7] = g->dev->backoff_time_critical;
-	config[8] = g->dev->temperature_debug;
-	config[9] = g->network_throttle;
+static mvncStatus get_thermal_history(void *deviceHandle, unsigned long long *sequence,
+				      mvncThermalSample *samples, unsigned int *count)
+{
+	unsigned long long first, n = 0;
 
-	if (usblink_setdata(g->dev->usb_link, "config", config, sizeof(config), 0))
-		return MVNC_ERROR;
+	if (!deviceHandle || !sequence || !samples || !count)
+		return MVNC_INVALID_PARAMETERS;
+
+	struct Device *d = (struct Device *) deviceHandle;
+	trace_lock(&mm, "global lock");
+	if (find_device(d)) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_INVALID_PARAMETERS;
+	}
+	trace_context(d->id, 0);
+
+	trace_lock(&d->mm, "device lock");
+	pthread_mutex_unlock(&mm);
+	first = d->thermal_count > THERMAL_HISTORY ? d->thermal_count - THERMAL_HISTORY : 0;
+	if (*sequence > first)
+		first = *sequence < d->thermal_count ? *sequence : d->thermal_count;
+	for (; n < *count && first + n < d->thermal_count; n++)
+		samples[n] = d->thermal[(first + n) % THERMAL_HISTORY];
+	pthread_mutex_unlock(&d->mm);
 
+	*sequence = first + n;
+	*count = n;
 	return MVNC_OK;
 }
 
-mvncStatus mvncLoadTensor(void *graphHandle, const void *inputTensor,
-			  unsigned int inputTensorLength, void *userParam)
+mvncStatus mvncGetThermalHistory(void *deviceHandle, unsigned long long *sequence,
+				 mvncThermalSample *samples, unsigned int *count)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = get_thermal_history(deviceHandle, sequence, samples, count);
+	trace_record(TRACE_API, "mvncGetThermalHistory", start, 0, rc);
+	return rc;
+}
+
+// Priority of a waiter, raised by one every MVNC_PRIORITY_AGING_MS it waits
+static long waiter_level(const struct Waiter *w, double now)
+{
+	return w->priority + (long) ((now - w->since) * 1e3 / MVNC_PRIORITY_AGING_MS);
+}
+
+// The waiter to send next: the highest level, then the earliest deadline,
+// then the oldest
+static struct Waiter *first_waiter(struct Graph *g)
+{
+	double now = time_in_seconds();
+	struct Waiter *w, *best = g->waiters;
+	long level, best_level = best ? waiter_level(best, now) : 0;
+
+	for (w = best ? best->next : NULL; w; w = w->next) {
+		level = waiter_level(w, now);
+		if (level > best_level || (level == best_level && w->deadline &&
+					   (!best->deadline || w->deadline < best->deadline))) {
+			best = w;
+			best_level = level;
+		}
+	}
+	return best;
+}
+
+static void add_waiter(struct Graph *g, struct Waiter *w)
+{
+	struct Waiter **p;
+
+	for (p = &g->waiters; *p; p = &(*p)->next)
+		;
+	*p = w;
+	g->nwaiters++;
+}
+
+static void remove_waiter(struct Graph *g, struct Waiter *w)
+{
+	struct Waiter **p;
+
+	for (p = &g->waiters; *p; p = &(*p)->next)
+		if (*p == w) {
+			*p = w->next;
+			g->nwaiters--;
+			break;
+		}
+}
+
+// Makes room for a new call in a full queue by MVNC_QUEUE_POLICY, under
+// the global lock, released while blocking and on failure
+static mvncStatus admit_waiter(struct Graph *g, struct Waiter *w)
+{
+	double until = time_in_seconds() + g->queue_timeout * 1e-3;
+
+	if (g->queue_policy == MVNC_QUEUE_DROP_OLDEST) {
+		g->waiters->dropped = 1;
+		remove_waiter(g, g->waiters);
+		COUNT(g, dropped, 1);
+		return MVNC_OK;
+	}
+	if (g->queue_policy != MVNC_QUEUE_BLOCK) {
+		COUNT(g, rejected, 1);
+		pthread_mutex_unlock(&mm);
+		return MVNC_BUSY;
+	}
+	COUNT(g, blocked, 1);
+	while (g->queue_limit && g->nwaiters >= g->queue_limit) {
+		if (expired(w->deadline)) {
+			COUNT(g, expired, 1);
+			pthread_mutex_unlock(&mm);
+			return MVNC_TIMEOUT;
+		}
+		if (g->queue_timeout && time_in_seconds() >= until) {
+			COUNT(g, rejected, 1);
+			pthread_mutex_unlock(&mm);
+			return MVNC_BUSY;
+		}
+		pthread_mutex_unlock(&mm);
+		usleep(1000);
+		trace_lock(&mm, "global lock");
+		if (find_graph(g)) {
+			pthread_mutex_unlock(&mm);
+			return MVNC_GONE;
+		}
+	}
+	return MVNC_OK;
+}
+
+static mvncStatus load_tensor(void *graphHandle, const void *inputTensor,
+			      unsigned int inputTensorLength, void *userParam,
+			      const mvncLoadParams *params)
 {
 	if (!graphHandle || !inputTensor || inputTensorLength < 2)
 		return MVNC_INVALID_PARAMETERS;
 
+	double start = time_in_seconds(), lock_wait, slot_wait, t;
 	struct Graph *g = (struct Graph *) graphHandle;
-	pthread_mutex_lock(&mm);
-	if (find_graph(graphHandle)) {
+	struct Waiter w = { userParam, 0, 0, start, 0, 0, NULL };
+	mvncStatus rc = MVNC_OK;
+	unsigned pace = 0;
+	if (params) {
+		w.deadline = params->deadline;
+		w.priority = params->priority;
+	}
+	trace_lock(&mm, "global lock");
+	t = time_in_seconds();
+	lock_wait = t - start;
+	if (find_graph(graphHandle) || inputTensorLength != 2 * g->ninputs) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	trace_context(g->dev->id, g->id);
 
-	if (!g->started) {
-		if (send_opt_data(g)) {
-			pthread_mutex_unlock(&mm);
-			return MVNC_ERROR;
-		}
-		g->started = 1;
+	if (g->queue_limit && g->nwaiters >= g->queue_limit && !g->dont_block) {
+		rc = admit_waiter(g, &w);
+		if (rc)
+			return rc;
 	}
 
-	while (g->have_data == 2) {
+	// Waits in the queue of the graph, only its first call taking a free
+	// input
+	add_waiter(g, &w);
+	for (;;) {
+		if (w.dropped) {
+			rc = MVNC_DROPPED;
+			break;
+		}
+		if (expired(w.deadline)) {
+			COUNT(g, expired, 1);
+			rc = MVNC_TIMEOUT;
+			break;
+		}
+		if (w.cancelled) {
+			COUNT(g, cancelled, 1);
+			rc = MVNC_CANCELLED;
+			break;
+		}
+		if (__atomic_load_n(&g->slots_used, __ATOMIC_ACQUIRE) < 2 && !g->dev->recovering &&
+		    first_waiter(g) == &w && !(pace = thermal_pace(g->dev))) {
+			// Taken under the global lock, before have_data counts the
+			// input, so that no other call takes a third one meanwhile
+			__atomic_add_fetch(&g->slots_used, 1, __ATOMIC_ACQ_REL);
+			break;
+		}
 		if (g->dont_block) {
-			pthread_mutex_unlock(&mm);
-			return MVNC_BUSY;
+			COUNT(g, busy, 1);
+			if (pace)
+				COUNT(g, throttled, 1);
+			rc = MVNC_BUSY;
+			break;
 		}
-		if (g->failed) {
-			pthread_mutex_unlock(&mm);
-			return MVNC_ERROR;
+		if (!pace && g->failed) {
+			rc = MVNC_ERROR;
+			break;
 		}
 		pthread_mutex_unlock(&mm);
-		usleep(1000);
-		pthread_mutex_lock(&mm);
+		usleep(pace ? pace : 1000);
+		pace = 0;
+		trace_lock(&mm, "global lock");
 		if (find_graph(g)) {
 			pthread_mutex_unlock(&mm);
 			return MVNC_GONE;
 		}
 	}
-	pthread_mutex_lock(&g->dev->mm);
+	remove_waiter(g, &w);
+	if (rc) {
+		pthread_mutex_unlock(&mm);
+		return rc;
+	}
+	slot_wait = time_in_seconds() - t;
+	t = time_in_seconds();
+	trace_lock(&g->dev->mm, "device lock");
 	pthread_mutex_unlock(&mm);
+	lock_wait += time_in_seconds() - t;
 
-	if (usblink_setdata(g->dev->usb_link, g->input_idx ? "input2" : "input1",
-	     inputTensor, inputTensorLength, g->have_data == 0)) {
-		pthread_mutex_unlock(&mm);
+	if (g->dev->lost || (!g->started && !g->dev->recovering && send_opt_data(g))) {
+		COUNT(g, errors, 1);
+		__atomic_sub_fetch(&g->slots_used, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&g->dev->mm);
 		return MVNC_ERROR;
 	}
+	g->started = 1;
+	if (g->dev->watchdog_ms) {
+		if (!g->replay[g->input_idx])
+			g->replay[g->input_idx] = malloc(inputTensorLength);
+		if (!g->replay[g->input_idx]) {
+			__atomic_sub_fetch(&g->slots_used, 1, __ATOMIC_RELEASE);
+			pthread_mutex_unlock(&g->dev->mm);
+			return MVNC_OUT_OF_MEMORY;
+		}
+		memcpy(g->replay[g->input_idx], inputTensor, inputTensorLength);
+		g->replays[g->input_idx] = 0;
+	}
 
+	// When the recovery of the device started meanwhile, or when the upload
+	// fails with the watchdog, the input is uploaded from the copy once it
+	// is back
+	t = time_in_seconds();
+	if (!g->dev->recovering &&
+	    usblink_setdata(g->dev->usb_link, g->input_idx ? "input2" : "input1",
+			    inputTensor, inputTensorLength, g->have_data == 0) &&
+	    (!g->dev->watchdog_ms || start_recovery(g->dev))) {
+		COUNT(g, errors, 1);
+		__atomic_sub_fetch(&g->slots_used, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&g->dev->mm);
+		return MVNC_ERROR;
+	}
+
+	mvncHostTimes *times = &g->times[g->input_idx];
+	memset(times, 0, sizeof(*times));
+	g->uploaded[g->input_idx] = time_in_seconds();
+	times->start = start;
+	times->slotWait = slot_wait * 1e3;
+	times->lockWait = lock_wait * 1e3;
+	times->upload = ms_between(t, g->uploaded[g->input_idx]);
+	times->uploadBytes = inputTensorLength;
+	COUNT(g, bytes_in, inputTensorLength);
+	if (g->dev->thermal_control)
+		pace_thermal(g->dev);
 	g->user_param[g->input_idx] = userParam;
 	g->input_idx = !g->input_idx;
 	g->have_data++;
+	if (g->completion_fd >= 0) {
+		pthread_mutex_lock(&g->async_mm);
+		pthread_cond_signal(&g->async_cond);
+		pthread_mutex_unlock(&g->async_mm);
+	}
 	pthread_mutex_unlock(&g->dev->mm);
 	return MVNC_OK;
 }
 
-mvncStatus mvncGetResult(void *graphHandle, void **outputData,
-			 unsigned int *outputDataLength, void **userParam)
+mvncStatus mvncLoadTensor(void *graphHandle, const void *inputTensor,
+			  unsigned int inputTensorLength, void *userParam)
 {
-	int rc, unlock_own = 0;
+	uint64_t start = trace_call();
+	mvncStatus rc = load_tensor(graphHandle, inputTensor, inputTensorLength, userParam, NULL);
+	trace_record(TRACE_API, "mvncLoadTensor", start, inputTensorLength, rc);
+	return rc;
+}
 
-	if (!graphHandle || !outputData || !outputDataLength)
-		return MVNC_INVALID_PARAMETERS;
+mvncStatus mvncLoadTensorWithParams(void *graphHandle, const void *inputTensor,
+				    unsigned int inputTensorLength, void *userParam,
+				    const mvncLoadParams *params)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = load_tensor(graphHandle, inputTensor, inputTensorLength, userParam, params);
+	trace_record(TRACE_API, "mvncLoadTensorWithParams", start, inputTensorLength, rc);
+	return rc;
+}
 
+static mvncStatus cancel_tensors(void *graphHandle, void *userParam)
+{
 	struct Graph *g = (struct Graph *) graphHandle;
-	pthread_mutex_lock(&mm);
+	mvncStatus rc = MVNC_NO_DATA;
+	struct Waiter *w;
+
+	trace_lock(&mm, "global lock");
 	if (find_graph(graphHandle)) {
 		pthread_mutex_unlock(&mm);
 		return MVNC_INVALID_PARAMETERS;
 	}
+	for (w = g->waiters; w; w = w->next)
+		if (w->user_param == userParam && !w->cancelled) {
+			w->cancelled = 1;
+			rc = MVNC_OK;
+		}
+	pthread_mutex_unlock(&mm);
+	return rc;
+}
+
+mvncStatus mvncCancelTensors(void *graphHandle, void *userParam)
+{
+	uint64_t start = trace_call();
+	mvncStatus rc = cancel_tensors(graphHandle, userParam);
+	trace_record(TRACE_API, "mvncCancelTensors", start, 0, rc);
+	return rc;
+}
+
+// Returns the oldest result fetched by the completion thread, called with
+// the global lock held
+static mvncStatus get_completed(struct Graph *g, void *buffer, void **outputData,
+				unsigned int *outputDataLength, void **userParam, double deadline)
+{
+	struct Result *r;
+
+	while (!__atomic_load_n(&g->completed, __ATOMIC_ACQUIRE)) {
+		if (g->dont_block || expired(deadline)) {
+			pthread_mutex_unlock(&mm);
+			return MVNC_NO_DATA;
+		}
+		pthread_mutex_unlock(&mm);
+		usleep(1000);
+		trace_lock(&mm, "global lock");
+		if (find_graph(g)) {
+			pthread_mutex_unlock(&mm);
+			return MVNC_GONE;
+		}
+	}
+
+	trace_lock(&g->dev->mm, "device lock");
+	pthread_mutex_unlock(&mm);
+	pthread_mutex_lock(&g->async_mm);
+	g->held = g->queue[g->first_completed];
+	g->first_completed = (g->first_completed + 1) % RESULT_SLOTS;
+	__atomic_sub_fetch(&g->completed, 1, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&g->slots_used, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g->async_mm);
+
+	r = &g->results[g->held];
+	memcpy(g->aux_buffer, r->aux, aux_length(g));
+	g->dev->throttle_happened = *(int *) (g->aux_buffer + DEBUG_BUFFER_SIZE
+						+ THERMAL_BUFFER_SIZE);
+	if (buffer)
+		memcpy(buffer, r->output, 2 * g->noutputs);
+	if (outputData)
+		*outputData = buffer ? buffer : r->output;
+	*outputDataLength = 2 * g->noutputs;
+	*userParam = r->user_param;
+	g->last_times = r->times;
+	pthread_mutex_unlock(&g->dev->mm);
+	return r->rc;
+}
+
+// Reads the next result into buffer, or into the graph output buffer when NULL
+static mvncStatus get_result(void *graphHandle, void *buffer, unsigned int bufferLength,
+			     void **outputData, unsigned int *outputDataLength, void **userParam,
+			     double deadline)
+{
+	int rc;
+
+	struct Graph *g = (struct Graph *) graphHandle;
+	trace_lock(&mm, "global lock");
+	if (find_graph(graphHandle) || (buffer && bufferLength < 2 * g->noutputs)) {
+		pthread_mutex_unlock(&mm);
+		return MVNC_INVALID_PARAMETERS;
+	}
+	trace_context(g->dev->id, g->id);
+	if (g->completion_fd >= 0)
+		return get_completed(g, buffer, outputData, outputDataLength, userParam, deadline);
+	if (!buffer)
+		buffer = g->output_data;
 
 	while (!g->have_data) {
-		if (g->dont_block) {
+		if (g->dont_block || expired(deadline)) {
 			pthread_mutex_unlock(&mm);
 			return MVNC_NO_DATA;
 		}
 		pthread_mutex_unlock(&mm);
 		usleep(1000);
-		pthread_mutex_lock(&mm);
+		trace_lock(&mm, "global lock");
 		if (find_graph(g)) {
 			pthread_mutex_unlock(&mm);
 			return MVNC_GONE;
 		}
 	}
 
-	double timeout = time_in_seconds() + STATUS_WAIT_TIMEOUT;
-	do {
-		pthread_mutex_lock(&g->dev->mm);
+	struct Device *d = g->dev;
+	double timeout = time_in_seconds() + result_timeout(d);
+	double t, lock_wait, output_start, aux_start;
+	for (;;) {
+		t = time_in_seconds();
+		trace_lock(&d->mm, "device lock");
 		pthread_mutex_unlock(&mm);
-		if (!usblink_getdata(g->dev->usb_link, "output", g->output_data,
-				     2 * g->noutputs, 0, 0)) {
-			unsigned int length = DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE +
-			     sizeof(int) + sizeof(*g->time_taken) * g->nstages;
-
-			if (usblink_getdata(g->dev->usb_link, "auxBuffer", g->aux_buffer,
-			     length, 0, g->have_data == 2)) {
-				g->failed = 1;
-				pthread_mutex_unlock(&g->dev->mm);
-				return MVNC_ERROR;
-			}
-			unlock_own = 1;
+		output_start = time_in_seconds();
+		lock_wait = output_start - t;
+		rc = MVNC_TIMEOUT;
+		if (d->recovering)
+			timeout = output_start + result_timeout(d);
+		else if (d->lost) {
+			rc = MVNC_ERROR;
 			break;
+		} else if (!usblink_getdata(d->usb_link, "output", buffer,
+					    2 * g->noutputs, 0, 0)) {
+			aux_start = time_in_seconds();
+			if (usblink_getdata(d->usb_link, "auxBuffer", g->aux_buffer,
+					    aux_length(g), 0, g->have_data == 2))
+				rc = MVNC_ERROR;
+			else {
+				rc = *g->debug_buffer ? MVNC_MYRIAD_ERROR : MVNC_OK;
+				finish_times(g, &g->last_times, lock_wait, output_start, aux_start,
+					     time_in_seconds());
+			}
+			if (!replay_result(g, rc))
+				break;
+		} else if (output_start >= timeout) {
+			if (!replay_result(g, rc))
+				break;
+		} else
+			COUNT(g, retries, 1);
+		if (expired(deadline)) {
+			pthread_mutex_unlock(&d->mm);
+			return MVNC_NO_DATA;
 		}
-		pthread_mutex_unlock(&g->dev->mm);
+		pthread_mutex_unlock(&d->mm);
 		usleep(1000);
-		pthread_mutex_lock(&mm);
+		trace_lock(&mm, "global lock");
 		if (find_graph(g)) {
 			pthread_mutex_unlock(&mm);
 			return MVNC_GONE;
 		}
-	} while (time_in_seconds() < timeout);
+	}
 
-	g->dev->throttle_happened = *(int *) (g->aux_buffer + DEBUG_BUFFER_SIZE
-						+ THERMAL_BUFFER_SIZE);
-	*outputData = g->output_data;
+	d->throttle_happened = *(int *) (g->aux_buffer + DEBUG_BUFFER_SIZE
+					   + THERMAL_BUFFER_SIZE);
+	if (outputData)
+		*outputData = buffer;
 	*outputDataLength = 2 * g->noutputs;
 	*userParam = g->user_param[g->output_idx];
+	count_result(g, g->aux_buffer, rc);
 	g->output_idx = !g->output_idx;
 	g->have_data--;
-
-	if (unlock_own) {
-		rc = *g->debug_buffer ? MVNC_MYRIAD_ERROR : MVNC_OK;
-		if (rc)
-			g->failed = 1;
-		pthread_mutex_unlock(&g->dev->mm);
-	} else {
-		rc = MVNC_TIMEOUT;
+	__atomic_sub_fetch(&g->slots_used, 1, __ATOMIC_RELEASE);
+	if (rc && !d->recovering)
 		g->failed = 1;
-		pthread_mutex_unlock(&mm);
-	}
+	pthread_mutex_unlock(&d->mm);
+	return rc;
+}
+
+mvncStatus mvncGetResult(void *graphHandle, void **outputData,
+			 unsigned int *outputDataLength, void **userParam)
+{
+	if (!graphHandle || !outputData || !outputDataLength)
+		return MVNC_INVALID_PARAMETERS;
+
+	uint64_t start = trace_call();
+	mvncStatus rc = get_result(graphHandle, 0, 0, outputData, outputDataLength, userParam, 0);
+	trace_record(TRACE_API, "mvncGetResult", start, 0, rc);
+	return rc;
+}
+
+mvncStatus mvncGetResultToBuffer(void *graphHandle, void *buffer, unsigned int bufferLength,
+				 unsigned int *outputDataLength, void **userParam)
+{
+	if (!graphHandle || !buffer || !outputDataLength)
+		return MVNC_INVALID_PARAMETERS;
+
+	uint64_t start = trace_call();
+	mvncStatus rc = get_result(graphHandle, buffer, bufferLength, 0, outputDataLength, userParam, 0);
+	trace_record(TRACE_API, "mvncGetResultToBuffer", start, 0, rc);
+	return rc;
+}
+
+mvncStatus mvncGetResultWithDeadline(void *graphHandle, void *buffer, unsigned int bufferLength,
+				     unsigned int *outputDataLength, void **userParam, double deadline)
+{
+	if (!graphHandle || !buffer || !outputDataLength)
+		return MVNC_INVALID_PARAMETERS;
 
+	uint64_t start = trace_call();
+	mvncStatus rc = get_result(graphHandle, buffer, bufferLength, 0, outputDataLength, userParam,
+				   deadline);
+	trace_record(TRACE_API, "mvncGetResultWithDeadline", start, 0, rc);
 	return rc;
 }
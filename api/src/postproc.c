@@ -0,0 +1,233 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Post-processing of half precision results without converting them.
+// Halves are mapped to 16 bit integers with the same ordering, so that
+// searches are integer compares, eight at a time with SSE2.
+// NaNs are not expected in results and are not treated specially.
+
+#include <math.h>
+#include "mvnc.h"
+#include "fp16.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Signed integer with the same ordering as the half, sign and magnitude
+// to two's complement. Both zeros map to 0.
+static int16_t key(uint16_t h)
+{
+	return (int16_t) (h & 0x8000 ? -(h & 0x7fff) : h);
+}
+
+static float from_key(int16_t k)
+{
+	return fp16_to_float(k < 0 ? 0x8000 | -k : k);
+}
+
+#ifdef __SSE2__
+static __m128i key8(const uint16_t *p)
+{
+	__m128i h = _mm_loadu_si128((const __m128i *) p);
+	__m128i sign = _mm_srai_epi16(h, 15);
+	__m128i magnitude = _mm_and_si128(h, _mm_set1_epi16(0x7fff));
+	return _mm_sub_epi16(_mm_xor_si128(magnitude, sign), sign);
+}
+
+// Non zero when any of the eight elements at p is greater than k
+static int any_greater8(const uint16_t *p, __m128i k)
+{
+	return _mm_movemask_epi8(_mm_cmpgt_epi16(key8(p), k));
+}
+#endif
+
+static int16_t max_key(const uint16_t *h, unsigned n)
+{
+	int16_t m = -32768;
+	unsigned i = 0;
+
+#ifdef __SSE2__
+	if (n >= 8) {
+		__m128i vm = _mm_set1_epi16(-32768);
+		for (; i + 8 <= n; i += 8)
+			vm = _mm_max_epi16(vm, key8(h + i));
+		vm = _mm_max_epi16(vm, _mm_srli_si128(vm, 8));
+		vm = _mm_max_epi16(vm, _mm_srli_si128(vm, 4));
+		vm = _mm_max_epi16(vm, _mm_srli_si128(vm, 2));
+		m = (int16_t) _mm_cvtsi128_si32(vm);
+	}
+#endif
+	for (; i < n; i++)
+		if (key(h[i]) > m)
+			m = key(h[i]);
+	return m;
+}
+
+mvncStatus mvncArgMax(const void *tensor, unsigned int count, unsigned int *index, float *value)
+{
+	const uint16_t *h = (const uint16_t *) tensor;
+	unsigned i;
+	int16_t m;
+
+	if (!tensor || !count || !index)
+		return MVNC_INVALID_PARAMETERS;
+
+	// Find the maximum, then its first position
+	m = max_key(h, count);
+	for (i = 0; key(h[i]) != m; i++)
+		;
+	*index = i;
+	if (value)
+		*value = from_key(m);
+	return MVNC_OK;
+}
+
+// Min heap of the best k elements seen so far, the worst one at the root.
+// Between equal values the lower index is considered better.
+struct entry {
+	int16_t key;
+	unsigned index;
+};
+
+static int worse(const struct entry *a, const struct entry *b)
+{
+	return a->key < b->key || (a->key == b->key && a->index > b->index);
+}
+
+static void sift_down(struct entry *heap, unsigned n, unsigned i)
+{
+	for (;;) {
+		unsigned l = 2 * i + 1, r = l + 1, w = i;
+		if (l < n && worse(&heap[l], &heap[w]))
+			w = l;
+		if (r < n && worse(&heap[r], &heap[w]))
+			w = r;
+		if (w == i)
+			return;
+		struct entry t = heap[i];
+		heap[i] = heap[w];
+		heap[w] = t;
+		i = w;
+	}
+}
+
+static void offer(struct entry *heap, unsigned k, int16_t kv, unsigned index)
+{
+	if (kv > heap[0].key) {
+		heap[0].key = kv;
+		heap[0].index = index;
+		sift_down(heap, k, 0);
+	}
+}
+
+mvncStatus mvncTopK(const void *tensor, unsigned int count, unsigned int k,
+		    unsigned int *indices, float *values)
+{
+	const uint16_t *h = (const uint16_t *) tensor;
+	struct entry heap[MVNC_MAX_TOP_K];
+	unsigned i, j, n;
+
+	if (!tensor || !indices || !k || k > count || k > MVNC_MAX_TOP_K)
+		return MVNC_INVALID_PARAMETERS;
+
+	for (i = 0; i < k; i++) {
+		heap[i].key = key(h[i]);
+		heap[i].index = i;
+	}
+	for (j = k / 2; j-- > 0;)
+		sift_down(heap, k, j);
+
+	// Most elements are below the current k-th best,
+	// skip them eight at a time
+#ifdef __SSE2__
+	for (; i + 8 <= count; i += 8)
+		if (any_greater8(h + i, _mm_set1_epi16(heap[0].key)))
+			for (j = i; j < i + 8; j++)
+				offer(heap, k, key(h[j]), j);
+#endif
+	for (; i < count; i++)
+		offer(heap, k, key(h[i]), i);
+
+	// Pop the worst first to get them sorted from the best
+	for (n = k; n > 0; n--) {
+		indices[n - 1] = heap[0].index;
+		if (values)
+			values[n - 1] = from_key(heap[0].key);
+		heap[0] = heap[n - 1];
+		sift_down(heap, n - 1, 0);
+	}
+	return MVNC_OK;
+}
+
+mvncStatus mvncSoftmax(const void *tensor, unsigned int count, float *probabilities)
+{
+	const uint16_t *h = (const uint16_t *) tensor;
+	float m, sum = 0;
+	unsigned i;
+
+	if (!tensor || !count || !probabilities)
+		return MVNC_INVALID_PARAMETERS;
+
+	// The maximum is found on the halves, subtracting it keeps exp() finite
+	m = from_key(max_key(h, count));
+	fp16_half_to_float(probabilities, h, count);
+	for (i = 0; i < count; i++) {
+		probabilities[i] = expf(probabilities[i] - m);
+		sum += probabilities[i];
+	}
+	sum = 1 / sum;
+	for (i = 0; i < count; i++)
+		probabilities[i] *= sum;
+	return MVNC_OK;
+}
+
+mvncStatus mvncThreshold(const void *tensor, unsigned int count, float threshold,
+			 unsigned int *indices, unsigned int maxIndices, unsigned int *found)
+{
+	const uint16_t *h = (const uint16_t *) tensor;
+	unsigned i = 0, n = 0;
+	uint16_t t;
+	int16_t kt;
+
+	if (!tensor || !indices || !found)
+		return MVNC_INVALID_PARAMETERS;
+
+	// Smallest half not below the threshold, so that the test
+	// value >= threshold becomes key(value) >= kt
+	t = fp16_from_float(threshold);
+	if (fp16_to_float(t) < threshold)
+		t = t & 0x8000 ? t - 1 : t + 1;
+	kt = key(t);
+
+#ifdef __SSE2__
+	__m128i vt = _mm_set1_epi16(kt - 1);
+	for (; i + 8 <= count && n < maxIndices; i += 8) {
+		unsigned j;
+		if (!any_greater8(h + i, vt))
+			continue;
+		for (j = i; j < i + 8 && n < maxIndices; j++)
+			if (key(h[j]) >= kt)
+				indices[n++] = j;
+	}
+#endif
+	for (; i < count && n < maxIndices; i++)
+		if (key(h[i]) >= kt)
+			indices[n++] = i;
+	*found = n;
+	return MVNC_OK;
+}
@@ -0,0 +1,253 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Image to input tensor conversion: bilinear resize, channel reorder,
+// mean and scale, and conversion to half precision in a single pass.
+// The tensor is produced in columns of chunks small enough to stay in the
+// L1 cache: the horizontal taps of a column are computed once, each source
+// row it needs is resized horizontally once into a small row cache, and
+// the vertical blend with the normalisation runs on contiguous floats,
+// with SSE2 or NEON where available.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "mvnc.h"
+#include "fp16.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define CHUNK_PIXELS	128
+#define MAX_CHANNELS	3
+
+// Interpolation coefficients for one output coordinate
+struct tap {
+	unsigned i0, i1;	// Source indexes of the two neighbours
+	float w;		// Weight of the second one
+};
+
+// Bilinear with pixel centres aligned, as done by most image libraries
+static void compute_tap(unsigned dst, float ratio, unsigned src_size, struct tap *t)
+{
+	float s = (dst + 0.5f) * ratio - 0.5f;
+
+	if (s < 0)
+		s = 0;
+	t->i0 = (unsigned) s;
+	if (t->i0 >= src_size - 1) {
+		t->i0 = t->i1 = src_size - 1;
+		t->w = 0;
+	} else {
+		t->i1 = t->i0 + 1;
+		t->w = s - t->i0;
+	}
+}
+
+#if defined(__SSE2__)
+// The first 4 bytes at p as floats
+static __m128 load_pixel(const unsigned char *p)
+{
+	__m128i zero = _mm_setzero_si128();
+	int32_t u;
+
+	memcpy(&u, p, sizeof(u));
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u), zero),
+						  zero));
+}
+#elif defined(__ARM_NEON)
+// The bytes at p picked by idx as floats
+static float32x4_t load_pixel(const unsigned char *p, uint8x8_t idx)
+{
+	uint32_t u;
+
+	memcpy(&u, p, sizeof(u));
+	return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(
+		vtbl1_u8(vreinterpret_u8_u32(vdup_n_u32(u)), idx)))));
+}
+#endif
+
+// Horizontal pass of one source row over n output pixels, whose taps are
+// byte offsets in the row, in the output channel order. Colour pixels are
+// interpolated 4 bytes at a time where they can be read without going past
+// row_bytes, writing one float past the pixel, so dst needs room for one
+// more. Taps and order are copied to locals, as the stores could alias them.
+static void resize_row(const unsigned char *row, unsigned row_bytes, const struct tap *tx,
+		       unsigned n, const unsigned *order, unsigned out_channels, float *dst)
+{
+	unsigned i = 0, k0 = order[0], k1 = order[1], k2 = order[2];
+
+	if (out_channels == 1) {
+		for (; i < n; i++) {
+			const unsigned char *p0 = row + tx[i].i0, *p1 = row + tx[i].i1;
+			float w = tx[i].w;
+			dst[i] = p0[k0] + (p1[k0] - p0[k0]) * w;
+		}
+		return;
+	}
+#if defined(__SSE2__)
+	// Only RGB and BGR to RGB, as SSE2 has no variable shuffle
+	if (k1 == 1 && ((k0 == 0 && k2 == 2) || (k0 == 2 && k2 == 0))) {
+		int reverse = k0 == 2;
+		for (; i < n && tx[i].i1 + 4 <= row_bytes; i++, dst += 3) {
+			__m128 a = load_pixel(row + tx[i].i0), b = load_pixel(row + tx[i].i1);
+			__m128 v = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(tx[i].w)));
+			if (reverse)
+				v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 1, 2));
+			_mm_storeu_ps(dst, v);
+		}
+	}
+#elif defined(__ARM_NEON)
+	const uint8_t pick[8] = { k0, k1, k2, 3, 4, 5, 6, 7 };
+	uint8x8_t idx = vld1_u8(pick);
+	for (; i < n && tx[i].i1 + 4 <= row_bytes; i++, dst += 3) {
+		float32x4_t a = load_pixel(row + tx[i].i0, idx), b = load_pixel(row + tx[i].i1, idx);
+		vst1q_f32(dst, vaddq_f32(a, vmulq_f32(vsubq_f32(b, a), vdupq_n_f32(tx[i].w))));
+	}
+#endif
+	for (; i < n; i++, dst += 3) {
+		const unsigned char *p0 = row + tx[i].i0, *p1 = row + tx[i].i1;
+		float w = tx[i].w;
+		float a0 = p0[k0], a1 = p0[k1], a2 = p0[k2];
+		float b0 = p1[k0], b1 = p1[k1], b2 = p1[k2];
+		dst[0] = a0 + (b0 - a0) * w;
+		dst[1] = a1 + (b1 - a1) * w;
+		dst[2] = a2 + (b2 - a2) * w;
+	}
+}
+
+// Vertical pass and normalisation: (top + (bottom - top) * w - mean) * scale
+static void blend_rows(float *dst, const float *top, const float *bottom, float w,
+		       const float *mean, const float *scale, unsigned n)
+{
+	unsigned i = 0;
+
+#if defined(__SSE2__)
+	__m128 vw = _mm_set1_ps(w);
+	for (; i + 4 <= n; i += 4) {
+		__m128 t = _mm_loadu_ps(top + i);
+		__m128 v = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bottom + i), t), vw));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_sub_ps(v, _mm_loadu_ps(mean + i)),
+						  _mm_loadu_ps(scale + i)));
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t vw = vdupq_n_f32(w);
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t t = vld1q_f32(top + i);
+		float32x4_t v = vaddq_f32(t, vmulq_f32(vsubq_f32(vld1q_f32(bottom + i), t), vw));
+		vst1q_f32(dst + i, vmulq_f32(vsubq_f32(v, vld1q_f32(mean + i)), vld1q_f32(scale + i)));
+	}
+#endif
+	for (; i < n; i++) {
+		float v = top[i] + (bottom[i] - top[i]) * w;
+		dst[i] = (v - mean[i]) * scale[i];
+	}
+}
+
+mvncStatus mvncPreprocessImage(const unsigned char *image, unsigned int width,
+			       unsigned int height, unsigned int stride,
+			       unsigned int channels, void *tensor,
+			       unsigned int tensorWidth, unsigned int tensorHeight,
+			       const mvncPreprocessParams *params)
+{
+	static const mvncPreprocessParams identity = {
+		{0, 1, 2}, {0, 0, 0}, {1, 1, 1}
+	};
+	float buf[CHUNK_PIXELS * MAX_CHANNELS], row_buf[2][CHUNK_PIXELS * MAX_CHANNELS + 1];
+	float mean[CHUNK_PIXELS * MAX_CHANNELS], scale[CHUNK_PIXELS * MAX_CHANNELS];
+	struct tap tx[CHUNK_PIXELS];
+	unsigned order[MAX_CHANNELS] = { 0 }, cached[2];
+	unsigned out_channels, x, y, c, i, n;
+	float xratio, yratio, *rows[2] = { row_buf[0], row_buf[1] }, *top, *bottom;
+	uint16_t *out = (uint16_t *) tensor;
+
+	if (!image || !tensor || !width || !height || !tensorWidth || !tensorHeight ||
+	    (channels != 1 && channels != 3 && channels != 4))
+		return MVNC_INVALID_PARAMETERS;
+
+	if (!params)
+		params = &identity;
+	if (!stride)
+		stride = width * channels;
+	if (stride < width * channels)
+		return MVNC_INVALID_PARAMETERS;
+
+	// Alpha is dropped and grayscale stays single channel
+	out_channels = channels == 1 ? 1 : 3;
+	for (c = 0; c < out_channels; c++) {
+		order[c] = out_channels == 1 ? 0 : params->channelOrder[c];
+		if (order[c] >= channels)
+			return MVNC_INVALID_PARAMETERS;
+	}
+
+	// Per channel constants repeated over a whole chunk, so that the
+	// normalisation below is a plain loop over contiguous floats
+	for (i = 0; i < CHUNK_PIXELS * out_channels; i++) {
+		mean[i] = params->mean[i % out_channels];
+		scale[i] = params->scale[i % out_channels];
+	}
+
+	xratio = (float) width / tensorWidth;
+	yratio = (float) height / tensorHeight;
+	for (x = 0; x < tensorWidth; x += n) {
+		n = tensorWidth - x < CHUNK_PIXELS ? tensorWidth - x : CHUNK_PIXELS;
+		for (i = 0; i < n; i++) {
+			compute_tap(x + i, xratio, width, &tx[i]);
+			tx[i].i0 *= channels;
+			tx[i].i1 *= channels;
+		}
+
+		// Source rows resized in rows[0] and rows[1], none yet
+		cached[0] = cached[1] = height;
+		for (y = 0; y < tensorHeight; y++) {
+			struct tap ty;
+			compute_tap(y, yratio, height, &ty);
+
+			// Going down, the top row is usually the bottom one of the
+			// previous output row
+			if (cached[0] != ty.i0 && cached[1] == ty.i0) {
+				top = rows[0];
+				rows[0] = rows[1];
+				rows[1] = top;
+				cached[1] = cached[0];
+				cached[0] = ty.i0;
+			}
+			if (cached[0] != ty.i0) {
+				resize_row(image + (size_t) ty.i0 * stride, width * channels, tx, n,
+					   order, out_channels, rows[0]);
+				cached[0] = ty.i0;
+			}
+			top = bottom = rows[0];
+			if (ty.w) {
+				if (cached[1] != ty.i1) {
+					resize_row(image + (size_t) ty.i1 * stride, width * channels,
+						   tx, n, order, out_channels, rows[1]);
+					cached[1] = ty.i1;
+				}
+				bottom = rows[1];
+			}
+
+			blend_rows(buf, top, bottom, ty.w, mean, scale, n * out_channels);
+			fp16_float_to_half(out + ((size_t) y * tensorWidth + x) * out_channels, buf,
+					   n * out_channels);
+		}
+	}
+	return MVNC_OK;
+}
@@ -0,0 +1,152 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Latencies are counted in log-linear buckets of microseconds: one per
+// microsecond up to 16, then 8 per power of 2, so that each bucket is
+// within 12.5% of its value, up to 16 s in the last one
+
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#define LINEAR_BUCKETS	16
+#define SUB_BUCKETS	8
+#define SUB_BITS	3
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned bucket(uint64_t us)
+{
+	unsigned e, i;
+
+	if (us < LINEAR_BUCKETS)
+		return us;
+	e = 63 - __builtin_clzll(us);
+	i = LINEAR_BUCKETS + (e - 4) * SUB_BUCKETS + ((us >> (e - SUB_BITS)) & (SUB_BUCKETS - 1));
+	return i < MVNC_LATENCY_BUCKETS ? i : MVNC_LATENCY_BUCKETS - 1;
+}
+
+// Lower bound of bucket i in us, the upper one being that of i + 1
+static double bucket_start(unsigned i)
+{
+	unsigned e;
+
+	if (i < LINEAR_BUCKETS)
+		return i;
+	e = 4 + (i - LINEAR_BUCKETS) / SUB_BUCKETS;
+	return (double) (SUB_BUCKETS + (i - LINEAR_BUCKETS) % SUB_BUCKETS) * (1ull << (e - SUB_BITS));
+}
+
+void stats_latency(struct stats *s, double seconds)
+{
+	stats_add(&s->latency[bucket(seconds > 0 ? seconds * 1e6 : 0)], 1);
+}
+
+void stats_reset(struct stats *s)
+{
+	uint64_t *p;
+
+	for (p = &s->inferences; p < s->latency + MVNC_LATENCY_BUCKETS; p++)
+		__atomic_store_n(p, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->start, now_ns(), __ATOMIC_RELAXED);
+}
+
+void stats_read(struct stats *s, mvncStats *out)
+{
+	unsigned i;
+
+	out->seconds = (now_ns() - __atomic_load_n(&s->start, __ATOMIC_RELAXED)) * 1e-9;
+	out->inferences = __atomic_load_n(&s->inferences, __ATOMIC_RELAXED);
+	out->bytesIn = __atomic_load_n(&s->bytes_in, __ATOMIC_RELAXED);
+	out->bytesOut = __atomic_load_n(&s->bytes_out, __ATOMIC_RELAXED);
+	out->deviceMicroseconds = __atomic_load_n(&s->device_us, __ATOMIC_RELAXED);
+	out->busy = __atomic_load_n(&s->busy, __ATOMIC_RELAXED);
+	out->timeouts = __atomic_load_n(&s->timeouts, __ATOMIC_RELAXED);
+	out->myriadErrors = __atomic_load_n(&s->myriad_errors, __ATOMIC_RELAXED);
+	out->errors = __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+	out->retries = __atomic_load_n(&s->retries, __ATOMIC_RELAXED);
+	out->throttled = __atomic_load_n(&s->throttled, __ATOMIC_RELAXED);
+	out->resets = __atomic_load_n(&s->resets, __ATOMIC_RELAXED);
+	out->replays = __atomic_load_n(&s->replays, __ATOMIC_RELAXED);
+	out->expired = __atomic_load_n(&s->expired, __ATOMIC_RELAXED);
+	out->cancelled = __atomic_load_n(&s->cancelled, __ATOMIC_RELAXED);
+	out->rejected = __atomic_load_n(&s->rejected, __ATOMIC_RELAXED);
+	out->dropped = __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+	out->blocked = __atomic_load_n(&s->blocked, __ATOMIC_RELAXED);
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+		out->latency[i] = __atomic_load_n(&s->latency[i], __ATOMIC_RELAXED);
+}
+
+void stage_stats_add(struct stage_stats *s, float ms)
+{
+	if (!s->count || ms < s->min)
+		s->min = ms;
+	if (!s->count || ms > s->max)
+		s->max = ms;
+	s->count++;
+	s->sum += ms;
+	s->time[bucket(ms > 0 ? ms * 1e3 : 0)]++;
+}
+
+void stage_stats_read(const struct stage_stats *s, mvncStageStats *out)
+{
+	out->count = s->count;
+	out->min = s->min;
+	out->max = s->max;
+	out->mean = s->count ? s->sum / s->count : 0;
+	memcpy(out->time, s->time, sizeof(out->time));
+}
+
+mvncStatus mvncHistogramPercentile(const unsigned long long *histogram, float percentile, float *ms)
+{
+	unsigned long long total = 0, rank, n = 0;
+	unsigned i;
+	double r;
+
+	if (!histogram || !ms || percentile < 0 || percentile > 100)
+		return MVNC_INVALID_PARAMETERS;
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+		total += histogram[i];
+	if (!total)
+		return MVNC_NO_DATA;
+
+	// Middle of the bucket holding the sample of that rank
+	r = percentile / 100 * total;
+	rank = (unsigned long long) r;
+	if (rank < r || !rank)
+		rank++;
+	for (i = 0; i < MVNC_LATENCY_BUCKETS - 1; i++) {
+		n += histogram[i];
+		if (n >= rank)
+			break;
+	}
+	*ms = (bucket_start(i) + bucket_start(i + 1)) / 2 * 1e-3;
+	return MVNC_OK;
+}
+
+mvncStatus mvncStatsPercentile(const mvncStats *stats, float percentile, float *ms)
+{
+	if (!stats)
+		return MVNC_INVALID_PARAMETERS;
+	return mvncHistogramPercentile(stats->latency, percentile, ms);
+}
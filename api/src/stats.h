@@ -0,0 +1,60 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Counters of the devices and graphs, updated with relaxed atomic adds so
+// that they can be read and reset at any time without locks
+
+#ifndef __STATS_H_INCLUDED__
+#define __STATS_H_INCLUDED__
+
+#include <stdint.h>
+#include "mvnc.h"
+
+struct stats {
+	uint64_t start;		// ns, CLOCK_MONOTONIC, of the last reset
+	uint64_t inferences;
+	uint64_t bytes_in, bytes_out;
+	uint64_t device_us;
+	uint64_t busy, timeouts, myriad_errors, errors;
+	uint64_t retries, throttled;
+	uint64_t resets, replays;
+	uint64_t expired, cancelled;
+	uint64_t rejected, dropped, blocked;
+	uint64_t latency[MVNC_LATENCY_BUCKETS];
+};
+
+static inline void stats_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+void stats_latency(struct stats *s, double seconds);
+void stats_reset(struct stats *s);
+void stats_read(struct stats *s, mvncStats *out);
+
+// Times of a stage, updated with the device lock held
+struct stage_stats {
+	uint64_t count;
+	float min, max;
+	double sum;		// ms
+	uint64_t time[MVNC_LATENCY_BUCKETS];
+};
+
+void stage_stats_add(struct stage_stats *s, float ms);
+void stage_stats_read(const struct stage_stats *s, mvncStageStats *out);
+
+#endif
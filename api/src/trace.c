@@ -0,0 +1,216 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Each thread writes its events into its own ring, published by a release
+// store of the count of events written. The dump reads the rings without
+// stopping the writers and drops the events that may have been overwritten
+// while it was copying them. The rings of the threads that exit are reused
+// by new threads.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "mvnc.h"
+#include "trace.h"
+
+#define RING_EVENTS	8192	// Per thread, a power of 2
+#define MAX_NAMES	256	// Device names kept for the dump
+
+struct trace_event {
+	uint64_t start, end;	// ns, CLOCK_MONOTONIC
+	const char *name;
+	uint32_t arg;
+	int32_t rc;
+	int32_t tid;
+	uint16_t category, device, graph;
+};
+
+struct trace_ring {
+	struct trace_event events[RING_EVENTS];
+	uint64_t written;
+	int tid;		// Of the thread using it
+	int in_use;
+	struct trace_ring *next;
+};
+
+int trace_enabled;
+
+static __thread struct trace_ring *ring;
+static __thread uint16_t context_device, context_graph;
+static struct trace_ring *rings;
+static struct {
+	int device;
+	char name[MVNC_MAX_NAME_SIZE];
+} device_names[MAX_NAMES];
+static pthread_mutex_t trace_mm = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static char *exit_dump;
+
+static const char *category_names[TRACE_CATEGORIES] = {
+	"api", "usb", "lock", "boot", "upload"
+};
+
+uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void release_ring(void *r)
+{
+	__atomic_store_n(&((struct trace_ring *) r)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_key(void)
+{
+	pthread_key_create(&ring_key, release_ring);
+}
+
+static struct trace_ring *get_ring(void)
+{
+	struct trace_ring *r;
+
+	pthread_once(&key_once, create_key);
+	pthread_mutex_lock(&trace_mm);
+	for (r = rings; r; r = r->next)
+		if (!r->in_use)
+			break;
+	if (!r) {
+		r = calloc(1, sizeof(*r));
+		if (!r) {
+			pthread_mutex_unlock(&trace_mm);
+			return 0;
+		}
+		r->next = rings;
+		rings = r;
+	}
+	r->in_use = 1;
+	r->tid = syscall(SYS_gettid);
+	pthread_mutex_unlock(&trace_mm);
+	pthread_setspecific(ring_key, r);
+	return r;
+}
+
+void trace_record(enum trace_category category, const char *name, uint64_t start,
+		  unsigned arg, int rc)
+{
+	struct trace_event *e;
+
+	if (!start || (!ring && !(ring = get_ring())))
+		return;
+	e = &ring->events[ring->written % RING_EVENTS];
+	e->start = start;
+	e->end = trace_now();
+	e->name = name;
+	e->arg = arg;
+	e->rc = rc;
+	e->category = category;
+	e->device = context_device;
+	e->graph = context_graph;
+	e->tid = ring->tid;
+	__atomic_store_n(&ring->written, ring->written + 1, __ATOMIC_RELEASE);
+}
+
+void trace_context(int device, int graph)
+{
+	context_device = device;
+	context_graph = graph;
+}
+
+void trace_device_name(int device, const char *name)
+{
+	pthread_mutex_lock(&trace_mm);
+	device_names[device % MAX_NAMES].device = device;
+	strncpy(device_names[device % MAX_NAMES].name, name, MVNC_MAX_NAME_SIZE - 1);
+	pthread_mutex_unlock(&trace_mm);
+}
+
+static void write_event(FILE *fp, const struct trace_event *e)
+{
+	fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+		"\"pid\":%u,\"tid\":%d,\"args\":{\"graph\":%u,\"arg\":%u,\"rc\":%d}}",
+		e->name, category_names[e->category], e->start * 1e-3,
+		(e->end - e->start) * 1e-3, e->device, e->tid, e->graph, e->arg, e->rc);
+}
+
+// Chrome trace format, with a process per device and the host as process 0
+mvncStatus mvncDumpTrace(const char *path)
+{
+	static struct trace_event copy[RING_EVENTS];
+	struct trace_ring *r;
+	uint64_t written, after, from, i;
+	FILE *fp;
+	int d;
+
+	if (!path)
+		return MVNC_INVALID_PARAMETERS;
+	fp = fopen(path, "w");
+	if (!fp)
+		return MVNC_ERROR;
+
+	// The mutex only keeps the list and the copy buffer stable
+	pthread_mutex_lock(&trace_mm);
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	fprintf(fp, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}}");
+	for (d = 0; d < MAX_NAMES; d++)
+		if (device_names[d].device)
+			fprintf(fp, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"args\":{\"name\":\"%s\"}}", device_names[d].device,
+				device_names[d].name);
+	for (r = rings; r; r = r->next) {
+		written = __atomic_load_n(&r->written, __ATOMIC_ACQUIRE);
+		from = written > RING_EVENTS ? written - RING_EVENTS : 0;
+		for (i = from; i < written; i++)
+			copy[i % RING_EVENTS] = r->events[i % RING_EVENTS];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&r->written, __ATOMIC_RELAXED);
+		// The writer may be overwriting the event after - RING_EVENTS
+		if (after >= RING_EVENTS && after - RING_EVENTS + 1 > from)
+			from = after - RING_EVENTS + 1;
+		for (i = from; i < written; i++)
+			write_event(fp, &copy[i % RING_EVENTS]);
+	}
+	fprintf(fp, "\n]}\n");
+	pthread_mutex_unlock(&trace_mm);
+	return fclose(fp) ? MVNC_ERROR : MVNC_OK;
+}
+
+// MVNC_TRACE=file enables tracing from the start and dumps it to file at exit
+void __attribute__ ((constructor)) trace_library_load()
+{
+	const char *path = getenv("MVNC_TRACE");
+
+	if (path && *path) {
+		exit_dump = strdup(path);
+		trace_enabled = 1;
+	}
+}
+
+void __attribute__ ((destructor)) trace_library_unload()
+{
+	if (exit_dump) {
+		mvncDumpTrace(exit_dump);
+		free(exit_dump);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Trace of the library activity in per-thread rings, enabled by MVNC_TRACE.
+// Recording an event is a few stores into the ring of the calling thread,
+// without locks; when tracing is disabled every call returns after a load.
+// Events are attributed to the device and graph set by trace_context() on
+// the calling thread.
+
+#ifndef __TRACE_H_INCLUDED__
+#define __TRACE_H_INCLUDED__
+
+#include <stdint.h>
+#include <pthread.h>
+
+enum trace_category {
+	TRACE_API,		// Call of the public API
+	TRACE_USB,		// Transfer on the link, arg is the bytes
+	TRACE_LOCK,		// Wait for a contended lock
+	TRACE_BOOT,		// Firmware boot, arg is the bytes
+	TRACE_UPLOAD,		// Graph upload, arg is the bytes
+	TRACE_CATEGORIES
+};
+
+extern int trace_enabled __attribute__ ((visibility("hidden")));
+
+uint64_t trace_now(void);
+void trace_record(enum trace_category category, const char *name, uint64_t start,
+		  unsigned arg, int rc);
+void trace_context(int device, int graph);
+void trace_device_name(int device, const char *name);
+
+// Start time of an event, 0 when tracing is disabled
+static inline uint64_t trace_start(void)
+{
+	return __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED) ? trace_now() : 0;
+}
+
+// Start time of an API call, which sets its own context
+static inline uint64_t trace_call(void)
+{
+	uint64_t start = trace_start();
+
+	if (start)
+		trace_context(0, 0);
+	return start;
+}
+
+// name must be a literal, as for all the events
+static inline void trace_lock(pthread_mutex_t *m, const char *name)
+{
+	uint64_t start;
+
+	if (!pthread_mutex_trylock(m))
+		return;
+	start = trace_start();
+	pthread_mutex_lock(m);
+	trace_record(TRACE_LOCK, name, start, 0, 0);
+}
+
+#endif
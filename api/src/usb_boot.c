@@ -29,8 +29,10 @@
 #include <getopt.h>
 #include <errno.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <libusb.h>
 #include "usb_boot.h"
+#include "usb_link_sim.h"
 #include "mvnc.h"
 #include "common.h"
 
@@ -42,6 +44,9 @@ static unsigned int bulk_chunk_len = DEFAULT_CHUNK_SZ;
 static int write_timeout = DEFAULT_WRITE_TIMEOUT;
 static int connect_timeout = DEFAULT_CONNECT_TIMEOUT;
 static int initialized;
+// Protects the device list kept between calls, as the recovery of a device
+// boots it without the global lock of the library
+static pthread_mutex_t find_mm = PTHREAD_MUTEX_INITIALIZER;
 
 void __attribute__ ((constructor)) usb_library_load()
 {
@@ -94,10 +99,9 @@ static const char *gen_addr(libusb_device *dev)
 	return buff;
 }
 
-// if device is NULL, return device address for device at index idx
-// if device is not NULL, search by name and return device struct
-int usb_find_device(unsigned idx, char *addr, unsigned addr_size, void **device,
-		    int vid, int pid)
+// found returns the number of matching devices when idx is past them
+static int find_usb_device(unsigned idx, char *addr, unsigned addr_size, void **device,
+			   int vid, int pid, unsigned *found)
 {
 	static libusb_device **devs;
 	libusb_device *dev;
@@ -164,9 +168,29 @@ int usb_find_device(unsigned idx, char *addr, unsigned addr_size, void **device,
 	}
 	libusb_free_device_list(devs, 1);
 	devs = 0;
+	*found = count;
 	return MVNC_DEVICE_NOT_FOUND;
 }
 
+// if device is NULL, return device address for device at index idx
+// if device is not NULL, search by name and return device struct
+// The software devices are listed after the USB ones, booted ones only
+// when looking for a vid/pid
+int usb_find_device(unsigned idx, char *addr, unsigned addr_size, void **device,
+		    int vid, int pid)
+{
+	unsigned found = 0;
+	int rc;
+
+	pthread_mutex_lock(&find_mm);
+	rc = find_usb_device(idx, addr, addr_size, device, vid, pid, &found);
+	pthread_mutex_unlock(&find_mm);
+	if (rc && !device && idx >= found &&
+	    !sim_find_device(idx - found, addr, addr_size, vid || pid))
+		return 0;
+	return rc;
+}
+
 static libusb_device_handle *usb_open_device(libusb_device *dev, uint8_t *endpoint,
 					     char *err_string_buff, unsigned buff_size)
 {
@@ -323,6 +347,8 @@ int usb_boot(const char *addr, const void *mvcmd, unsigned size)
 	libusb_device_handle *h;
 	uint8_t endpoint;
 
+	if (sim_is_device(addr))
+		return sim_boot(addr);
 	rc = wait_findopen(addr, connect_timeout, &dev, &h, &endpoint);
 	if (rc)
 		return rc;
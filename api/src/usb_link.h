@@ -17,6 +17,8 @@
 
 #include "USBLinkDefines.h"
 
+void usblink_header(usbHeader_t *header, hostcommands_t cmd, const char *name,
+		    unsigned int length, unsigned int offset, int hostready);
 int usblink_sendcommand(void *f, hostcommands_t command);
 int usblink_resetmyriad(void *f);
 int usblink_getmyriadstatus(void *f, myriadStatus_t *myriadState);
@@ -25,3 +27,5 @@ void usblink_close(void *f);
 int usblink_setdata(void *f, const char *name, const void *data, unsigned int length, int hostready);
 int usblink_getdata(void *f, const char *name, void *data, unsigned int length, unsigned int offset, int hostready);
 void usblink_resetall();
+void *usblink_mem_alloc(void *f, unsigned int length);
+void usblink_mem_free(void *f, void *data, unsigned int length);
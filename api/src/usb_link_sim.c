@@ -0,0 +1,368 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Software devices emulating the usblink protocol of the sticks in the host.
+// They boot without firmware, accept any graph file and complete each
+// inference after a fixed latency, returning a constant result. Their
+// temperature follows their load and they throttle with the configured
+// limits and backoff times, as the firmware does. Configured with:
+//   MVNC_SIM_DEVICES     number of devices, at most MAX_SIM_DEVICES
+//   MVNC_SIM_LATENCY_MS  inference time, 10 ms by default
+//   MVNC_SIM_MBPS        link speed in MB/s, unlimited by default
+//   MVNC_SIM_TEMP_RISE   temperature rise at full load over 40 C, 40 C by default,
+//                        or a comma separated list, one per device, the last repeated
+//   MVNC_SIM_TIME_CONSTANT  thermal time constant in seconds, 20 s by default
+//   MVNC_SIM_HANG_AFTER  inferences after which a device stops responding until it is
+//                        reset, once, 0 for never by default, negative for a device that
+//                        cannot boot again; a comma separated list as MVNC_SIM_TEMP_RISE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "mvnc.h"
+#include "usb_link_sim.h"
+
+#define MAX_SIM_DEVICES		16
+#define SIM_PREFIX		"sim-"
+#define AMBIENT_TEMPERATURE	40.0
+
+// Layout of the aux buffer, see mvnc_api.c
+#define DEBUG_BUFFER_SIZE	120
+#define THERMAL_BUFFER_SIZE	100
+
+struct SimDevice {
+	char name[MVNC_MAX_NAME_SIZE];
+	int booted, opened;
+	unsigned output_length;
+	unsigned nstages;
+	int queued;		// Inputs received and not returned
+	int running;		// Inference in progress until t_done
+	int done;		// Result ready
+	int output_read;
+	double t_done;
+	double latency;		// Of the current inference, with throttling
+	float temperature;
+	double t_temperature;
+	double temp_rise;
+	int throttle;		// 0 none, 1 lower limit reached, 2 upper
+	float temp_lim_lower, temp_lim_upper;
+	int backoff_time_high, backoff_time_critical;
+	int hang_after;		// MVNC_SIM_HANG_AFTER, 0 when done
+	unsigned started;	// Inferences since the boot
+	int hung, gone;
+	pthread_mutex_t mm;
+};
+
+static struct SimDevice sim_devices[MAX_SIM_DEVICES];
+static int sim_count;
+static double sim_latency, sim_mbps, sim_time_constant;
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double env(const char *name, double def)
+{
+	const char *s = getenv(name);
+	return s && *s ? atof(s) : def;
+}
+
+// The next value of a comma separated list, or the last one when it ends
+static double next_value(const char **list, double last)
+{
+	char *end;
+
+	if (*list && **list) {
+		last = strtod(*list, &end);
+		*list = *end == ',' ? end + 1 : 0;
+	}
+	return last;
+}
+
+static void sim_init()
+{
+	const char *rise = getenv("MVNC_SIM_TEMP_RISE"), *hang = getenv("MVNC_SIM_HANG_AFTER");
+	double temp_rise = 40, hang_after = 0;
+	int i;
+
+	sim_count = (int) env("MVNC_SIM_DEVICES", 0);
+	if (sim_count < 0)
+		sim_count = 0;
+	if (sim_count > MAX_SIM_DEVICES)
+		sim_count = MAX_SIM_DEVICES;
+	sim_latency = env("MVNC_SIM_LATENCY_MS", 10) * 1e-3;
+	sim_mbps = env("MVNC_SIM_MBPS", 0);
+	sim_time_constant = env("MVNC_SIM_TIME_CONSTANT", 20);
+	if (sim_time_constant <= 0)
+		sim_time_constant = 20;
+	for (i = 0; i < sim_count; i++) {
+		struct SimDevice *s = &sim_devices[i];
+		snprintf(s->name, sizeof(s->name), SIM_PREFIX "%d", i);
+		s->temperature = AMBIENT_TEMPERATURE;
+		temp_rise = next_value(&rise, temp_rise);
+		hang_after = next_value(&hang, hang_after);
+		s->temp_rise = temp_rise;
+		s->hang_after = (int) hang_after;
+		s->t_temperature = now();
+		s->temp_lim_lower = 85;
+		s->temp_lim_upper = 95;
+		pthread_mutex_init(&s->mm, 0);
+	}
+}
+
+static struct SimDevice *find(const char *addr)
+{
+	int i;
+
+	pthread_once(&sim_once, sim_init);
+	for (i = 0; i < sim_count; i++)
+		if (!strcmp(sim_devices[i].name, addr))
+			return &sim_devices[i];
+	return 0;
+}
+
+// Brings the temperature to time t, the device having been running or not since the last update
+static void update_temperature(struct SimDevice *s, double t)
+{
+	double target = AMBIENT_TEMPERATURE + (s->running ? s->temp_rise : 0);
+
+	if (t > s->t_temperature) {
+		s->temperature += (target - s->temperature) *
+			(1 - exp(-(t - s->t_temperature) / sim_time_constant));
+		s->t_temperature = t;
+	}
+}
+
+static void update(struct SimDevice *s)
+{
+	double t = now();
+
+	if (s->running && t >= s->t_done) {
+		update_temperature(s, s->t_done);
+		s->running = 0;
+		s->done = 1;
+		s->output_read = 0;
+	}
+	update_temperature(s, t);
+}
+
+static void start(struct SimDevice *s)
+{
+	s->throttle = s->temperature >= s->temp_lim_upper ? 2 :
+		      s->temperature >= s->temp_lim_lower ? 1 : 0;
+	s->latency = sim_latency;
+	if (s->throttle == 1)
+		s->latency += s->backoff_time_high * 1e-3;
+	else if (s->throttle == 2)
+		s->latency += s->backoff_time_critical * 1e-3;
+	s->running = 1;
+	s->t_done = now() + s->latency;
+	if (s->hang_after && ++s->started == abs(s->hang_after))
+		s->hung = 1;
+	if (s->hung)
+		s->t_done = HUGE_VAL;
+}
+
+static void transfer(unsigned int length)
+{
+	if (sim_mbps > 0)
+		usleep(length / (sim_mbps * 1048576.0) * 1e6);
+}
+
+int sim_find_device(unsigned idx, char *addr, unsigned addrsize, int booted_only)
+{
+	unsigned count = 0;
+	int i;
+
+	pthread_once(&sim_once, sim_init);
+	for (i = 0; i < sim_count; i++) {
+		struct SimDevice *s = &sim_devices[i];
+		if (booted_only && (!s->booted || s->opened))
+			continue;
+		if (count++ == idx) {
+			strncpy(addr, s->name, addrsize);
+			return 0;
+		}
+	}
+	return MVNC_DEVICE_NOT_FOUND;
+}
+
+int sim_is_device(const char *addr)
+{
+	return !strncmp(addr, SIM_PREFIX, strlen(SIM_PREFIX)) && find(addr);
+}
+
+int sim_is_link(void *f)
+{
+	return (struct SimDevice *) f >= sim_devices &&
+	       (struct SimDevice *) f < sim_devices + MAX_SIM_DEVICES;
+}
+
+int sim_boot(const char *addr)
+{
+	struct SimDevice *s = find(addr);
+
+	if (!s)
+		return MVNC_DEVICE_NOT_FOUND;
+	pthread_mutex_lock(&s->mm);
+	s->booted = !s->gone;
+	pthread_mutex_unlock(&s->mm);
+	return s->booted ? 0 : MVNC_DEVICE_NOT_FOUND;
+}
+
+void *sim_open(const char *addr)
+{
+	struct SimDevice *s = find(addr);
+	int ok;
+
+	if (!s)
+		return 0;
+	pthread_mutex_lock(&s->mm);
+	ok = s->booted && !s->opened;
+	if (ok)
+		s->opened = 1;
+	pthread_mutex_unlock(&s->mm);
+	return ok ? s : 0;
+}
+
+void sim_close(void *f)
+{
+	struct SimDevice *s = (struct SimDevice *) f;
+
+	pthread_mutex_lock(&s->mm);
+	s->opened = 0;
+	pthread_mutex_unlock(&s->mm);
+}
+
+int sim_resetmyriad(void *f)
+{
+	struct SimDevice *s = (struct SimDevice *) f;
+
+	pthread_mutex_lock(&s->mm);
+	update(s);
+	s->booted = 0;
+	s->queued = s->running = s->done = 0;
+	s->started = 0;
+	if (s->hung) {
+		s->gone = s->hang_after < 0;
+		s->hang_after = 0;
+		s->hung = 0;
+	}
+	pthread_mutex_unlock(&s->mm);
+	return 0;
+}
+
+int sim_getmyriadstatus(void *f, myriadStatus_t *myriadState)
+{
+	struct SimDevice *s = (struct SimDevice *) f;
+
+	pthread_mutex_lock(&s->mm);
+	update(s);
+	*myriadState = s->running ? MYRIAD_RUNNING : s->done ? MYRIAD_FINISHED : MYRIAD_WAITING;
+	pthread_mutex_unlock(&s->mm);
+	return 0;
+}
+
+int sim_setdata(void *f, const char *name, const void *data, unsigned int length, int hostready)
+{
+	struct SimDevice *s = (struct SimDevice *) f;
+	mvncGraphFileInfo info;
+	int rc = 0;
+
+	transfer(length);
+	pthread_mutex_lock(&s->mm);
+	update(s);
+	if (!strcmp(name, "blobFile")) {
+		if (mvncGetGraphFileInfo(data, length, &info))
+			rc = -1;
+		else {
+			s->output_length = info.outputLength;
+			s->nstages = info.stageCount;
+			s->queued = s->running = s->done = 0;
+		}
+	} else if (!strcmp(name, "config") && length >= 8 * sizeof(int)) {
+		const int *config = (const int *) data;
+		s->temp_lim_upper = config[3];
+		s->temp_lim_lower = config[4];
+		s->backoff_time_high = config[6];
+		s->backoff_time_critical = config[7];
+	} else if (!strncmp(name, "input", 5)) {
+		s->queued++;
+		if (hostready && !s->running && !s->done)
+			start(s);
+	}
+	pthread_mutex_unlock(&s->mm);
+	return rc;
+}
+
+int sim_getdata(void *f, const char *name, void *data, unsigned int length,
+		unsigned int offset, int hostready)
+{
+	struct SimDevice *s = (struct SimDevice *) f;
+	unsigned i;
+	int rc = 0;
+
+	// The library always reads whole buffers, from offset 0
+	(void) offset;
+	pthread_mutex_lock(&s->mm);
+	update(s);
+	if (!strcmp(name, "output")) {
+		if (!s->done)
+			rc = -1;
+		else {
+			for (i = 0; i < length / 2; i++)
+				((uint16_t *) data)[i] = 0x3c00 + (i & 0x1ff);
+			s->output_read = 1;
+		}
+	} else if (!strcmp(name, "auxBuffer")) {
+		memset(data, 0, length);
+		if (length >= DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE + sizeof(int)) {
+			float *thermal = (float *) ((char *) data + DEBUG_BUFFER_SIZE);
+			float *time_taken = (float *) ((char *) data + DEBUG_BUFFER_SIZE +
+						       THERMAL_BUFFER_SIZE + sizeof(int));
+			unsigned ntimes = (length - DEBUG_BUFFER_SIZE - THERMAL_BUFFER_SIZE -
+					   sizeof(int)) / sizeof(float);
+
+			for (i = 0; i < THERMAL_BUFFER_SIZE / sizeof(float); i++)
+				thermal[i] = s->temperature;
+			*(int *) ((char *) data + DEBUG_BUFFER_SIZE + THERMAL_BUFFER_SIZE) = s->throttle;
+			for (i = 0; i < ntimes; i++)
+				time_taken[i] = s->latency * 1e3 / ntimes;
+		}
+		if (s->done && s->output_read) {
+			s->done = 0;
+			s->queued--;
+			if (hostready && s->queued > 0)
+				start(s);
+		}
+	} else
+		memset(data, 0, length);
+	pthread_mutex_unlock(&s->mm);
+	if (!rc)
+		transfer(length);
+	return rc;
+}
@@ -0,0 +1,34 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Software devices, emulating sticks in the host so that the library and the
+// tools can run without hardware. They are enabled by MVNC_SIM_DEVICES and
+// are named sim-0, sim-1... after the USB devices. The usblink functions
+// pass the calls on their links here.
+
+#include "USBLinkDefines.h"
+
+int sim_find_device(unsigned idx, char *addr, unsigned addrsize, int booted_only);
+int sim_is_device(const char *addr);
+int sim_is_link(void *f);
+int sim_boot(const char *addr);
+void *sim_open(const char *addr);
+void sim_close(void *f);
+int sim_resetmyriad(void *f);
+int sim_getmyriadstatus(void *f, myriadStatus_t *myriadState);
+int sim_setdata(void *f, const char *name, const void *data, unsigned int length, int hostready);
+int sim_getdata(void *f, const char *name, void *data, unsigned int length, unsigned int offset, int hostready);
@@ -34,6 +34,8 @@
 
 #include "usb_link.h"
 #include "usb_boot.h"
+#include "usb_link_sim.h"
+#include "trace.h"
 #include "common.h"
 
 #define USB_ENDPOINT_IN 	0x81
@@ -79,6 +81,8 @@ void *usblink_open(const char *path)
 	libusb_device_handle *h = NULL;
 	libusb_device *dev;
 
+	if (sim_is_device(path))
+		return sim_open(path);
 	rc = usb_find_device(0, (char *) path, 0, (void **) &dev,
 			     DEFAULT_OPEN_VID, DEFAULT_OPEN_PID);
 	if (rc < 0)
@@ -101,6 +105,10 @@ void *usblink_open(const char *path)
 
 void usblink_close(void *f)
 {
+	if (sim_is_link(f)) {
+		sim_close(f);
+		return;
+	}
 	libusb_release_interface(f, 0);
 	libusb_close(f);
 }
@@ -163,15 +171,43 @@ void usblink_resetall()
 	libusb_free_device_list(devs, 1);
 }
 
-int usblink_setdata(void *f, const char *name, const void *data,
-		    unsigned int length, int host_ready)
+// Memory mapped from the USB driver can be used by bulk
+// transfers directly, without a copy into kernel buffers
+void *usblink_mem_alloc(void *f, unsigned int length)
+{
+	if (sim_is_link(f))
+		return NULL;
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	return libusb_dev_mem_alloc(f, length);
+#else
+	return NULL;
+#endif
+}
+
+void usblink_mem_free(void *f, void *data, unsigned int length)
+{
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	libusb_dev_mem_free(f, data, length);
+#endif
+}
+
+void usblink_header(usbHeader_t *header, hostcommands_t cmd, const char *name,
+		    unsigned int length, unsigned int offset, int host_ready)
+{
+	memset(header, 0, sizeof(*header));
+	header->cmd = cmd;
+	header->hostready = host_ready;
+	header->dataLength = length;
+	header->offset = offset;
+	if (name)
+		strncpy(header->name, name, sizeof(header->name) - 1);
+}
+
+static int usb_setdata(void *f, const char *name, const void *data,
+		       unsigned int length, int host_ready)
 {
 	usbHeader_t header;
-	memset(&header, 0, sizeof(header));
-	header.cmd = USB_LINK_HOST_SET_DATA;
-	header.hostready = host_ready;
-	strcpy(header.name, name);
-	header.dataLength = length;
+	usblink_header(&header, USB_LINK_HOST_SET_DATA, name, length, 0, host_ready);
 	if (usb_write(f, &header, sizeof(header)))
 		return -1;
 
@@ -185,16 +221,11 @@ int usblink_setdata(void *f, const char *name, const void *data,
 	return rc;
 }
 
-int usblink_getdata(void *f, const char *name, void *data, unsigned int length,
-		    unsigned int offset, int host_ready)
+static int usb_getdata(void *f, const char *name, void *data, unsigned int length,
+		       unsigned int offset, int host_ready)
 {
 	usbHeader_t header;
-	memset(&header, 0, sizeof(header));
-	header.cmd = USB_LINK_HOST_GET_DATA;
-	header.hostready = host_ready;
-	strcpy(header.name, name);
-	header.dataLength = length;
-	header.offset = offset;
+	usblink_header(&header, USB_LINK_HOST_GET_DATA, name, length, offset, host_ready);
 	if (usb_write(f, &header, sizeof(header)))
 		return -1;
 
@@ -207,11 +238,36 @@ int usblink_getdata(void *f, const char *name, void *data, unsigned int length,
 	return usb_read(f, data, length);
 }
 
+// Transfers are traced under the name of the data
+int usblink_setdata(void *f, const char *name, const void *data,
+		    unsigned int length, int host_ready)
+{
+	uint64_t start = trace_start();
+	int rc = sim_is_link(f) ? sim_setdata(f, name, data, length, host_ready) :
+		 usb_setdata(f, name, data, length, host_ready);
+
+	trace_record(TRACE_USB, name, start, length, rc);
+	return rc;
+}
+
+int usblink_getdata(void *f, const char *name, void *data, unsigned int length,
+		    unsigned int offset, int host_ready)
+{
+	uint64_t start = trace_start();
+	int rc = sim_is_link(f) ? sim_getdata(f, name, data, length, offset, host_ready) :
+		 usb_getdata(f, name, data, length, offset, host_ready);
+
+	trace_record(TRACE_USB, name, start, length, rc);
+	return rc;
+}
+
 int usblink_resetmyriad(void *f)
 {
+	if (sim_is_link(f))
+		return sim_resetmyriad(f);
+
 	usbHeader_t header;
-	memset(&header, 0, sizeof(header));
-	header.cmd = USB_LINK_RESET_REQUEST;
+	usblink_header(&header, USB_LINK_RESET_REQUEST, NULL, 0, 0, 0);
 	if (usb_write(f, &header, sizeof(header)))
 		return -1;
 	return 0;
@@ -219,10 +275,17 @@ int usblink_resetmyriad(void *f)
 
 int usblink_getmyriadstatus(void *f, myriadStatus_t* myriad_state)
 {
+	uint64_t start = trace_start();
 	usbHeader_t header;
-	memset(&header, 0, sizeof(header));
-	header.cmd = USB_LINK_GET_MYRIAD_STATUS;
-	if (usb_write(f, &header, sizeof(header)))
-		return -1;
-	return usb_read(f, myriad_state, sizeof(*myriad_state));
+	int rc;
+
+	if (sim_is_link(f))
+		rc = sim_getmyriadstatus(f, myriad_state);
+	else {
+		usblink_header(&header, USB_LINK_GET_MYRIAD_STATUS, NULL, 0, 0, 0);
+		rc = usb_write(f, &header, sizeof(header)) ||
+		     usb_read(f, myriad_state, sizeof(*myriad_state)) ? -1 : 0;
+	}
+	trace_record(TRACE_USB, "status", start, sizeof(*myriad_state), rc);
+	return rc;
 }
@@ -0,0 +1,110 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Allocates a graph on three software devices at once over a slow link: the
+// uploads must overlap, and the options of every device, including those being
+// uploaded to, must stay readable meanwhile. Then checks that a failed
+// mvncAllocateGraphs allocates the graph on none of the devices.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+#define DEVICES		3
+#define BLOB_SIZE	(1024 * 1024)
+#define MBPS		"4"		// 0.25 s per upload
+#define MAX_QUERY	0.1		// s a query may take during the uploads
+
+struct Query {
+	void **devices;
+	int stop;
+	int count;
+	double max;
+};
+
+// Reads an option of each device in turn until stopped
+static void *query(void *arg)
+{
+	struct Query *q = arg;
+	unsigned length;
+	double t;
+	int i, level;
+
+	while (!__atomic_load_n(&q->stop, __ATOMIC_ACQUIRE)) {
+		for (i = 0; i < DEVICES; i++) {
+			t = now();
+			mvncGetDeviceOption(q->devices[i], MVNC_THERMAL_THROTTLING_LEVEL, &level, &length);
+			t = now() - t;
+			if (t > q->max)
+				q->max = t;
+			q->count++;
+		}
+		usleep(5000);
+	}
+	return 0;
+}
+
+int main()
+{
+	static unsigned char blob[BLOB_SIZE];
+	void *devices[DEVICES], *graphs[DEVICES], *pair[2];
+	char name[MVNC_MAX_NAME_SIZE];
+	struct Query q = { devices, 0, 0, 0 };
+	pthread_t thread;
+	int i, failed = 0;
+	double t;
+
+	setenv("MVNC_SIM_DEVICES", "3", 1);
+	setenv("MVNC_SIM_MBPS", MBPS, 1);
+	alarm(30);
+	make_graph(blob, 1);
+	for (i = 0; i < DEVICES; i++)
+		if (check("mvncGetDeviceName", mvncGetDeviceName(i, name, sizeof(name)), MVNC_OK) ||
+		    check("mvncOpenDevice", mvncOpenDevice(name, &devices[i]), MVNC_OK))
+			return 1;
+
+	pthread_create(&thread, 0, query, &q);
+	t = now();
+	failed |= check("mvncAllocateGraphs", mvncAllocateGraphs(devices, graphs, DEVICES,
+								 blob, sizeof(blob)), MVNC_OK);
+	t = now() - t;
+	__atomic_store_n(&q.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, 0);
+	if (t > 2 * BLOB_SIZE / (atof(MBPS) * 1048576)) {
+		fprintf(stderr, "Uploads took %.2f s, not concurrently\n", t);
+		failed = 1;
+	}
+	if (q.max > MAX_QUERY) {
+		fprintf(stderr, "A query took %.2f s during the uploads\n", q.max);
+		failed = 1;
+	}
+	for (i = 0; i < DEVICES; i++)
+		failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graphs[i]), MVNC_OK);
+
+	// A device given twice is refused, and its first reservation undone
+	pair[0] = pair[1] = devices[0];
+	failed |= check("mvncAllocateGraphs", mvncAllocateGraphs(pair, graphs, 2, blob, sizeof(blob)),
+			MVNC_BUSY);
+	failed |= check("mvncAllocateGraph", mvncAllocateGraph(devices[0], &graphs[0], blob, sizeof(blob)),
+			MVNC_OK);
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graphs[0]), MVNC_OK);
+
+	for (i = 0; i < DEVICES; i++)
+		failed |= check("mvncCloseDevice", mvncCloseDevice(devices[i]), MVNC_OK);
+	return report(failed);
+}
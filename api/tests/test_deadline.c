@@ -0,0 +1,130 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Deadlines and cancellation of the tensors waiting for an input of a
+// software device busy with two inferences of 100 ms: one waiting past its
+// deadline must get MVNC_TIMEOUT, one cancelled MVNC_CANCELLED, neither being
+// sent, and mvncGetResultWithDeadline must give up at its deadline and leave
+// the inference for the next call.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+#define LATENCY		0.1
+
+static void *graph;
+static char input[INPUT_LENGTH];
+
+struct Load {
+	pthread_t thread;
+	void *param;
+	double deadline;
+	mvncStatus rc;
+	double time;
+};
+
+static void *load(void *arg)
+{
+	struct Load *l = (struct Load *) arg;
+	mvncLoadParams params = { l->deadline, 0 };
+	double t = now();
+
+	l->rc = mvncLoadTensorWithParams(graph, input, INPUT_LENGTH, l->param, &params);
+	l->time = now() - t;
+	return NULL;
+}
+
+static int check_time(const char *what, double t, double min, double max)
+{
+	if (t >= min && t < max)
+		return 0;
+	fprintf(stderr, "%s took %.1f ms, expected %.0f to %.0f ms\n", what, t * 1e3, min * 1e3,
+		max * 1e3);
+	return 1;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static char output[OUTPUT_LENGTH];
+	char name[MVNC_MAX_NAME_SIZE];
+	struct Load late = { 0, (void *) 3, 0, 0, 0 }, cancelled = { 0, (void *) 4, 0, 0, 0 };
+	void *device, *param;
+	unsigned length;
+	mvncStats stats;
+	int failed = 0;
+	double t;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_LATENCY_MS", "100", 1);
+	alarm(20);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK))
+		return 1;
+
+	// Both inputs taken, the first result 100 ms away
+	t = now();
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, (void *) 1), MVNC_OK);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, (void *) 2), MVNC_OK);
+	failed |= check("mvncGetResultWithDeadline", mvncGetResultWithDeadline(graph, output, sizeof(output),
+			&length, &param, now() + 0.01), MVNC_NO_DATA);
+	failed |= check_time("mvncGetResultWithDeadline", now() - t, 0.01, LATENCY / 2);
+
+	// One waits past its deadline, the other is cancelled
+	late.deadline = now() + 0.02;
+	pthread_create(&late.thread, NULL, load, &late);
+	pthread_create(&cancelled.thread, NULL, load, &cancelled);
+	usleep(5000);
+	failed |= check("mvncCancelTensors", mvncCancelTensors(graph, (void *) 4), MVNC_OK);
+	failed |= check("mvncCancelTensors again", mvncCancelTensors(graph, (void *) 4), MVNC_NO_DATA);
+	failed |= check("mvncCancelTensors", mvncCancelTensors(graph, (void *) 5), MVNC_NO_DATA);
+	pthread_join(cancelled.thread, NULL);
+	pthread_join(late.thread, NULL);
+	failed |= check("Cancelled", cancelled.rc, MVNC_CANCELLED);
+	failed |= check_time("Cancelled", cancelled.time, 0, 0.02);
+	failed |= check("Past its deadline", late.rc, MVNC_TIMEOUT);
+	failed |= check_time("Past its deadline", late.time, 0.015, LATENCY / 2);
+
+	// Only the first two were sent, the first one left by
+	// mvncGetResultWithDeadline included
+	failed |= check("mvncGetResultWithDeadline", mvncGetResultWithDeadline(graph, output, sizeof(output),
+			&length, &param, now() + 1), MVNC_OK);
+	failed |= check("First result", (int) (intptr_t) param, 1);
+	failed |= check("mvncGetResultWithDeadline", mvncGetResultWithDeadline(graph, output, sizeof(output),
+			&length, &param, now() + 1), MVNC_OK);
+	failed |= check("Second result", (int) (intptr_t) param, 2);
+	t = now();
+	failed |= check("mvncGetResultWithDeadline", mvncGetResultWithDeadline(graph, output, sizeof(output),
+			&length, &param, now() + 0.02), MVNC_NO_DATA);
+	failed |= check_time("No more results", now() - t, 0.015, LATENCY / 2);
+
+	length = sizeof(stats);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_GRAPH_STATS, &stats, &length),
+			MVNC_OK);
+	if (stats.expired != 1 || stats.cancelled != 1) {
+		fprintf(stderr, "%llu expired, %llu cancelled\n", stats.expired, stats.cancelled);
+		failed = 1;
+	}
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
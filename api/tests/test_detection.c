@@ -0,0 +1,230 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// mvncDecodeDetections on a few boxes with known results, then on random
+// SSD results against a box by box non-maximum suppression, with the list
+// ended by its count or by an image id below 0. No device needed.
+
+#include <stdlib.h>
+#include <math.h>
+#include "tests.h"
+#include "fp16.h"
+
+#define MAX_BOXES	300
+#define RECORD_SIZE	7
+
+struct box {
+	float label, confidence, xmin, ymin, xmax, ymax;
+	unsigned index;
+};
+
+static float clamp01(float v)
+{
+	return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+static int by_confidence(const void *a, const void *b)
+{
+	const struct box *x = a, *y = b;
+
+	if (x->confidence != y->confidence)
+		return x->confidence < y->confidence ? 1 : -1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static float area(const struct box *b)
+{
+	float w = b->xmax - b->xmin, h = b->ymax - b->ymin;
+
+	return w > 0 && h > 0 ? w * h : 0;
+}
+
+// Keeps each box unless a kept one of its label overlaps it too much
+__attribute__((optimize("fp-contract=off")))
+static unsigned reference(const uint16_t *t, unsigned count, float min_confidence, float max_overlap,
+			  mvncDetection *detections, unsigned max)
+{
+	static struct box boxes[MAX_BOXES], kept[MAX_BOXES];
+	unsigned n = 0, k = 0, i, j;
+	float w, h, inter;
+
+	for (i = 0; i < count / RECORD_SIZE - 1 && i < fp16_to_float(t[0]); i++) {
+		const uint16_t *r = t + RECORD_SIZE * (i + 1);
+
+		if (fp16_to_float(r[0]) < 0)
+			break;
+		if (fp16_to_float(r[2]) < min_confidence || !isfinite(fp16_to_float(r[3])) ||
+		    !isfinite(fp16_to_float(r[4])) || !isfinite(fp16_to_float(r[5])) ||
+		    !isfinite(fp16_to_float(r[6])))
+			continue;
+		boxes[n].label = fp16_to_float(r[1]);
+		boxes[n].confidence = fp16_to_float(r[2]);
+		boxes[n].xmin = clamp01(fp16_to_float(r[3]));
+		boxes[n].ymin = clamp01(fp16_to_float(r[4]));
+		boxes[n].xmax = clamp01(fp16_to_float(r[5]));
+		boxes[n].ymax = clamp01(fp16_to_float(r[6]));
+		boxes[n].index = i;
+		n++;
+	}
+	qsort(boxes, n, sizeof(boxes[0]), by_confidence);
+	for (i = 0; i < n && k < max; i++) {
+		for (j = 0; j < k && max_overlap < 1; j++) {
+			if (kept[j].label != boxes[i].label)
+				continue;
+			w = fminf(kept[j].xmax, boxes[i].xmax) - fmaxf(kept[j].xmin, boxes[i].xmin);
+			h = fminf(kept[j].ymax, boxes[i].ymax) - fmaxf(kept[j].ymin, boxes[i].ymin);
+			inter = (w > 0 ? w : 0) * (h > 0 ? h : 0);
+			if (inter > max_overlap * (area(&kept[j]) + area(&boxes[i]) - inter))
+				break;
+		}
+		if (j < k && max_overlap < 1)
+			continue;
+		kept[k] = boxes[i];
+		detections[k].xmin = boxes[i].xmin;
+		detections[k].ymin = boxes[i].ymin;
+		detections[k].xmax = boxes[i].xmax;
+		detections[k].ymax = boxes[i].ymax;
+		detections[k].confidence = boxes[i].confidence;
+		detections[k].label = (int) boxes[i].label;
+		k++;
+	}
+	return k;
+}
+
+static void put_box(uint16_t *t, unsigned i, float image, float label, float confidence,
+		    float xmin, float ymin, float xmax, float ymax)
+{
+	uint16_t *r = t + RECORD_SIZE * (i + 1);
+
+	r[0] = fp16_from_float(image);
+	r[1] = fp16_from_float(label);
+	r[2] = fp16_from_float(confidence);
+	r[3] = fp16_from_float(xmin);
+	r[4] = fp16_from_float(ymin);
+	r[5] = fp16_from_float(xmax);
+	r[6] = fp16_from_float(ymax);
+}
+
+static int compare(const char *what, const mvncDetection *d, unsigned found, const mvncDetection *e,
+		   unsigned expected)
+{
+	unsigned i;
+
+	if (found != expected) {
+		fprintf(stderr, "%s: %u detections instead of %u\n", what, found, expected);
+		return 1;
+	}
+	for (i = 0; i < found; i++)
+		if (memcmp(&d[i], &e[i], sizeof(d[i]))) {
+			fprintf(stderr, "%s: detection %u is label %d %g (%g %g %g %g) instead of "
+				"label %d %g (%g %g %g %g)\n", what, i, d[i].label, d[i].confidence,
+				d[i].xmin, d[i].ymin, d[i].xmax, d[i].ymax, e[i].label, e[i].confidence,
+				e[i].xmin, e[i].ymin, e[i].xmax, e[i].ymax);
+			return 1;
+		}
+	return 0;
+}
+
+static int check_known(void)
+{
+	static const mvncDetection expected[] = {
+		{ 0, 0, 0.5f, 0.5f, 0.875f, 2 },
+		{ 0.125f, 0, 0.5f, 1, 0.75f, 1 },
+		{ 0, 0, 0.5f, 0.5f, 0.5f, 3 },		// The same box of label 2 is suppressed
+	};
+	uint16_t t[RECORD_SIZE * 8];
+	mvncDetection d[8];
+	unsigned found;
+	int failed = 0;
+
+	memset(t, 0, sizeof(t));
+	t[0] = fp16_from_float(6);
+	put_box(t, 0, 0, 2, 0.5f, 0, 0, 0.5f, 0.5f);
+	put_box(t, 1, 0, 2, 0.875f, -1, -1, 0.5f, 0.5f);	// Clamped to the image
+	put_box(t, 2, 0, 3, 0.5f, 0, 0, 0.5f, 0.5f);
+	put_box(t, 3, 0, 1, 0.75f, 0.125f, 0, 0.5f, 1);
+	put_box(t, 4, 0, 1, 0.125f, 0.25f, 0, 0.5f, 1);		// Below the minimum
+	put_box(t, 5, -1, 1, 0.9f, 0, 0, 1, 1);			// Ends the list
+	put_box(t, 6, 0, 1, 0.9f, 0, 0, 1, 1);
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * 8, 0.25f, 0.5f, d,
+								     8, &found), MVNC_OK);
+	failed |= compare("Known boxes", d, found, expected, 3);
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * 8, 0.25f, 0.5f, d,
+								     2, &found), MVNC_OK);
+	failed |= compare("Two known boxes", d, found, expected, 2);
+
+	// Non finite coordinates skip the box, a NaN count reads none
+	put_box(t, 1, 0, 2, 0.875f, -1, -1, INFINITY, 0.5f);
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * 8, 0.25f, 0.5f, d,
+								     8, &found), MVNC_OK);
+	if (found != 3 || d[0].confidence != 0.75f) {
+		fprintf(stderr, "Box with an infinite coordinate kept\n");
+		failed = 1;
+	}
+	t[0] = 0x7e00;
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * 8, 0, 1, d, 8,
+								     &found), MVNC_OK);
+	failed |= compare("NaN count", d, found, expected, 0);
+
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE - 1, 0, 1, d, 8,
+								     &found), MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * 8, 0, 1, 0, 8,
+								     &found), MVNC_INVALID_PARAMETERS);
+	return failed;
+}
+
+// Boxes of few labels, sizes and confidences, so that many overlap and tie
+static void random_result(uint16_t *t, unsigned boxes, unsigned declared, unsigned end)
+{
+	unsigned i;
+	float x, y;
+
+	t[0] = fp16_from_float(declared);
+	for (i = 0; i < boxes; i++) {
+		x = (rand() % 40) / 32.0f - 0.125f;
+		y = (rand() % 40) / 32.0f - 0.125f;
+		put_box(t, i, i == end ? -1 : 0, rand() % 4, (rand() % 16) / 16.0f, x, y,
+			x + (rand() % 12) / 16.0f, y + (rand() % 12) / 16.0f);
+	}
+}
+
+int main()
+{
+	static const float overlaps[] = { 0, 0.3f, 0.5f, 0.7f, 1 };
+	static uint16_t t[RECORD_SIZE * (MAX_BOXES + 1)];
+	static mvncDetection d[MAX_BOXES], e[MAX_BOXES];
+	unsigned boxes, declared, end, o, found, expected, max;
+	char what[64];
+	int failed;
+
+	failed = check_known();
+	srand(1);
+	for (boxes = 1; boxes < MAX_BOXES; boxes += boxes < 12 ? 1 : 37)
+		for (o = 0; o < sizeof(overlaps) / sizeof(overlaps[0]); o++) {
+			declared = rand() % 4 ? boxes : rand() % (boxes + 1);
+			end = rand() % 4 ? boxes : rand() % boxes;
+			max = rand() % 4 ? MAX_BOXES : rand() % (boxes + 1);
+			random_result(t, boxes, declared, end);
+			expected = reference(t, RECORD_SIZE * (boxes + 1), 0.25f, overlaps[o], e, max);
+			snprintf(what, sizeof(what), "%u boxes, %u declared, end at %u, overlap %g", boxes,
+				 declared, end, overlaps[o]);
+			failed |= check("mvncDecodeDetections", mvncDecodeDetections(t, RECORD_SIZE * (boxes + 1),
+					0.25f, overlaps[o], d, max, &found), MVNC_OK);
+			failed |= compare(what, d, found, e, expected);
+		}
+	return report(failed);
+}
@@ -0,0 +1,182 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// The scalar fp16 conversion against known values, then every variant the
+// processor supports bit for bit against it, on all the halves and on floats
+// around the rounding, subnormal and overflow boundaries, NaNs included, with
+// lengths that leave every tail. No device needed.
+
+#include <stdlib.h>
+#include "tests.h"
+#include "fp16.h"
+
+#define FLOATS	65536
+
+static float as_float(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static uint32_t as_bits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static const struct {
+	uint32_t f;
+	uint16_t h;
+} known[] = {
+	{ 0x00000000, 0x0000 },	// 0
+	{ 0x80000000, 0x8000 },	// -0
+	{ 0x3f800000, 0x3c00 },	// 1
+	{ 0xc0000000, 0xc000 },	// -2
+	{ 0x3f801000, 0x3c00 },	// 1 + 2^-11, a tie rounded to even
+	{ 0x3f803000, 0x3c02 },	// 1 + 3 * 2^-11, a tie rounded to even
+	{ 0x477fe000, 0x7bff },	// 65504, the largest half
+	{ 0x477fefff, 0x7bff },	// Just under the tie to infinity
+	{ 0x477ff000, 0x7c00 },	// 65520, the tie rounding to infinity
+	{ 0x7f7fffff, 0x7c00 },	// Largest float
+	{ 0xff800000, 0xfc00 },	// -inf
+	{ 0x38800000, 0x0400 },	// 2^-14, the smallest normal half
+	{ 0x387fc000, 0x03ff },	// The largest subnormal half
+	{ 0x387fe000, 0x0400 },	// Between them, a tie rounded to even
+	{ 0x33800000, 0x0001 },	// 2^-24, the smallest subnormal half
+	{ 0x33000000, 0x0000 },	// 2^-25, a tie rounded to even 0
+	{ 0x33000001, 0x0001 },	// Just over it
+	{ 0x33c00000, 0x0002 },	// 1.5 * 2^-24, a tie rounded to even 2
+	{ 0x00000001, 0x0000 },	// Subnormal float
+	{ 0x7fc00000, 0x7e00 },	// Quiet NaN
+	{ 0xffc00000, 0xfe00 },	// Negative NaN keeps its sign
+	{ 0x7f800001, 0x7e00 },	// Signaling NaN becomes quiet
+	{ 0x7fa02000, 0x7f01 },	// Top of the payload kept
+};
+
+static int check_known(void)
+{
+	unsigned i;
+	uint16_t h;
+	float f;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+		h = fp16_from_float(as_float(known[i].f));
+		if (h != known[i].h) {
+			fprintf(stderr, "%08x converts to %04x instead of %04x\n", known[i].f, h, known[i].h);
+			failed = 1;
+		}
+	}
+	// Back to float, the halves of the table are exact
+	for (i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+		f = fp16_to_float(known[i].h);
+		if (fp16_from_float(f) != known[i].h) {
+			fprintf(stderr, "%04x does not convert back\n", known[i].h);
+			failed = 1;
+		}
+	}
+	if (as_bits(fp16_to_float(0x0001)) != 0x33800000 ||
+	    as_bits(fp16_to_float(0x7c01)) != 0x7fc02000 ||
+	    as_bits(fp16_to_float(0xfc00)) != 0xff800000) {
+		fprintf(stderr, "Wrong subnormal, NaN or infinity from half\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static unsigned rand_bits(unsigned *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return (*state >> 16) | ((*state * 1103515245 + 12345) & 0xffff0000);
+}
+
+// Floats around the boundaries, then NaNs, then random bits
+static void fill_floats(float *f)
+{
+	unsigned i, seed = 1;
+	uint32_t u;
+
+	for (i = 0; i < FLOATS; i++) {
+		u = rand_bits(&seed);
+		if (i < 1024)
+			u = (i & 1 ? 0x80000000 : 0) + (i % 4 < 2 ? 0x33000000 : 0x38000000) +
+			    (i % 4 < 2 ? 0 : (i / 4) << 18) + (i & 0xff0) + 0xff0;
+		else if (i < 2048)
+			u = (i & 1 ? 0x80000000 : 0) + 0x477fe000 + (i & 0x3ff) * 4;
+		else if (i < 4096)
+			u = (i & 1 ? 0xff800000 : 0x7f800000) + (i - 2048) * 0x1001;
+		else if (i < 6144)
+			u = (i & 1 ? 0x80000000 : 0) + (i - 4096) * 0x3fff;
+		f[i] = as_float(u);
+	}
+}
+
+// Converts from every offset, with every tail length, in both directions
+static int check_variant(const struct fp16_variant *v, const uint16_t *h, const float *f)
+{
+	static uint16_t h1[FLOATS], h2[FLOATS];
+	static float f1[FLOATS], f2[FLOATS];
+	unsigned offset, n;
+
+	fp16_variants[0].half_to_float(f1, h, FLOATS);
+	fp16_variants[0].float_to_half(h1, f, FLOATS);
+	for (offset = 0; offset < 4; offset++)
+		for (n = 0; n < 17; n++) {
+			memset(f2, 0, sizeof(f2));
+			memset(h2, 0, sizeof(h2));
+			v->half_to_float(f2 + offset, h + offset, FLOATS - offset - n);
+			v->float_to_half(h2 + offset, f + offset, FLOATS - offset - n);
+			if (memcmp(f1 + offset, f2 + offset, (FLOATS - offset - n) * sizeof(float)) ||
+			    memcmp(h1 + offset, h2 + offset, (FLOATS - offset - n) * sizeof(uint16_t)) ||
+			    (n && (as_bits(f2[FLOATS - n]) || h2[FLOATS - n]))) {
+				fprintf(stderr, "Variant %s differs from offset %u, length %u\n", v->name,
+					offset, FLOATS - offset - n);
+				return 1;
+			}
+		}
+	return 0;
+}
+
+int main()
+{
+	static uint16_t h[FLOATS], h1[FLOATS], h2[FLOATS];
+	static float f[FLOATS];
+	const struct fp16_variant *v;
+	unsigned i;
+	int failed;
+
+	failed = check_known();
+	for (i = 0; i < FLOATS; i++)
+		h[i] = i;
+	fill_floats(f);
+	for (v = fp16_variants + 1; v->name; v++)
+		if (v->supported()) {
+			printf("Checking variant %s\n", v->name);
+			failed |= check_variant(v, h, f);
+		}
+
+	// The one of mvncFloatToHalf
+	fp16_variants[0].float_to_half(h1, f, FLOATS);
+	failed |= check("mvncFloatToHalf", mvncFloatToHalf(h2, f, FLOATS), MVNC_OK);
+	if (memcmp(h1, h2, sizeof(h1))) {
+		fprintf(stderr, "mvncFloatToHalf differs, variant %s\n", fp16_variant_name());
+		failed = 1;
+	}
+	return report(failed);
+}
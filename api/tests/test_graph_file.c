@@ -0,0 +1,124 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// mvncGetGraphFileInfo and mvncGetGraphFileStage on a valid graph file and on
+// truncated or inconsistent ones, which must be rejected without reading past
+// their end. No device needed.
+
+#include <stdlib.h>
+#include "tests.h"
+
+#define STAGES	3
+#define LENGTH	(HEADER_SIZE + STAGES * STAGE_SIZE)
+
+static int check_shape(const char *what, const mvncTensorShape *s, unsigned x, unsigned y,
+		       unsigned z, unsigned stride_x, unsigned stride_y, unsigned stride_z)
+{
+	if (s->x == x && s->y == y && s->z == z && s->strideX == stride_x &&
+	    s->strideY == stride_y && s->strideZ == stride_z)
+		return 0;
+	fprintf(stderr, "%s is %ux%ux%u strides %u %u %u\n", what, s->x, s->y, s->z,
+		s->strideX, s->strideY, s->strideZ);
+	return 1;
+}
+
+// Rejection of a copy of blob modified by change at offset, of length bytes
+static int check_rejected(const char *what, const unsigned char *blob, unsigned length,
+			  unsigned offset, uint32_t change)
+{
+	unsigned char *copy = malloc(length);
+	mvncGraphFileInfo info;
+	mvncStageInfo stage;
+	int failed;
+
+	// An exact size allocation, so that ASan catches a read past the end
+	memcpy(copy, blob, length);
+	if (offset + 4 <= length)
+		put_u32(copy + offset, change);
+	failed = check(what, mvncGetGraphFileInfo(copy, length, &info), MVNC_UNSUPPORTED_GRAPH_FILE);
+	// The stages are read without their tensor sizes
+	if (offset < HEADER_SIZE || offset >= length)
+		failed |= check(what, mvncGetGraphFileStage(copy, length, 0, &stage),
+				MVNC_UNSUPPORTED_GRAPH_FILE);
+	free(copy);
+	return failed;
+}
+
+int main()
+{
+	static unsigned char blob[LENGTH];
+	unsigned char *last = blob + HEADER_SIZE + (STAGES - 1) * STAGE_SIZE;
+	mvncGraphFileInfo info;
+	mvncStageInfo stage;
+	int failed = 0;
+
+	make_graph(blob, STAGES);
+	put_u32(blob + 248, 3);
+	last[100] = 5;
+	last[184] = 1;
+	last[185] = 2;
+	last[186] = 3;
+	put_u32(last + 124, 3);
+	put_u32(last + 128, 3);
+	put_u32(last + 132, 16);
+	put_u32(last + 164, 32);
+
+	failed |= check("mvncGetGraphFileInfo", mvncGetGraphFileInfo(blob, LENGTH, &info), MVNC_OK);
+	if (info.version != 2 || info.stageCount != STAGES || info.firstShave != 3 ||
+	    info.lastShave != 11 || info.inputLength != INPUT_LENGTH ||
+	    info.outputLength != OUTPUT_LENGTH) {
+		fprintf(stderr, "Wrong graph file info\n");
+		failed = 1;
+	}
+	failed |= check_shape("Input", &info.input, 8, 8, 3, 6, 48, 2);
+	failed |= check_shape("Output", &info.output, 1, 1, 10, 20, 20, 2);
+
+	failed |= check("mvncGetGraphFileStage", mvncGetGraphFileStage(blob, LENGTH, STAGES - 1, &stage),
+			MVNC_OK);
+	if (strcmp(stage.name, "stage2") || stage.type != 5 || stage.dataType != 1 ||
+	    stage.precision != 2 || stage.storageOrder != 3) {
+		fprintf(stderr, "Wrong stage info\n");
+		failed = 1;
+	}
+	failed |= check_shape("Stage input", &stage.input, 8, 8, 3, 6, 48, 2);
+	failed |= check_shape("Stage taps", &stage.taps, 3, 3, 16, 0, 32, 0);
+	failed |= check_shape("Stage output", &stage.output, 1, 1, 10, 20, 20, 2);
+	failed |= check("mvncGetGraphFileStage", mvncGetGraphFileStage(blob, LENGTH, STAGES, &stage),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncGetGraphFileInfo", mvncGetGraphFileInfo(NULL, LENGTH, &info),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncGetGraphFileStage", mvncGetGraphFileStage(blob, LENGTH, 0, NULL),
+			MVNC_INVALID_PARAMETERS);
+
+	failed |= check_rejected("Truncated header", blob, HEADER_SIZE, LENGTH, 0);
+	failed |= check_rejected("Truncated first stage", blob, HEADER_SIZE + STAGE_SIZE - 1, LENGTH, 0);
+	failed |= check_rejected("Truncated last stage", blob, LENGTH - 1, LENGTH, 0);
+	failed |= check_rejected("Version 3", blob, LENGTH, 36, 3);
+	failed |= check_rejected("No stage", blob, LENGTH, 240, 0);
+	failed |= check_rejected("One stage too many", blob, LENGTH, 240, STAGES + 1);
+	failed |= check_rejected("65535 stages", blob, LENGTH, 240, 0xffff);
+
+	// Tensor sizes over 128 MB, also when X * Y * stride wraps around 64 bits
+	failed |= check_rejected("Large input", blob, LENGTH, HEADER_SIZE + 112, 1 << 22);
+	failed |= check_rejected("Large output", blob, LENGTH, last + 140 - blob, 1 << 27);
+	failed |= check_rejected("Large output stride", blob, LENGTH, last + 172 - blob, 1 << 28);
+	put_u32(last + 136, 0x80000000);
+	put_u32(last + 140, 0x80000000);
+	failed |= check_rejected("Wrapping output", blob, LENGTH, last + 172 - blob, 0x80000000);
+
+	return report(failed);
+}
@@ -0,0 +1,83 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Options returning a struct on a software device: a buffer too small must
+// be left alone and get MVNC_INVALID_PARAMETERS with the size needed, one of
+// the right size must be filled.
+
+#include <stdlib.h>
+#include "tests.h"
+
+#define GRAPH_OPTION	0
+#define DEVICE_OPTION	1
+
+static int check_size(const char *what, void *handle, int kind, int option, unsigned size)
+{
+	static unsigned char buffer[65536];
+	unsigned length = size - 1, i;
+	int failed;
+
+	memset(buffer, 0xaa, size);
+	failed = check(what, kind == GRAPH_OPTION ?
+		       mvncGetGraphOption(handle, option, buffer, &length) :
+		       mvncGetDeviceOption(handle, option, buffer, &length), MVNC_INVALID_PARAMETERS);
+	for (i = 0; i < size && buffer[i] == 0xaa; i++)
+		;
+	if (length != size || i < size) {
+		fprintf(stderr, "%s: length %u instead of %u, %s\n", what, length, size,
+			i < size ? "written" : "not written");
+		failed = 1;
+	}
+	length = size;
+	failed |= check(what, kind == GRAPH_OPTION ?
+			mvncGetGraphOption(handle, option, buffer, &length) :
+			mvncGetDeviceOption(handle, option, buffer, &length), MVNC_OK);
+	if (length != size) {
+		fprintf(stderr, "%s: length %u instead of %u\n", what, length, size);
+		failed = 1;
+	}
+	return failed;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static char input[INPUT_LENGTH];
+	char name[MVNC_MAX_NAME_SIZE];
+	void *device, *graph, *output, *param;
+	unsigned length;
+	int failed = 0;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK) ||
+	    check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK) ||
+	    check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK))
+		return 1;
+
+	failed |= check_size("MVNC_HOST_TIMES", graph, GRAPH_OPTION, MVNC_HOST_TIMES, sizeof(mvncHostTimes));
+	failed |= check_size("MVNC_GRAPH_STATS", graph, GRAPH_OPTION, MVNC_GRAPH_STATS, sizeof(mvncStats));
+	failed |= check_size("MVNC_DEVICE_STATS", device, DEVICE_OPTION, MVNC_DEVICE_STATS, sizeof(mvncStats));
+	failed |= check_size("MVNC_THERMAL_CONTROL", device, DEVICE_OPTION, MVNC_THERMAL_CONTROL,
+			     sizeof(mvncThermalControl));
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
@@ -0,0 +1,201 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// mvncArgMax, mvncTopK, mvncThreshold and mvncSoftmax against the same
+// operations on the converted floats: ties go to the lowest index, both
+// zeros are equal and thresholds between two halves select the upper one.
+// Lengths leave every tail of the vectorized loops. No device needed.
+
+#include <stdlib.h>
+#include <math.h>
+#include "tests.h"
+#include "fp16.h"
+
+#define COUNT	1003
+
+struct element {
+	float value;
+	unsigned index;
+};
+
+// Largest first, then lowest index first
+static int by_value(const void *a, const void *b)
+{
+	const struct element *x = a, *y = b;
+
+	if (x->value != y->value)
+		return x->value < y->value ? 1 : -1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Random halves from few values, for many ties, with both zeros and no NaN
+static void fill_halves(uint16_t *h, unsigned n, unsigned seed, unsigned values)
+{
+	unsigned i;
+
+	srand(seed);
+	for (i = 0; i < n; i++) {
+		h[i] = rand() % values * 0x1f3 + (rand() & 1) * 0x8000;
+		if (rand() % 50 == 0)
+			h[i] = rand() & 1 ? 0x8000 : 0;
+	}
+}
+
+static int check_argmax_topk(const uint16_t *h, unsigned n)
+{
+	static const unsigned ks[] = { 1, 2, 7, 8, 9, 100 };
+	static struct element sorted[COUNT];
+	unsigned indices[MVNC_MAX_TOP_K], i, k, index;
+	float values[MVNC_MAX_TOP_K], value;
+
+	for (i = 0; i < n; i++) {
+		sorted[i].value = fp16_to_float(h[i]);
+		sorted[i].index = i;
+	}
+	qsort(sorted, n, sizeof(sorted[0]), by_value);
+
+	if (check("mvncArgMax", mvncArgMax(h, n, &index, &value), MVNC_OK))
+		return 1;
+	if (index != sorted[0].index || value != sorted[0].value) {
+		fprintf(stderr, "mvncArgMax of %u elements is %g at %u instead of %g at %u\n", n, value,
+			index, sorted[0].value, sorted[0].index);
+		return 1;
+	}
+	for (i = 0; i < sizeof(ks) / sizeof(ks[0]) + 1; i++) {
+		k = i < sizeof(ks) / sizeof(ks[0]) ? ks[i] : n;
+		if (k > n)
+			continue;
+		if (check("mvncTopK", mvncTopK(h, n, k, indices, values), MVNC_OK))
+			return 1;
+		for (index = 0; index < k; index++)
+			if (indices[index] != sorted[index].index || values[index] != sorted[index].value) {
+				fprintf(stderr, "mvncTopK %u of %u: element %u is %g at %u instead of %g at %u\n",
+					k, n, index, values[index], indices[index], sorted[index].value,
+					sorted[index].index);
+				return 1;
+			}
+	}
+	return 0;
+}
+
+static int check_threshold(const uint16_t *h, unsigned n, float threshold, unsigned max)
+{
+	static unsigned indices[0x10000], expected[0x10000];
+	unsigned found, i, m = 0;
+
+	if (check("mvncThreshold", mvncThreshold(h, n, threshold, indices, max, &found), MVNC_OK))
+		return 1;
+	for (i = 0; i < n && m < max; i++)
+		if (fp16_to_float(h[i]) >= threshold)
+			expected[m++] = i;
+	if (found != m || memcmp(indices, expected, m * sizeof(unsigned))) {
+		fprintf(stderr, "mvncThreshold %g of %u elements: %u found instead of %u\n", threshold, n,
+			found, m);
+		return 1;
+	}
+	return 0;
+}
+
+// Every half as a threshold, and the floats just around and between them
+static int check_thresholds(void)
+{
+	static uint16_t all[0x7c00 * 2 + 2];
+	unsigned i, n = 0;
+	float f, next;
+	int failed = 0;
+
+	for (i = 0; i <= 0x7c00; i++) {
+		all[n++] = i;
+		all[n++] = i | 0x8000;
+	}
+	for (i = 0; i < 0x7c00 && !failed; i += 37) {
+		f = fp16_to_float(i);
+		next = fp16_to_float(i + 1);
+		failed |= check_threshold(all, n, f, n);
+		failed |= check_threshold(all, n, -f, n);
+		failed |= check_threshold(all, n, nextafterf(f, 0), n);
+		failed |= check_threshold(all, n, nextafterf(f, 1e9f), n);
+		failed |= check_threshold(all, n, (f + next) / 2, n);
+		failed |= check_threshold(all, n, -(f + next) / 2, n);
+	}
+	// Beyond the range of halves, and with few indices
+	failed |= check_threshold(all, n, 1e6f, n);
+	failed |= check_threshold(all, n, -1e6f, n);
+	failed |= check_threshold(all, n, INFINITY, n);
+	failed |= check_threshold(all, n, 0.5f, 3);
+	failed |= check_threshold(all, n, 0, 0);
+	return failed;
+}
+
+static int check_softmax(const uint16_t *h, unsigned n)
+{
+	static float probabilities[COUNT];
+	double expected[COUNT], max = -INFINITY, sum = 0, sum_p = 0;
+	unsigned i;
+
+	if (check("mvncSoftmax", mvncSoftmax(h, n, probabilities), MVNC_OK))
+		return 1;
+	for (i = 0; i < n; i++)
+		if (fp16_to_float(h[i]) > max)
+			max = fp16_to_float(h[i]);
+	for (i = 0; i < n; i++)
+		sum += expected[i] = exp(fp16_to_float(h[i]) - max);
+	for (i = 0; i < n; i++) {
+		sum_p += probabilities[i];
+		if (fabs(probabilities[i] - expected[i] / sum) > 1e-5 * expected[i] / sum + 1e-30) {
+			fprintf(stderr, "mvncSoftmax of %u elements: %g instead of %g at %u\n", n,
+				probabilities[i], expected[i] / sum, i);
+			return 1;
+		}
+	}
+	if (fabs(sum_p - 1) > 1e-4) {
+		fprintf(stderr, "mvncSoftmax of %u elements sums to %g\n", n, sum_p);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	static uint16_t h[COUNT];
+	unsigned n, seed, index;
+	int failed = 0;
+
+	for (seed = 1; seed < 5; seed++)
+		for (n = 1; n <= COUNT; n += n < 20 ? 1 : 61) {
+			fill_halves(h, n, seed, seed < 3 ? 8 : 60);
+			failed |= check_argmax_topk(h, n);
+			failed |= check_threshold(h, n, fp16_to_float(h[n / 2]), n);
+			if (seed == 4)
+				failed |= check_softmax(h, n);
+		}
+	// Values under 8, for exp() to be significant everywhere
+	for (n = 1; n < 40; n++) {
+		fill_halves(h, n, n, 8);
+		for (index = 0; index < n; index++)
+			h[index] &= 0xc7ff;
+		failed |= check_softmax(h, n);
+	}
+	failed |= check_thresholds();
+
+	failed |= check("mvncArgMax", mvncArgMax(h, 0, &index, 0), MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncTopK", mvncTopK(h, 3, 4, &index, 0), MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncTopK", mvncTopK(h, 2000, MVNC_MAX_TOP_K + 1, &index, 0),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncSoftmax", mvncSoftmax(h, 3, 0), MVNC_INVALID_PARAMETERS);
+	return report(failed);
+}
@@ -0,0 +1,196 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// mvncPreprocessImage on small images with known results, then on random
+// grayscale, RGB, BGR and RGBA images scaled up and down against a per pixel
+// reference, with widths leaving the vectorized passes a scalar tail and
+// spanning several chunks. No device needed.
+
+#include <stdlib.h>
+#include "tests.h"
+#include "fp16.h"
+
+#define MAX_SIDE	700
+
+// Without fused multiply-adds the library gives the bits of the reference,
+// with them a result may round the other way
+#if defined(__FP_FAST_FMAF) || defined(__aarch64__)
+#define TOLERANCE	1
+#else
+#define TOLERANCE	0
+#endif
+
+struct tap {
+	unsigned i0, i1;
+	float w;
+};
+
+static void compute_tap(unsigned dst, float ratio, unsigned src_size, struct tap *t)
+{
+	float s = (dst + 0.5f) * ratio - 0.5f;
+
+	if (s < 0)
+		s = 0;
+	t->i0 = (unsigned) s;
+	if (t->i0 >= src_size - 1) {
+		t->i0 = t->i1 = src_size - 1;
+		t->w = 0;
+	} else {
+		t->i1 = t->i0 + 1;
+		t->w = s - t->i0;
+	}
+}
+
+// Each element on its own, horizontally then vertically
+__attribute__((optimize("fp-contract=off")))
+static void reference(const unsigned char *image, unsigned width, unsigned height, unsigned stride,
+		      unsigned channels, uint16_t *tensor, unsigned tensor_width,
+		      unsigned tensor_height, const mvncPreprocessParams *p)
+{
+	unsigned out_channels = channels == 1 ? 1 : 3, x, y, c, k;
+	float xratio = (float) width / tensor_width, yratio = (float) height / tensor_height;
+	float top, bottom, v;
+	const unsigned char *r0, *r1;
+	struct tap tx, ty;
+
+	for (y = 0; y < tensor_height; y++) {
+		compute_tap(y, yratio, height, &ty);
+		r0 = image + (size_t) ty.i0 * stride;
+		r1 = image + (size_t) ty.i1 * stride;
+		for (x = 0; x < tensor_width; x++) {
+			compute_tap(x, xratio, width, &tx);
+			for (c = 0; c < out_channels; c++) {
+				k = out_channels == 1 ? 0 : p->channelOrder[c];
+				top = r0[tx.i0 * channels + k] +
+				      (r0[tx.i1 * channels + k] - r0[tx.i0 * channels + k]) * tx.w;
+				bottom = r1[tx.i0 * channels + k] +
+					 (r1[tx.i1 * channels + k] - r1[tx.i0 * channels + k]) * tx.w;
+				v = top + (bottom - top) * ty.w;
+				*tensor++ = fp16_from_float((v - p->mean[c]) * p->scale[c]);
+			}
+		}
+	}
+}
+
+static int check_values(const char *what, const uint16_t *tensor, const float *expected, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		if (fp16_to_float(tensor[i]) != expected[i]) {
+			fprintf(stderr, "%s: element %u is %g instead of %g\n", what, i,
+				fp16_to_float(tensor[i]), expected[i]);
+			return 1;
+		}
+	return 0;
+}
+
+static int check_known(void)
+{
+	static const unsigned char gray[] = { 0, 100 }, ramp[] = { 0, 10, 20, 30 };
+	static const unsigned char rgb[] = { 10, 20, 30, 40, 50, 60 }, rgba[] = { 10, 20, 30, 255 };
+	static const float up[] = { 0, 25, 75, 100 }, down[] = { 5, 25 };
+	static const float swapped[] = { 58, 9, 7 }, bgr[] = { 60, 50, 40 };
+	static const mvncPreprocessParams normalise = { {2, 1, 0}, {1, 2, 3}, {2, 0.5f, 1} };
+	static const mvncPreprocessParams reverse = { {2, 1, 0}, {0, 0, 0}, {1, 1, 1} };
+	uint16_t tensor[12];
+	int failed = 0;
+
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(gray, 2, 1, 0, 1, tensor, 4, 1, 0),
+			MVNC_OK);
+	failed |= check_values("Grayscale upscale", tensor, up, 4);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(ramp, 4, 1, 0, 1, tensor, 2, 1, 0),
+			MVNC_OK);
+	failed |= check_values("Grayscale downscale", tensor, down, 2);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgba, 1, 1, 0, 4, tensor, 1, 1,
+								   &normalise), MVNC_OK);
+	failed |= check_values("RGBA to BGR with mean and scale", tensor, swapped, 3);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgb, 1, 2, 3, 3, tensor, 1, 1,
+								   &reverse), MVNC_OK);
+	failed |= check_values("RGB to BGR, two rows to one", tensor, (const float[]) { 45, 35, 25 }, 3);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgb + 3, 1, 1, 0, 3, tensor, 1, 1,
+								   &reverse), MVNC_OK);
+	failed |= check_values("RGB to BGR", tensor, bgr, 3);
+
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgb, 2, 1, 0, 2, tensor, 1, 1, 0),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgb, 2, 1, 5, 3, tensor, 1, 1, 0),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncPreprocessImage", mvncPreprocessImage(rgb, 2, 1, 0, 3, tensor, 0, 1, 0),
+			MVNC_INVALID_PARAMETERS);
+	return failed;
+}
+
+int main()
+{
+	static const unsigned sizes[][4] = {
+		{ 640, 480, 224, 224 },		// Downscale
+		{ 100, 80, 300, 227 },		// Upscale over three chunks
+		{ 333, 211, 129, 97 },		// A chunk and one pixel
+		{ 224, 224, 224, 224 },		// Same size
+		{ 7, 5, 3, 9 },
+		{ 1, 1, 5, 4 },			// Only the scalar tail
+		{ 2, 3, 1, 1 },
+	};
+	static const struct {
+		const char *name;
+		unsigned channels;
+		int order[3];
+	} formats[] = {
+		{ "grayscale", 1, { 0, 0, 0 } },
+		{ "RGB", 3, { 0, 1, 2 } },
+		{ "BGR", 3, { 2, 1, 0 } },
+		{ "GBR", 3, { 1, 2, 0 } },
+		{ "RGBA", 4, { 0, 1, 2 } },
+		{ "BGRA", 4, { 2, 1, 0 } },
+	};
+	static unsigned char image[MAX_SIDE * MAX_SIDE * 4];
+	static uint16_t tensor[MAX_SIDE * MAX_SIDE * 3], expected[MAX_SIDE * MAX_SIDE * 3];
+	mvncPreprocessParams params = { {0, 1, 2}, {10, 20, 30}, {0.5f, 0.25f, 2} };
+	unsigned s, f, i, n, stride, pad, worst;
+	int failed, d;
+
+	failed = check_known();
+	srand(1);
+	for (i = 0; i < sizeof(image); i++)
+		image[i] = rand();
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+		for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+			for (pad = 0; pad < 2; pad++) {
+				memcpy(params.channelOrder, formats[f].order, sizeof(params.channelOrder));
+				stride = sizes[s][0] * formats[f].channels + pad * 5;
+				n = sizes[s][2] * sizes[s][3] * (formats[f].channels == 1 ? 1 : 3);
+				reference(image, sizes[s][0], sizes[s][1], stride, formats[f].channels,
+					  expected, sizes[s][2], sizes[s][3], &params);
+				failed |= check("mvncPreprocessImage", mvncPreprocessImage(image,
+						sizes[s][0], sizes[s][1], pad ? stride : 0,
+						formats[f].channels, tensor, sizes[s][2], sizes[s][3],
+						&params), MVNC_OK);
+				for (i = worst = 0; i < n; i++) {
+					d = abs((int) tensor[i] - (int) expected[i]);
+					if (d > (int) worst)
+						worst = d;
+				}
+				if (worst > TOLERANCE) {
+					fprintf(stderr, "%s %ux%u to %ux%u, stride %u: %u from the reference\n",
+						formats[f].name, sizes[s][0], sizes[s][1], sizes[s][2],
+						sizes[s][3], stride, worst);
+					failed = 1;
+				}
+			}
+	return report(failed);
+}
@@ -0,0 +1,114 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Order in which the tensors waiting for an input of a software device are
+// sent: the highest priority first, then the earliest deadline, then the
+// oldest, a tensor gaining a level every MVNC_PRIORITY_AGING_MS. An input is
+// freed by reading its result, so the results come in the order sent.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+static void *graph;
+static char input[INPUT_LENGTH];
+
+struct Load {
+	pthread_t thread;
+	mvncLoadParams params;
+	mvncStatus rc;
+};
+
+static void *load(void *arg)
+{
+	struct Load *l = (struct Load *) arg;
+
+	l->rc = mvncLoadTensorWithParams(graph, input, INPUT_LENGTH, l, &l->params);
+	return NULL;
+}
+
+static void start(struct Load *l, double deadline, int priority)
+{
+	l->params.deadline = deadline;
+	l->params.priority = priority;
+	pthread_create(&l->thread, NULL, load, l);
+	usleep(2000);
+}
+
+// Reads the results, each one freeing an input for the next waiting tensor
+static int check_order(const char *what, struct Load **order, unsigned n)
+{
+	void *output, *param;
+	unsigned length, i;
+	int failed = 0;
+
+	for (i = 0; i < n; i++) {
+		usleep(10000);
+		failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+		if (param != order[i]) {
+			fprintf(stderr, "%s: result %u is not the one expected\n", what, i);
+			failed = 1;
+		}
+	}
+	for (i = 0; i < n; i++)
+		if (order[i]->thread) {
+			pthread_join(order[i]->thread, NULL);
+			failed |= check("mvncLoadTensorWithParams", order[i]->rc, MVNC_OK);
+		}
+	return failed;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static struct Load a, b, c, d, e, f, g, h, i;
+	char name[MVNC_MAX_NAME_SIZE];
+	struct Load *order1[] = { &a, &b, &d, &e, &c }, *order2[] = { &f, &g, &h, &i };
+	void *device;
+	int failed = 0;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_LATENCY_MS", "1", 1);
+	alarm(20);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK))
+		return 1;
+
+	// A and B take the inputs, then D by its priority, E by its deadline
+	// and C last, all within a level of aging
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, &a), MVNC_OK);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, &b), MVNC_OK);
+	start(&c, now() + 10, 0);
+	start(&d, 0, 5);
+	start(&e, now() + 5, 0);
+	failed |= check_order("Priority and deadline", order1, 5);
+
+	// H waits 2.5 levels, so goes before I of a priority higher by 1
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, &f), MVNC_OK);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, &g), MVNC_OK);
+	start(&h, 0, 0);
+	usleep(2.5 * MVNC_PRIORITY_AGING_MS * 1000);
+	start(&i, 0, 1);
+	failed |= check_order("Aging", order2, 4);
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
@@ -0,0 +1,92 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Deallocates a graph while a call of mvncLoadTensor is blocked on its full
+// queue with MVNC_QUEUE_BLOCK: the call must return MVNC_GONE and the
+// library stay usable. Runs on a software device, failing by SIGALRM if the
+// library deadlocks.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+struct Load {
+	pthread_t thread;
+	void *graph;
+	void *input;
+	int rc;
+	int done;
+};
+
+static void *load(void *arg)
+{
+	struct Load *l = arg;
+
+	l->rc = mvncLoadTensor(l->graph, l->input, INPUT_LENGTH, l);
+	__atomic_store_n(&l->done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static char input[INPUT_LENGTH];
+	struct Load loads[4];
+	int limit = 1, policy = MVNC_QUEUE_BLOCK, i, failed = 0;
+	char name[MVNC_MAX_NAME_SIZE];
+	void *device, *graph;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_LATENCY_MS", "1000", 1);
+	alarm(20);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK) ||
+	    check("mvncSetGraphOption", mvncSetGraphOption(graph, MVNC_QUEUE_LIMIT, &limit,
+							   sizeof(limit)), MVNC_OK) ||
+	    check("mvncSetGraphOption", mvncSetGraphOption(graph, MVNC_QUEUE_POLICY, &policy,
+							   sizeof(policy)), MVNC_OK))
+		return 1;
+
+	// Two inferences in flight, one call waiting for an input and the last
+	// one blocked by the full queue
+	for (i = 0; i < 4; i++) {
+		loads[i].graph = graph;
+		loads[i].input = input;
+		loads[i].done = 0;
+		pthread_create(&loads[i].thread, 0, load, &loads[i]);
+		usleep(50000);
+	}
+	for (i = 2; i < 4; i++)
+		if (__atomic_load_n(&loads[i].done, __ATOMIC_ACQUIRE)) {
+			fprintf(stderr, "Load %d did not wait\n", i);
+			failed = 1;
+		}
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	for (i = 0; i < 4; i++)
+		pthread_join(loads[i].thread, 0);
+	failed |= check("mvncLoadTensor in flight", loads[0].rc, MVNC_OK);
+	failed |= check("mvncLoadTensor in flight", loads[1].rc, MVNC_OK);
+	failed |= check("mvncLoadTensor waiting", loads[2].rc, MVNC_GONE);
+	failed |= check("mvncLoadTensor blocked", loads[3].rc, MVNC_GONE);
+	failed |= check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
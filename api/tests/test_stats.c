@@ -0,0 +1,223 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// The latency histogram of the counters: each latency must land in the
+// bucket whose bounds hold it, one per us up to 16 us, then 8 per power
+// of 2, and the last bucket take everything from 16 s on. Then
+// mvncHistogramPercentile against the samples sorted, and the stage times.
+// No device needed.
+
+#include <stdlib.h>
+#include <math.h>
+#include "tests.h"
+#include "stats.h"
+
+// Lower bound of bucket i in us, as documented in mvnc.h
+static double bucket_start(unsigned i)
+{
+	unsigned power;
+
+	if (i < 16)
+		return i;
+	power = 4 + (i - 16) / 8;
+	return (1ull << power) * (1 + (i - 16) % 8 / 8.0);
+}
+
+// Index of the only bucket counting the latency of us
+static int bucket_of(unsigned long long us, unsigned *index)
+{
+	static struct stats s;
+	static mvncStats out;
+	unsigned i, n = 0;
+
+	stats_reset(&s);
+	stats_latency(&s, (us + 0.5) * 1e-6);
+	stats_read(&s, &out);
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+		if (out.latency[i]) {
+			*index = i;
+			n += out.latency[i];
+		}
+	return n == 1 ? 0 : -1;
+}
+
+static int check_latency(unsigned long long us)
+{
+	unsigned i;
+
+	if (bucket_of(us, &i)) {
+		fprintf(stderr, "%llu us not counted once\n", us);
+		return 1;
+	}
+	if (us < bucket_start(i) ||
+	    (i < MVNC_LATENCY_BUCKETS - 1 && us >= bucket_start(i + 1))) {
+		fprintf(stderr, "%llu us in bucket %u, from %g to %g us\n", us, i, bucket_start(i),
+			bucket_start(i + 1));
+		return 1;
+	}
+	return 0;
+}
+
+static double middle(unsigned i)
+{
+	return (bucket_start(i) + bucket_start(i + 1)) / 2 * 1e-3;
+}
+
+// The sample of rank ceil(percentile * total / 100), at least 1, from the
+// buckets expanded into their samples in order
+static int check_percentile(const unsigned long long *histogram, float percentile)
+{
+	static unsigned samples[100000];
+	unsigned long long n = 0, j, rank;
+	unsigned i;
+	float ms;
+
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+		for (j = 0; j < histogram[i]; j++)
+			samples[n++] = i;
+	rank = (unsigned long long) ceil((double) percentile * n / 100);
+	if (!rank)
+		rank = 1;
+	if (check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, percentile, &ms), MVNC_OK))
+		return 1;
+	if (fabs(ms - middle(samples[rank - 1])) > 1e-6 * ms) {
+		fprintf(stderr, "Percentile %g of %llu samples is %g ms instead of %g ms\n", percentile, n,
+			ms, middle(samples[rank - 1]));
+		return 1;
+	}
+	return 0;
+}
+
+static int check_percentiles(void)
+{
+	static const float percentiles[] = { 0, 0.1f, 1, 25, 49.9f, 50, 50.1f, 90, 99, 99.9f, 100 };
+	unsigned long long histogram[MVNC_LATENCY_BUCKETS];
+	mvncStats stats;
+	unsigned i, p, seed;
+	float ms;
+	int failed = 0;
+
+	// Two halves, the median at the end of the first
+	memset(histogram, 0, sizeof(histogram));
+	histogram[10] = histogram[100] = 50;
+	failed |= check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, 50, &ms), MVNC_OK);
+	failed |= ms != (float) middle(10);
+	failed |= check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, 50.5f, &ms),
+			MVNC_OK);
+	failed |= ms != (float) middle(100);
+	if (failed)
+		fprintf(stderr, "Wrong median\n");
+
+	// One sample in each bucket alone, the last one included
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++) {
+		memset(histogram, 0, sizeof(histogram));
+		histogram[i] = 1;
+		failed |= check_percentile(histogram, 0);
+		failed |= check_percentile(histogram, 100);
+	}
+
+	// Random histograms, sparse and dense
+	for (seed = 1; seed < 40; seed++) {
+		srand(seed);
+		for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+			histogram[i] = rand() % (seed % 2 ? 4 : 400) ? 0 : rand() % 1000;
+		histogram[rand() % MVNC_LATENCY_BUCKETS] += 1;
+		for (p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+			failed |= check_percentile(histogram, percentiles[p]);
+	}
+
+	memcpy(stats.latency, histogram, sizeof(histogram));
+	failed |= check("mvncStatsPercentile", mvncStatsPercentile(&stats, 50, &ms), MVNC_OK);
+	memset(histogram, 0, sizeof(histogram));
+	failed |= check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, 50, &ms),
+			MVNC_NO_DATA);
+	failed |= check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, -1, &ms),
+			MVNC_INVALID_PARAMETERS);
+	failed |= check("mvncHistogramPercentile", mvncHistogramPercentile(histogram, 101, &ms),
+			MVNC_INVALID_PARAMETERS);
+	return failed;
+}
+
+static int check_stage_stats(void)
+{
+	static const float ms[] = { 2.5f, 0, 40, 2.5f, 0 };
+	static struct stage_stats s;
+	mvncStageStats out;
+	unsigned long long n = 0;
+	unsigned i, b;
+	float p;
+
+	stage_stats_read(&s, &out);
+	if (out.count || out.mean) {
+		fprintf(stderr, "Stage stats not empty\n");
+		return 1;
+	}
+	for (i = 0; i < sizeof(ms) / sizeof(ms[0]); i++)
+		stage_stats_add(&s, ms[i]);
+	stage_stats_read(&s, &out);
+	for (i = 0; i < MVNC_LATENCY_BUCKETS; i++)
+		n += out.time[i];
+	bucket_of(2500, &b);
+	if (out.count != 5 || n != 5 || out.min != 0 || out.max != 40 || out.mean != 9 ||
+	    out.time[0] != 2 || out.time[b] != 2) {
+		fprintf(stderr, "Stage stats %llu times from %g to %g ms, mean %g\n", out.count, out.min,
+			out.max, out.mean);
+		return 1;
+	}
+	if (check("mvncHistogramPercentile", mvncHistogramPercentile(out.time, 50, &p), MVNC_OK) ||
+	    p != (float) middle(b)) {
+		fprintf(stderr, "Median stage time %g ms\n", p);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	unsigned long long us, step;
+	unsigned i;
+	int failed = 0;
+
+	// Every us up to 5 ms, then around each bucket bound and far beyond
+	for (us = 0; us < 5000 && !failed; us++)
+		failed |= check_latency(us);
+	for (i = 0; i <= MVNC_LATENCY_BUCKETS && !failed; i++) {
+		us = bucket_start(i);
+		failed |= check_latency(us);
+		if (us)
+			failed |= check_latency(us - 1);
+		failed |= check_latency(us + 1);
+	}
+	for (us = 5000, step = 1; us < 100000000000ull && !failed; us += step, step = step * 3 / 2 + 1)
+		failed |= check_latency(us);
+
+	// Buckets within 12.5% of their value, up to 16 s
+	for (i = 16; i < MVNC_LATENCY_BUCKETS; i++)
+		if (bucket_start(i + 1) > bucket_start(i) * 1.125) {
+			fprintf(stderr, "Bucket %u from %g to %g us\n", i, bucket_start(i),
+				bucket_start(i + 1));
+			failed = 1;
+		}
+	if (bucket_start(MVNC_LATENCY_BUCKETS) < 16000000) {
+		fprintf(stderr, "The histogram ends at %g us\n", bucket_start(MVNC_LATENCY_BUCKETS));
+		failed = 1;
+	}
+
+	failed |= check_percentiles();
+	failed |= check_stage_stats();
+	return report(failed);
+}
@@ -0,0 +1,139 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Follows the thermal history of a software device past the wraparound of
+// its 1024 samples: a sample is taken at each change of throttling level, so
+// a device heating in a fraction of a ms alternates the level on each pair
+// of inferences, the second one starting hot. The samples followed must be
+// contiguous, and once overwritten the history must start from the oldest
+// one held.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "tests.h"
+
+#define HISTORY		1024
+#define SAMPLES		1300
+
+static int check_samples(const char *what, const mvncThermalSample *s, unsigned n,
+			 unsigned long long first)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		if (s[i].sequence != first + i || (i && s[i].time < s[i - 1].time) ||
+		    s[i].throttle < 0 || s[i].throttle > 1) {
+			fprintf(stderr, "%s: sample %u is %llu at %.6f level %d, expected %llu\n", what, i,
+				s[i].sequence, s[i].time, s[i].throttle, first + i);
+			return 1;
+		}
+	return 0;
+}
+
+// Copies from sequence and checks what comes back against the samples followed
+static int check_history(const char *what, void *device, const mvncThermalSample *followed,
+			 unsigned long long total, unsigned long long sequence, unsigned count)
+{
+	static mvncThermalSample samples[2 * HISTORY];
+	unsigned long long first = sequence, oldest = total - HISTORY;
+	unsigned n = count;
+
+	if (first < oldest)
+		first = oldest;
+	if (first > total)
+		first = total;
+	if (n > total - first)
+		n = total - first;
+	if (check("mvncGetThermalHistory", mvncGetThermalHistory(device, &sequence, samples, &count),
+		  MVNC_OK))
+		return 1;
+	if (count != n || sequence != first + n) {
+		fprintf(stderr, "%s: %u samples up to %llu instead of %u up to %llu\n", what, count,
+			sequence, n, first + n);
+		return 1;
+	}
+	if (check_samples(what, samples, count, first))
+		return 1;
+	if (memcmp(samples, followed + first, count * sizeof(samples[0]))) {
+		fprintf(stderr, "%s: samples differ from those followed\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static mvncThermalSample followed[SAMPLES + 64];
+	static char input[INPUT_LENGTH];
+	char name[MVNC_MAX_NAME_SIZE];
+	void *device, *graph, *output, *param;
+	unsigned long long sequence = 0;
+	float lower = 60, upper = 1e9;
+	int backoff = 0, failed = 0;
+	unsigned length, count;
+	double start;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_LATENCY_MS", "0.5", 1);
+	setenv("MVNC_SIM_TEMP_RISE", "100000", 1);
+	setenv("MVNC_SIM_TIME_CONSTANT", "0.0005", 1);
+	alarm(60);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_TEMP_LIM_LOWER, &lower,
+							     sizeof(lower)), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_TEMP_LIM_HIGHER, &upper,
+							     sizeof(upper)), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_BACKOFF_TIME_HIGH, &backoff,
+							     sizeof(backoff)), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK))
+		return 1;
+
+	// A cold inference then a hot one, following the history in small steps
+	start = now();
+	while (sequence < SAMPLES && !failed && now() - start < 30) {
+		failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+		failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+		failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+		failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+		count = 3;
+		failed |= check("mvncGetThermalHistory", mvncGetThermalHistory(device, &sequence,
+				followed + sequence, &count), MVNC_OK);
+		failed |= check_samples("Following", followed + sequence - count, count, sequence - count);
+		usleep(8000);
+	}
+	if (sequence < SAMPLES) {
+		fprintf(stderr, "Only %llu samples in %.1f s\n", sequence, now() - start);
+		return report(1);
+	}
+
+	// The last 1024 from the oldest held, however far before it the copy starts
+	failed |= check_history("From 0", device, followed, sequence, 0, 2 * HISTORY);
+	failed |= check_history("From overwritten", device, followed, sequence, 5, 10);
+	failed |= check_history("From the oldest", device, followed, sequence, sequence - HISTORY, 7);
+	failed |= check_history("Across the end of the buffer", device, followed, sequence,
+				sequence - sequence % HISTORY - 3, 6);
+	failed |= check_history("The last ones", device, followed, sequence, sequence - 2, 10);
+	failed |= check_history("From the next", device, followed, sequence, sequence, 10);
+	failed |= check_history("From the future", device, followed, sequence, sequence + 100, 10);
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
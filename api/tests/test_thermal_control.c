@@ -0,0 +1,130 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// MVNC_THERMAL_CONTROL with MVNC_DONT_BLOCK on a software device held over
+// its target temperature: a tensor paced by the controller must get
+// MVNC_BUSY at once, counted as throttled, with MVNC_THERMAL_WAIT telling
+// when it can be sent.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "tests.h"
+
+#define LATENCY_MS	10
+
+static mvncStatus infer(void *graph, const void *input)
+{
+	void *output, *param;
+	unsigned length;
+	mvncStatus rc;
+	float ms;
+
+	while ((rc = mvncLoadTensor(graph, input, INPUT_LENGTH, 0)) == MVNC_BUSY) {
+		length = sizeof(ms);
+		if (mvncGetGraphOption(graph, MVNC_THERMAL_WAIT, &ms, &length))
+			return MVNC_ERROR;
+		usleep(ms * 1e3 + 1000);
+	}
+	if (rc)
+		return rc;
+	while ((rc = mvncGetResult(graph, &output, &length, &param)) == MVNC_NO_DATA)
+		usleep(1000);
+	return rc;
+}
+
+int main()
+{
+	static unsigned char blob[HEADER_SIZE + STAGE_SIZE + 4096];
+	static char input[INPUT_LENGTH];
+	char name[MVNC_MAX_NAME_SIZE];
+	int on = 1, i, failed = 0;
+	float target = 1, ms, ms2;
+	void *device, *graph;
+	mvncThermalControl control;
+	mvncStats stats;
+	unsigned length;
+	double t;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_LATENCY_MS", "10", 1);
+	alarm(20);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_THERMAL_CONTROL, &on,
+							     sizeof(on)), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_THERMAL_TARGET, &target,
+							     sizeof(target)), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK) ||
+	    check("mvncSetGraphOption", mvncSetGraphOption(graph, MVNC_DONT_BLOCK, &on, sizeof(on)),
+		  MVNC_OK))
+		return 1;
+
+	// The device is over its target from the start, the duty goes down
+	for (i = 0; i < 3; i++)
+		failed |= check("Inference", infer(graph, input), MVNC_OK);
+	length = sizeof(control);
+	failed |= check("mvncGetDeviceOption", mvncGetDeviceOption(device, MVNC_THERMAL_CONTROL, &control,
+								   &length), MVNC_OK);
+	if (control.duty >= 0.5f) {
+		fprintf(stderr, "Duty %g over the target\n", control.duty);
+		failed = 1;
+	}
+
+	// Paced: MVNC_BUSY without waiting
+	length = sizeof(ms);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_THERMAL_WAIT, &ms, &length),
+			MVNC_OK);
+	usleep(ms * 1e3 + 1000);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+	t = now();
+	failed |= check("mvncLoadTensor paced", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_BUSY);
+	t = now() - t;
+	if (t > 0.5 * LATENCY_MS * 1e-3) {
+		fprintf(stderr, "mvncLoadTensor took %.1f ms\n", t * 1e3);
+		failed = 1;
+	}
+	length = sizeof(ms);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_THERMAL_WAIT, &ms, &length),
+			MVNC_OK);
+	if (ms <= LATENCY_MS || ms > LATENCY_MS / 0.04) {
+		fprintf(stderr, "MVNC_THERMAL_WAIT is %g ms\n", ms);
+		failed = 1;
+	}
+	length = sizeof(stats);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_GRAPH_STATS, &stats, &length),
+			MVNC_OK);
+	if (!stats.throttled || stats.throttled != stats.busy) {
+		fprintf(stderr, "%llu throttled for %llu busy\n", stats.throttled, stats.busy);
+		failed = 1;
+	}
+
+	// Then sent once the wait is over, the result of the first being read
+	usleep(ms * 1e3 + 1000);
+	length = sizeof(ms2);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_THERMAL_WAIT, &ms2, &length),
+			MVNC_OK);
+	if (ms2 != 0) {
+		fprintf(stderr, "MVNC_THERMAL_WAIT still %g ms\n", ms2);
+		failed = 1;
+	}
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
@@ -0,0 +1,122 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// MVNC_WATCHDOG on a software device hanging on its third inference: the
+// device must be reset and reloaded once, the two inferences in flight
+// uploaded again and their results returned. The graph file takes a quarter
+// of a second to upload again, the queries of the device must not wait for
+// it meanwhile.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+#define GRAPH_SIZE	(1 << 20)
+#define WATCHDOG_MS	100
+
+static volatile int done;
+static double longest;
+static int recovering;
+
+// Queries the device until the results come, timing each query
+static void *query(void *device)
+{
+	mvncStats stats;
+	unsigned length;
+	float weight;
+	double t;
+
+	while (!done) {
+		t = now();
+		length = sizeof(stats);
+		if (mvncGetDeviceOption(device, MVNC_DEVICE_STATS, &stats, &length))
+			break;
+		length = sizeof(weight);
+		if (mvncGetDeviceOption(device, MVNC_DISPATCH_WEIGHT, &weight, &length))
+			break;
+		t = now() - t;
+		if (t > longest)
+			longest = t;
+		if (!weight)
+			recovering = 1;
+		usleep(1000);
+	}
+	return NULL;
+}
+
+int main()
+{
+	static unsigned char blob[GRAPH_SIZE];
+	static char input[INPUT_LENGTH];
+	char name[MVNC_MAX_NAME_SIZE];
+	void *device, *graph, *output, *param;
+	int watchdog = WATCHDOG_MS, i, failed = 0;
+	unsigned length;
+	mvncStats stats;
+	pthread_t thread;
+
+	setenv("MVNC_SIM_DEVICES", "1", 1);
+	setenv("MVNC_SIM_MBPS", "4", 1);
+	setenv("MVNC_SIM_HANG_AFTER", "3", 1);
+	alarm(30);
+	make_graph(blob, 1);
+	if (check("mvncGetDeviceName", mvncGetDeviceName(0, name, sizeof(name)), MVNC_OK) ||
+	    check("mvncOpenDevice", mvncOpenDevice(name, &device), MVNC_OK) ||
+	    check("mvncSetDeviceOption", mvncSetDeviceOption(device, MVNC_WATCHDOG, &watchdog,
+							     sizeof(watchdog)), MVNC_OK) ||
+	    check("mvncAllocateGraph", mvncAllocateGraph(device, &graph, blob, sizeof(blob)), MVNC_OK))
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+		failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+	}
+
+	// The third hangs, the fourth waits behind it
+	pthread_create(&thread, NULL, query, device);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, (void *) 3), MVNC_OK);
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, (void *) 4), MVNC_OK);
+	failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+	failed |= check("First replayed", (int) (intptr_t) param, 3);
+	failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+	failed |= check("Second replayed", (int) (intptr_t) param, 4);
+	done = 1;
+	pthread_join(thread, NULL);
+	if (!recovering || longest > WATCHDOG_MS * 1e-3) {
+		fprintf(stderr, "Queries up to %.1f ms, %s\n", longest * 1e3,
+			recovering ? "during the recovery" : "no recovery seen");
+		failed = 1;
+	}
+
+	length = sizeof(stats);
+	failed |= check("mvncGetGraphOption", mvncGetGraphOption(graph, MVNC_GRAPH_STATS, &stats, &length),
+			MVNC_OK);
+	if (stats.resets != 1 || stats.replays != 2 || stats.errors) {
+		fprintf(stderr, "%llu resets, %llu replays, %llu errors\n", stats.resets, stats.replays,
+			stats.errors);
+		failed = 1;
+	}
+
+	// And the graph goes on
+	failed |= check("mvncLoadTensor", mvncLoadTensor(graph, input, INPUT_LENGTH, 0), MVNC_OK);
+	failed |= check("mvncGetResult", mvncGetResult(graph, &output, &length, &param), MVNC_OK);
+
+	failed |= check("mvncDeallocateGraph", mvncDeallocateGraph(graph), MVNC_OK);
+	failed |= check("mvncCloseDevice", mvncCloseDevice(device), MVNC_OK);
+	return report(failed);
+}
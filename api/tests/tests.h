@@ -0,0 +1,94 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Helpers of the tests, which run on the software devices of usb_link_sim.c
+// or on no device at all. Each test is a program returning 0 when it passes.
+
+#ifndef _TESTS_H
+#define _TESTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "mvnc.h"
+
+#define HEADER_SIZE	264
+#define STAGE_SIZE	227
+#define INPUT_LENGTH	(8 * 8 * 3 * 2)
+#define OUTPUT_LENGTH	(10 * 2)
+
+static inline void put_u32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// Graph file of nstages stages from 8x8x3 to 1x1x10, accepted by the software
+// devices, in blob of at least HEADER_SIZE + nstages * STAGE_SIZE zeroed bytes
+static inline void make_graph(unsigned char *blob, unsigned nstages)
+{
+	unsigned char *s;
+	unsigned i;
+
+	blob[36] = 2;
+	put_u32(blob + 240, nstages);
+	put_u32(blob + 252, 11);
+	for (i = 0; i < nstages; i++) {
+		s = blob + HEADER_SIZE + i * STAGE_SIZE;
+		sprintf((char *) s, "stage%u", i);
+		put_u32(s + 112, 8);
+		put_u32(s + 116, 8);
+		put_u32(s + 120, 3);
+		put_u32(s + 136, 1);
+		put_u32(s + 140, 1);
+		put_u32(s + 144, 10);
+		put_u32(s + 148, 3 * 2);
+		put_u32(s + 152, 8 * 3 * 2);
+		put_u32(s + 156, 2);
+		put_u32(s + 172, 10 * 2);
+		put_u32(s + 176, 10 * 2);
+		put_u32(s + 180, 2);
+	}
+}
+
+static inline int check(const char *what, int rc, int expected)
+{
+	if (rc == expected)
+		return 0;
+	fprintf(stderr, "%s returned %d instead of %d\n", what, rc, expected);
+	return 1;
+}
+
+// Seconds of the clock of the deadlines
+static inline double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline int report(int failed)
+{
+	printf("%s: %s\n", __BASE_FILE__, failed ? "FAILED" : "OK");
+	return failed;
+}
+
+#endif
@@ -0,0 +1,563 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Throughput and latency benchmark of a graph on one or more devices.
+// Closed loop keeps depth inferences in flight on each device; open loop
+// (-r) generates requests at a fixed rate and queues them in the host, so
+// that latency includes the queueing, and with -D drops the requests not
+// sent within their deadline. -L bounds that queue, rejecting the new
+// requests when it is full, or with -O dropping the oldest ones, as
+// MVNC_QUEUE_POLICY. The report is printed as JSON.
+// Set MVNC_SIM_DEVICES to run it on software devices.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "mvnc.h"
+
+#define MAX_DEVICES	64
+#define QUEUE_SIZE	65536	// Requests waiting in the host in open loop
+
+struct Stick {
+	char name[MVNC_MAX_NAME_SIZE];
+	void *device, *graph;
+	int fd;
+	unsigned inflight;
+	double start[2];	// Of the inferences in flight, in order
+	void *input, *output;
+	// Measured in the window
+	unsigned inferences;
+	double busy, busy_since;
+	double compute;
+	mvncHostTimes phases;	// Sums
+	float weight;		// MVNC_GRAPH_WEIGHT with -d
+};
+
+struct Worker {
+	pthread_t thread;
+	struct Stick **sticks;
+	unsigned nsticks;
+	double interval;	// Between arrivals in open loop, 0 for closed loop
+	double queue[QUEUE_SIZE];
+	unsigned head, tail;
+	unsigned dropped;
+	unsigned expired, late;	// Past the deadline before being sent, or at the result
+	double weighed;		// Time of the last weight update
+	float *latency;		// ms
+	unsigned nlatency, latency_size;
+	int rc;
+};
+
+static unsigned depth = 2;
+static int weighted;
+static double deadline;		// Seconds after the arrival, 0 for none
+static unsigned queue_limit = QUEUE_SIZE;
+static int drop_oldest;		// MVNC_QUEUE_DROP_OLDEST rather than MVNC_QUEUE_REJECT
+static double t_begin, t_end;	// Measurement window
+static unsigned input_length, output_length;
+
+static double time_in_seconds()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_seconds()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: mvnc_bench [options] graph\n"
+		"  -n devices   number of devices, all by default\n"
+		"  -q depth     inferences in flight per device, 1 or 2, default 2\n"
+		"  -t threads   host threads sharing the devices, default 1\n"
+		"  -s seconds   measurement duration, default 10\n"
+		"  -w seconds   warmup before measuring, default 2\n"
+		"  -r rate      open loop at rate inferences/s, closed loop by default\n"
+		"  -c           pace the devices with the host thermal controller\n"
+		"  -d           dispatch by MVNC_GRAPH_WEIGHT instead of to the least loaded device\n"
+		"  -W ms        recover the devices without a result for ms, MVNC_WATCHDOG\n"
+		"  -D ms        in open loop, drop the requests not sent within ms of their arrival\n"
+		"  -L length    in open loop, requests queued at most, default 65536\n"
+		"  -O           drop the oldest request of a full queue instead of the new one\n");
+	exit(1);
+}
+
+static void *load_file(const char *path, unsigned *length)
+{
+	FILE *fp = fopen(path, "rb");
+	void *buf;
+
+	if (!fp)
+		return 0;
+	fseek(fp, 0, SEEK_END);
+	*length = ftell(fp);
+	rewind(fp);
+	buf = malloc(*length);
+	if (buf && fread(buf, 1, *length, fp) != *length) {
+		free(buf);
+		buf = 0;
+	}
+	fclose(fp);
+	return buf;
+}
+
+static void add_latency(struct Worker *w, double ms)
+{
+	if (w->nlatency == w->latency_size) {
+		w->latency_size = w->latency_size ? w->latency_size * 2 : 4096;
+		w->latency = realloc(w->latency, w->latency_size * sizeof(*w->latency));
+		if (!w->latency) {
+			perror("latency");
+			exit(1);
+		}
+	}
+	w->latency[w->nlatency++] = ms;
+}
+
+// Accumulates the time with inferences in flight inside the window
+static void busy_until(struct Stick *s, double t)
+{
+	double from = s->busy_since > t_begin ? s->busy_since : t_begin;
+
+	if (t > t_end)
+		t = t_end;
+	if (t > from)
+		s->busy += t - from;
+}
+
+// MVNC_TIMEOUT when the request was dropped at its deadline, MVNC_BUSY
+// while the device is being recovered
+static int load(struct Stick *s, double start)
+{
+	mvncLoadParams params = { deadline ? start + deadline : 0, 0 };
+	int rc = mvncLoadTensorWithParams(s->graph, s->input, input_length, 0, &params);
+
+	if (rc == MVNC_TIMEOUT || rc == MVNC_BUSY)
+		return rc;
+	if (rc) {
+		fprintf(stderr, "LoadTensor on %s failed: %d\n", s->name, rc);
+		return rc;
+	}
+	if (!s->inflight++)
+		s->busy_since = time_in_seconds();
+	s->start[s->inflight - 1] = start;
+	return 0;
+}
+
+static int collect(struct Worker *w, struct Stick *s)
+{
+	unsigned length, i;
+	uint64_t count;
+	void *param;
+	float *times;
+	mvncHostTimes h;
+	double t, sum;
+	int rc;
+
+	if (read(s->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return MVNC_ERROR;
+	while (s->inflight) {
+		rc = mvncGetResultToBuffer(s->graph, s->output, output_length, &length, &param);
+		if (rc == MVNC_NO_DATA)
+			break;
+		if (rc) {
+			fprintf(stderr, "GetResult on %s failed: %d\n", s->name, rc);
+			return rc;
+		}
+		t = time_in_seconds();
+		if (!--s->inflight)
+			busy_until(s, t);
+		if (t >= t_begin && t < t_end) {
+			s->inferences++;
+			add_latency(w, (t - s->start[0]) * 1e3);
+			if (deadline && t - s->start[0] > deadline)
+				w->late++;
+			if (!mvncGetGraphOption(s->graph, MVNC_TIME_TAKEN, &times, &length)) {
+				for (sum = 0, i = 0; i < length / sizeof(*times); i++)
+					sum += times[i];
+				s->compute += sum * 1e-3;
+			}
+			length = sizeof(h);
+			if (!mvncGetGraphOption(s->graph, MVNC_HOST_TIMES, &h, &length)) {
+				s->phases.slotWait += h.slotWait;
+				s->phases.lockWait += h.lockWait;
+				s->phases.upload += h.upload;
+				s->phases.device += h.device;
+				s->phases.download += h.download;
+				s->phases.aux += h.aux;
+			}
+		}
+		s->start[0] = s->start[1];
+	}
+	return 0;
+}
+
+static void weigh(struct Worker *w, double t)
+{
+	unsigned i, length;
+
+	if (t - w->weighed < 0.1)
+		return;
+	w->weighed = t;
+	for (i = 0; i < w->nsticks; i++)
+		mvncGetGraphOption(w->sticks[i]->graph, MVNC_GRAPH_WEIGHT, &w->sticks[i]->weight,
+				   &length);
+}
+
+static void *worker(void *arg)
+{
+	struct Worker *w = arg;
+	struct pollfd fds[MAX_DEVICES];
+	double t, next = time_in_seconds(), stop = t_end;
+	unsigned i, pending;
+	struct timespec timeout;
+
+	for (i = 0; i < w->nsticks; i++) {
+		fds[i].fd = w->sticks[i]->fd;
+		fds[i].events = POLLIN;
+	}
+	for (;;) {
+		t = time_in_seconds();
+		// Requests arrived since the last pass
+		while (w->interval && next <= t && next < stop) {
+			if (w->tail - w->head == queue_limit) {
+				w->dropped++;
+				if (drop_oldest)
+					w->head++;
+			}
+			if (w->tail - w->head < queue_limit)
+				w->queue[w->tail++ % QUEUE_SIZE] = next;
+			next += w->interval;
+		}
+		// Fill the devices, the least loaded first, or with -d the one with
+		// the lowest (inflight + 1) / weight, waiting for it when it is full
+		if (weighted)
+			weigh(w, t);
+		for (;;) {
+			struct Stick *best = 0, *s;
+			for (i = 0; i < w->nsticks; i++) {
+				s = w->sticks[i];
+				if (weighted ? !best || (s->inflight + 1) * best->weight <
+						       (best->inflight + 1) * s->weight :
+				    s->inflight < depth && (!best || s->inflight < best->inflight))
+					best = s;
+			}
+			if (best && best->inflight >= depth)
+				best = 0;
+			if (!best || (w->interval ? w->head == w->tail : t >= stop))
+				break;
+			double start = w->interval ? w->queue[w->head++ % QUEUE_SIZE] : t;
+			w->rc = load(best, start);
+			if (w->rc == MVNC_TIMEOUT) {
+				if (start >= t_begin && start < t_end)
+					w->expired++;
+				w->rc = 0;
+				continue;
+			}
+			if (w->rc == MVNC_BUSY) {
+				if (w->interval)
+					w->head--;
+				w->rc = 0;
+				break;
+			}
+			if (w->rc)
+				return 0;
+		}
+		for (pending = 0, i = 0; i < w->nsticks; i++)
+			pending += w->sticks[i]->inflight;
+		if (t >= stop && !pending && w->head == w->tail)
+			break;
+
+		// Wait for a completion or the next arrival
+		t = w->interval && next < stop ? next - time_in_seconds() : 1;
+		if (t < 0)
+			t = 0;
+		timeout.tv_sec = (time_t) t;
+		timeout.tv_nsec = (long) ((t - timeout.tv_sec) * 1e9);
+		if (ppoll(fds, w->nsticks, &timeout, 0) < 0 && errno != EINTR) {
+			perror("poll");
+			w->rc = MVNC_ERROR;
+			return 0;
+		}
+		for (i = 0; i < w->nsticks; i++)
+			if (fds[i].revents & POLLIN) {
+				w->rc = collect(w, w->sticks[i]);
+				if (w->rc)
+					return 0;
+			}
+	}
+	return 0;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const float *sorted, unsigned n, double p)
+{
+	unsigned i = (unsigned) ceil(p * n);
+	return n ? sorted[i ? i - 1 : 0] : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static struct Stick sticks[MAX_DEVICES];
+	static struct Stick *order[MAX_DEVICES];
+	struct Worker *workers;
+	unsigned ndevices = MAX_DEVICES, nthreads = 1, graph_length, length, i, n, total;
+	double seconds = 10, warmup = 2, rate = 0, cpu0, cpu1, sum;
+	mvncGraphFileInfo info;
+	mvncThermalControl thermal;
+	void *graph_file;
+	float *latency;
+	mvncStats stats;
+	int opt, rc, dontblock = 1, control = 0, watchdog = 0;
+
+	while ((opt = getopt(argc, argv, "n:q:t:s:w:r:cdW:D:L:O")) != -1) {
+		switch (opt) {
+		case 'n':
+			ndevices = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atof(optarg);
+			break;
+		case 'w':
+			warmup = atof(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'c':
+			control = 1;
+			break;
+		case 'd':
+			weighted = 1;
+			break;
+		case 'W':
+			watchdog = atoi(optarg);
+			break;
+		case 'D':
+			deadline = atof(optarg) * 1e-3;
+			break;
+		case 'L':
+			queue_limit = atoi(optarg);
+			break;
+		case 'O':
+			drop_oldest = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || depth < 1 || depth > 2 || !ndevices || !nthreads ||
+	    seconds <= 0 || warmup < 0 || rate < 0 || watchdog < 0 || deadline < 0 ||
+	    (deadline && !rate) || !queue_limit || queue_limit > QUEUE_SIZE)
+		usage();
+	if (ndevices > MAX_DEVICES)
+		ndevices = MAX_DEVICES;
+
+	graph_file = load_file(argv[optind], &graph_length);
+	if (!graph_file) {
+		perror(argv[optind]);
+		return 1;
+	}
+	rc = mvncGetGraphFileInfo(graph_file, graph_length, &info);
+	if (rc) {
+		fprintf(stderr, "%s: invalid graph file: %d\n", argv[optind], rc);
+		return 1;
+	}
+	input_length = info.inputLength;
+	output_length = info.outputLength;
+
+	for (n = 0; n < ndevices; n++) {
+		struct Stick *s = &sticks[n];
+		if (mvncGetDeviceName(n, s->name, sizeof(s->name)))
+			break;
+		rc = mvncOpenDevice(s->name, &s->device);
+		if (!rc && control)
+			rc = mvncSetDeviceOption(s->device, MVNC_THERMAL_CONTROL, &control, sizeof(control));
+		if (!rc && watchdog)
+			rc = mvncSetDeviceOption(s->device, MVNC_WATCHDOG, &watchdog, sizeof(watchdog));
+		if (!rc)
+			rc = mvncAllocateGraph(s->device, &s->graph, graph_file, graph_length);
+		if (!rc)
+			rc = mvncSetGraphOption(s->graph, MVNC_DONT_BLOCK, &dontblock, sizeof(dontblock));
+		if (!rc)
+			rc = mvncGetGraphOption(s->graph, MVNC_COMPLETION_FD, &s->fd, &length);
+		if (!rc && mvncAllocTensorBuffer(s->device, input_length, &s->input))
+			rc = MVNC_OUT_OF_MEMORY;
+		if (rc) {
+			fprintf(stderr, "Cannot use device %s: %d\n", s->name, rc);
+			return 1;
+		}
+		memset(s->input, 0, input_length);
+		s->output = malloc(output_length);
+		if (!s->output) {
+			perror("output");
+			return 1;
+		}
+		order[n] = s;
+	}
+	if (!n) {
+		fprintf(stderr, "No devices found\n");
+		return 1;
+	}
+	ndevices = n;
+	if (nthreads > ndevices)
+		nthreads = ndevices;
+
+	// Devices are dealt to the threads, and so is the arrival rate, in proportion
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers) {
+		perror("workers");
+		return 1;
+	}
+	t_begin = time_in_seconds() + warmup;
+	t_end = t_begin + seconds;
+	for (i = 0; i < nthreads; i++) {
+		struct Worker *w = &workers[i];
+		w->sticks = order + i * ndevices / nthreads;
+		w->nsticks = (i + 1) * ndevices / nthreads - i * ndevices / nthreads;
+		w->interval = rate && w->nsticks ? ndevices / (rate * w->nsticks) : 0;
+	}
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&workers[i].thread, 0, worker, &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	usleep(warmup * 1e6);
+	cpu0 = cpu_seconds();
+	while (time_in_seconds() < t_end)
+		usleep((t_end - time_in_seconds()) * 1e6 + 1);
+	cpu1 = cpu_seconds();
+
+	rc = 0;
+	for (total = 0, i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, 0);
+		rc |= workers[i].rc;
+		total += workers[i].nlatency;
+	}
+	latency = malloc((total + 1) * sizeof(*latency));
+	if (!latency) {
+		perror("latency");
+		return 1;
+	}
+	for (n = 0, i = 0; i < nthreads; i++) {
+		memcpy(latency + n, workers[i].latency, workers[i].nlatency * sizeof(*latency));
+		n += workers[i].nlatency;
+	}
+	qsort(latency, total, sizeof(*latency), compare_float);
+	for (sum = 0, i = 0; i < total; i++)
+		sum += latency[i];
+
+	printf("{\n");
+	printf("  \"graph\": \"%s\",\n", argv[optind]);
+	printf("  \"mode\": \"%s\",\n", rate ? "open" : "closed");
+	printf("  \"devices\": %u,\n", ndevices);
+	printf("  \"depth\": %u,\n", depth);
+	printf("  \"threads\": %u,\n", nthreads);
+	printf("  \"seconds\": %g,\n", seconds);
+	if (rate) {
+		for (n = 0, i = 0; i < nthreads; i++)
+			n += workers[i].dropped;
+		printf("  \"rate\": %g,\n", rate);
+		printf("  \"queue_limit\": %u,\n", queue_limit);
+		printf("  \"queue_policy\": \"%s\",\n", drop_oldest ? "drop_oldest" : "reject");
+		printf("  \"dropped\": %u,\n", n);
+	}
+	if (deadline) {
+		unsigned expired = 0, late = 0;
+		for (i = 0; i < nthreads; i++) {
+			expired += workers[i].expired;
+			late += workers[i].late;
+		}
+		printf("  \"deadline_ms\": %g,\n", deadline * 1e3);
+		printf("  \"expired\": %u,\n", expired);
+		printf("  \"late\": %u,\n", late);
+	}
+	printf("  \"inferences\": %u,\n", total);
+	printf("  \"throughput\": %.2f,\n", total / seconds);
+	printf("  \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+	       "\"p99\": %.3f, \"p99.9\": %.3f, \"max\": %.3f},\n",
+	       total ? sum / total : 0, percentile(latency, total, 0.5),
+	       percentile(latency, total, 0.9), percentile(latency, total, 0.99),
+	       percentile(latency, total, 0.999), total ? latency[total - 1] : 0);
+	printf("  \"cpu_us_per_inference\": %.1f,\n", total ? (cpu1 - cpu0) * 1e6 / total : 0);
+	printf("  \"device\": [\n");
+	for (i = 0; i < ndevices; i++) {
+		struct Stick *s = &sticks[i];
+		double k = s->inferences ? 1.0 / s->inferences : 0;
+		printf("    {\"name\": \"%s\", \"inferences\": %u, \"busy\": %.3f, \"compute\": %.3f,\n",
+		       s->name, s->inferences, s->busy / seconds, s->compute / seconds);
+		printf("     \"phases_ms\": {\"slot_wait\": %.3f, \"lock_wait\": %.3f, \"upload\": %.3f, "
+		       "\"device\": %.3f, \"download\": %.3f, \"aux\": %.3f}",
+		       s->phases.slotWait * k, s->phases.lockWait * k, s->phases.upload * k,
+		       s->phases.device * k, s->phases.download * k, s->phases.aux * k);
+		length = sizeof(thermal);
+		if ((control || weighted) &&
+		    !mvncGetDeviceOption(s->device, MVNC_THERMAL_CONTROL, &thermal, &length))
+			printf(",\n     \"thermal\": {\"target\": %.1f, \"temperature\": %.1f, \"duty\": %.3f, "
+			       "\"sustained_rate\": %.2f, \"rate\": %.2f}",
+			       thermal.target, thermal.temperature, thermal.duty, thermal.sustainedRate,
+			       thermal.rate);
+		length = sizeof(stats);
+		if (watchdog && !mvncGetDeviceOption(s->device, MVNC_DEVICE_STATS, &stats, &length))
+			printf(",\n     \"watchdog\": {\"resets\": %llu, \"replays\": %llu}",
+			       stats.resets, stats.replays);
+		printf("}%s\n", i + 1 < ndevices ? "," : "");
+	}
+	printf("  ]\n}\n");
+
+	for (i = 0; i < ndevices; i++) {
+		mvncFreeTensorBuffer(sticks[i].device, sticks[i].input);
+		free(sticks[i].output);
+		mvncDeallocateGraph(sticks[i].graph);
+		mvncCloseDevice(sticks[i].device);
+	}
+	for (i = 0; i < nthreads; i++)
+		free(workers[i].latency);
+	free(workers);
+	free(latency);
+	free(graph_file);
+	return rc ? 1 : 0;
+}
@@ -0,0 +1,380 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Microbenchmarks of the host side code paths of libmvnc. The calls going
+// to a device use software devices with no latency, so that only the cost
+// of the library is measured. Each case reports the time and the number
+// of heap allocations per operation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "mvnc.h"
+#include "fp16.h"
+#include "usb_link.h"
+
+#define FP16_ELEMENTS	(224 * 224 * 3)
+#define MIN_TIME	0.2	// Seconds per measurement
+#define SIM_DEVICES	4
+#define IMAGE_WIDTH	640
+#define IMAGE_HEIGHT	480
+#define TENSOR_SIZE	224
+#define OUTPUT_COUNT	1000
+
+// Heap allocations of the whole process, library threads included
+static unsigned long allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+static double time_in_seconds()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned rand_bits(unsigned *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return (*state >> 16) | ((*state * 1103515245 + 12345) & 0xffff0000);
+}
+
+// Every variant must give the same bits as the scalar code, on all
+// halves and on a sample of floats including the special values
+static int fp16_check(const struct fp16_variant *v)
+{
+	static uint16_t h[65536], h2[65536];
+	static float f[65536], f2[65536];
+	unsigned i, seed = 1;
+	uint32_t u;
+
+	for (i = 0; i < 65536; i++)
+		h[i] = i;
+	fp16_variants[0].half_to_float(f, h, 65536);
+	v->half_to_float(f2, h, 65536);
+	if (memcmp(f, f2, sizeof(f)))
+		return -1;
+
+	for (i = 0; i < 65536; i++) {
+		u = rand_bits(&seed);
+		if (i < 1024)	// Around the rounding, subnormal and overflow boundaries
+			u = (i & 1 ? 0x80000000 : 0) + (i % 4 < 2 ? 0x33000000 : 0x38000000) +
+			    (i % 4 < 2 ? 0 : (i / 4) << 18) + (i & 0xff0) + 0xff0;
+		else if (i < 2048)
+			u = (i & 1 ? 0x80000000 : 0) + 0x477fe000 + (i & 0x3ff) * 4;
+		else if (i < 2100)
+			u = 0x7f800000 + (i - 2048) * 0x1001;
+		memcpy(&f[i], &u, sizeof(u));
+	}
+	fp16_variants[0].float_to_half(h, f, 65536);
+	v->float_to_half(h2, f, 65536);
+	if (memcmp(h, h2, sizeof(h)))
+		return -1;
+	return 0;
+}
+
+static double fp16_rate(const struct fp16_variant *v, int to_half)
+{
+	static float f[FP16_ELEMENTS];
+	static uint16_t h[FP16_ELEMENTS];
+	unsigned i, iterations = 0;
+	double t0, t;
+
+	for (i = 0; i < FP16_ELEMENTS; i++)
+		f[i] = (float) i / FP16_ELEMENTS - 0.5f;
+	fp16_variants[0].float_to_half(h, f, FP16_ELEMENTS);
+
+	t0 = time_in_seconds();
+	do {
+		if (to_half)
+			v->float_to_half(h, f, FP16_ELEMENTS);
+		else
+			v->half_to_float(f, h, FP16_ELEMENTS);
+		iterations++;
+		t = time_in_seconds() - t0;
+	} while (t < MIN_TIME);
+
+	// Bytes read and written
+	return (double) iterations * FP16_ELEMENTS * (sizeof(*f) + sizeof(*h)) / t / 1e9;
+}
+
+static void bench_fp16(void)
+{
+	const struct fp16_variant *v;
+
+	printf("fp16 conversion, %u elements, selected variant %s\n",
+	       FP16_ELEMENTS, fp16_variant_name());
+	for (v = fp16_variants; v->name; v++) {
+		if (!v->supported()) {
+			printf("  %-8s not supported\n", v->name);
+			continue;
+		}
+		printf("  %-8s float->half %6.2f GB/s  half->float %6.2f GB/s  %s\n", v->name,
+		       fp16_rate(v, 1), fp16_rate(v, 0), fp16_check(v) ? "MISMATCH" : "exact");
+	}
+}
+
+// Runs fn for batches of n operations, doubling n until a batch lasts MIN_TIME
+static void run_case(const char *name, void (*fn)(void *arg, unsigned n), void *arg)
+{
+	unsigned long a0;
+	unsigned n = 1;
+	double t0, t;
+
+	fn(arg, 1);
+	for (;;) {
+		a0 = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+		t0 = time_in_seconds();
+		fn(arg, n);
+		t = time_in_seconds() - t0;
+		if (t >= MIN_TIME || n >= 1u << 30)
+			break;
+		n *= 2;
+	}
+	printf("  %-36s %12.1f ns/op %8.2f allocs/op\n", name, t * 1e9 / n,
+	       (double) (__atomic_load_n(&allocations, __ATOMIC_RELAXED) - a0) / n);
+}
+
+struct Context {
+	void *devices[SIM_DEVICES];
+	void *graph;		// On the device searched last
+	void *input;
+	unsigned input_length;
+	uint16_t output[OUTPUT_COUNT];
+	unsigned char image[IMAGE_WIDTH * IMAGE_HEIGHT * 3];
+	float floats[FP16_ELEMENTS];
+	uint16_t halves[FP16_ELEMENTS];
+	usbHeader_t header;
+};
+
+static void case_find_device(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+	unsigned length;
+	int level;
+
+	while (n--)
+		mvncGetDeviceOption(c->devices[0], MVNC_THERMAL_THROTTLING_LEVEL, &level, &length);
+}
+
+static void case_find_graph(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+	unsigned length;
+	int dontblock;
+
+	while (n--)
+		mvncGetGraphOption(c->graph, MVNC_DONT_BLOCK, &dontblock, &length);
+}
+
+static void case_header(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+
+	while (n--)
+		usblink_header(&c->header, USB_LINK_HOST_SET_DATA, "input1", n, 0, 1);
+}
+
+static void case_inference(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+	unsigned length;
+	void *param;
+
+	while (n--) {
+		mvncLoadTensor(c->graph, c->input, c->input_length, 0);
+		mvncGetResultToBuffer(c->graph, c->output, sizeof(c->output), &length, &param);
+	}
+}
+
+struct Handoff {
+	struct Context *c;
+	unsigned n;
+};
+
+static void *handoff_producer(void *arg)
+{
+	struct Handoff *h = arg;
+
+	while (h->n--)
+		mvncLoadTensor(h->c->graph, h->c->input, h->c->input_length, 0);
+	return 0;
+}
+
+// The inputs are loaded by another thread, so the two calls contend for the locks
+static void case_handoff(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+	struct Handoff h = {c, n};
+	pthread_t thread;
+	unsigned length;
+	void *param;
+
+	pthread_create(&thread, 0, handoff_producer, &h);
+	while (n--)
+		mvncGetResultToBuffer(c->graph, c->output, sizeof(c->output), &length, &param);
+	pthread_join(thread, 0);
+}
+
+static void case_float_to_half(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+
+	while (n--)
+		mvncFloatToHalf(c->halves, c->floats, FP16_ELEMENTS);
+}
+
+static void case_half_to_float(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+
+	while (n--)
+		mvncHalfToFloat(c->floats, c->halves, FP16_ELEMENTS);
+}
+
+static void case_preprocess(void *arg, unsigned n)
+{
+	struct Context *c = arg;
+
+	while (n--)
+		mvncPreprocessImage(c->image, IMAGE_WIDTH, IMAGE_HEIGHT, 0, 3,
+				    c->halves, TENSOR_SIZE, TENSOR_SIZE, 0);
+}
+
+// One stage graph file from an image tensor to OUTPUT_COUNT values
+static unsigned char *make_graph_file(unsigned *length)
+{
+	static const unsigned input[6] = {TENSOR_SIZE, TENSOR_SIZE, 3, 6, TENSOR_SIZE * 6, 2};
+	static const unsigned output[6] = {1, 1, OUTPUT_COUNT, OUTPUT_COUNT * 2, OUTPUT_COUNT * 2, 2};
+	unsigned char *graph;
+
+	*length = 264 + 227 + 4096;
+	graph = calloc(1, *length);
+	if (!graph)
+		return 0;
+	graph[36] = 2;		// Version
+	graph[240] = 1;		// Stages
+	memcpy(graph + 264 + 112, input, 12);
+	memcpy(graph + 264 + 148, input + 3, 12);
+	memcpy(graph + 264 + 136, output, 12);
+	memcpy(graph + 264 + 172, output + 3, 12);
+	return graph;
+}
+
+static int bench_api(void)
+{
+	static struct Context c;
+	char name[MVNC_MAX_NAME_SIZE], title[40];
+	unsigned char *graph_file;
+	unsigned length, i;
+	mvncGraphFileInfo info;
+	int rc, trace;
+
+	graph_file = make_graph_file(&length);
+	if (!graph_file || mvncGetGraphFileInfo(graph_file, length, &info))
+		return -1;
+	for (i = 0; i < SIM_DEVICES; i++) {
+		snprintf(name, sizeof(name), "sim-%u", i);
+		rc = mvncOpenDevice(name, &c.devices[i]);
+		if (!rc && i == 0)
+			rc = mvncAllocateGraph(c.devices[0], &c.graph, graph_file, length);
+		if (rc) {
+			fprintf(stderr, "Cannot use %s: %d\n", name, rc);
+			return -1;
+		}
+	}
+	c.input_length = info.inputLength;
+	if (mvncAllocTensorBuffer(c.devices[0], c.input_length, &c.input))
+		return -1;
+	memset(c.input, 0, c.input_length);
+	for (i = 0; i < sizeof(c.image); i++)
+		c.image[i] = i * 7;
+
+	printf("libmvnc calls, %u software devices\n", SIM_DEVICES);
+	snprintf(title, sizeof(title), "find_device (%u devices)", SIM_DEVICES);
+	run_case(title, case_find_device, &c);
+	snprintf(title, sizeof(title), "find_graph (%u devices)", SIM_DEVICES);
+	run_case(title, case_find_graph, &c);
+	run_case("usblink header", case_header, &c);
+	run_case("LoadTensor + GetResult", case_inference, &c);
+	run_case("LoadTensor / GetResult handoff", case_handoff, &c);
+	trace = 1;
+	mvncSetGlobalOption(MVNC_TRACE, &trace, sizeof(trace));
+	run_case("LoadTensor + GetResult, traced", case_inference, &c);
+	trace = 0;
+	mvncSetGlobalOption(MVNC_TRACE, &trace, sizeof(trace));
+	snprintf(title, sizeof(title), "FloatToHalf (%u)", FP16_ELEMENTS);
+	run_case(title, case_float_to_half, &c);
+	snprintf(title, sizeof(title), "HalfToFloat (%u)", FP16_ELEMENTS);
+	run_case(title, case_half_to_float, &c);
+	snprintf(title, sizeof(title), "PreprocessImage (%ux%u to %u)", IMAGE_WIDTH,
+		 IMAGE_HEIGHT, TENSOR_SIZE);
+	run_case(title, case_preprocess, &c);
+
+	mvncFreeTensorBuffer(c.devices[0], c.input);
+	mvncDeallocateGraph(c.graph);
+	for (i = 0; i < SIM_DEVICES; i++)
+		mvncCloseDevice(c.devices[i]);
+	free(graph_file);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char count[16];
+
+	// Software devices only, without latency
+	snprintf(count, sizeof(count), "%u", SIM_DEVICES);
+	setenv("MVNC_SIM_DEVICES", count, 1);
+	setenv("MVNC_SIM_LATENCY_MS", "0", 1);
+	setenv("MVNC_SIM_MBPS", "0", 1);
+
+	bench_fp16();
+	return bench_api() ? 1 : 0;
+}
@@ -0,0 +1,315 @@
+/*
+*
+* Copyright (c) 2017-2018 Intel Corporation. All Rights Reserved
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Per stage profile of a compiled graph: runs it on a device and joins the
+// stage table of the graph file with the stage times measured by the device
+// (MVNC_STAGE_STATS). The operations and bytes of each stage are estimated
+// from its tensor shapes, in half precision: 2 operations per weight and
+// output for stages with weights, one per input or output element for the
+// others. Printed as a table, or as JSON with -j.
+// Set MVNC_SIM_DEVICES to run it on software devices.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mvnc.h"
+
+struct Stage {
+	unsigned index;
+	mvncStageInfo info;
+	mvncStageStats stats;
+	float p50, p99;		// ms
+	double ops, bytes;
+};
+
+// Operation types as numbered by the graph compiler
+static const char *type_names[] = {
+	"Convolution", "MaxPool", "AvgPool", "SoftMax", "FullyConnected", "None",
+	"ReLU", "ReLUX", "DepthConv", "Bias", "PReLU", "LRN", "Sum", "Prod", "Max",
+	"Scale", "Relayout", "Square", "InnerLRN", "Copy", "Sigmoid", "TanH",
+	"Deconvolution", "Elu", "Reshape", "ToPlaneMajor", "Power", "Crop", "Tile",
+	"Region", "Reorg",
+};
+
+static void usage()
+{
+	fprintf(stderr, "Usage: mvnc_profile [options] graph\n"
+		"  -d device    device name, the first one by default\n"
+		"  -n count     inferences measured, default 100\n"
+		"  -w count     inferences before measuring, default 5\n"
+		"  -s           sort the stages by mean time, slowest first\n"
+		"  -j           print JSON instead of a table\n");
+	exit(1);
+}
+
+static void *load_file(const char *path, unsigned *length)
+{
+	FILE *fp = fopen(path, "rb");
+	void *buf;
+
+	if (!fp)
+		return 0;
+	fseek(fp, 0, SEEK_END);
+	*length = ftell(fp);
+	rewind(fp);
+	buf = malloc(*length);
+	if (buf && fread(buf, 1, *length, fp) != *length) {
+		free(buf);
+		buf = 0;
+	}
+	fclose(fp);
+	return buf;
+}
+
+static const char *type_name(int type, char *buf, unsigned size)
+{
+	if (type >= 0 && type < (int) (sizeof(type_names) / sizeof(*type_names)))
+		return type_names[type];
+	snprintf(buf, size, "Type%d", type);
+	return buf;
+}
+
+static double elements(const mvncTensorShape *shape)
+{
+	return (double) shape->x * shape->y * shape->z;
+}
+
+static void estimate(struct Stage *s)
+{
+	double in = elements(&s->info.input), taps = elements(&s->info.taps);
+	double out = elements(&s->info.output);
+
+	// Each output of convolutions and fully connected layers uses the
+	// weights of its channel, taps / output channels of them
+	if (taps && s->info.output.z)
+		s->ops = 2 * out * taps / s->info.output.z;
+	else
+		s->ops = in > out ? in : out;
+	s->bytes = 2 * (in + taps + out);
+}
+
+static int by_time(const void *a, const void *b)
+{
+	float ta = ((const struct Stage *) a)->stats.mean;
+	float tb = ((const struct Stage *) b)->stats.mean;
+
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static int run(void *graph, void *input, unsigned input_length, unsigned count)
+{
+	unsigned i, length;
+	void *output, *param;
+	mvncStatus rc;
+
+	for (i = 0; i < count; i++) {
+		rc = mvncLoadTensor(graph, input, input_length, 0);
+		if (!rc)
+			rc = mvncGetResult(graph, &output, &length, &param);
+		if (rc) {
+			fprintf(stderr, "Inference failed: %d\n", rc);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void print_table(const char *path, struct Stage *stages, unsigned n, float total,
+			const mvncStats *stats)
+{
+	char type[16], in[40], out[40];
+	unsigned i;
+	float ms;
+
+	printf("%s: %u stages, %llu inferences\n\n", path, n, stats->inferences);
+	printf("%-5s %-28s %-14s %-16s %-16s %9s %8s %8s %8s %8s %6s %9s %8s\n",
+	       "Stage", "Name", "Type", "Input", "Output", "MFLOPs", "MB",
+	       "mean ms", "p50 ms", "p99 ms", "share", "MB/s", "GFLOP/s");
+	for (i = 0; i < n; i++) {
+		struct Stage *s = &stages[i];
+		double seconds = s->stats.mean * 1e-3;
+
+		snprintf(in, sizeof(in), "%ux%ux%u", s->info.input.x, s->info.input.y, s->info.input.z);
+		snprintf(out, sizeof(out), "%ux%ux%u", s->info.output.x, s->info.output.y,
+			 s->info.output.z);
+		printf("%-5u %-28.28s %-14s %-16s %-16s %9.3f %8.3f %8.3f %8.3f %8.3f %5.1f%% %9.1f %8.2f\n",
+		       s->index, s->info.name, type_name(s->info.type, type, sizeof(type)), in, out,
+		       s->ops * 1e-6, s->bytes * 1e-6, s->stats.mean, s->p50, s->p99,
+		       total ? 100 * s->stats.mean / total : 0,
+		       seconds ? s->bytes * 1e-6 / seconds : 0, seconds ? s->ops * 1e-9 / seconds : 0);
+	}
+	printf("\nDevice time %.3f ms per inference", total);
+	if (!mvncStatsPercentile(stats, 50, &ms))
+		printf(", host latency p50 %.3f ms", ms);
+	if (!mvncStatsPercentile(stats, 99, &ms))
+		printf(", p99 %.3f ms", ms);
+	printf("\n");
+}
+
+static void print_shape(const char *name, const mvncTensorShape *shape)
+{
+	printf("\"%s\": [%u, %u, %u], ", name, shape->x, shape->y, shape->z);
+}
+
+static void print_json(const char *path, struct Stage *stages, unsigned n, float total,
+		       const mvncStats *stats)
+{
+	char type[16];
+	unsigned i;
+	float ms;
+
+	printf("{\n");
+	printf("  \"graph\": \"%s\",\n", path);
+	printf("  \"inferences\": %llu,\n", stats->inferences);
+	printf("  \"device_ms\": %.4f,\n", total);
+	if (!mvncStatsPercentile(stats, 50, &ms))
+		printf("  \"latency_ms\": {\"p50\": %.4f, ", ms);
+	if (!mvncStatsPercentile(stats, 99, &ms))
+		printf("\"p99\": %.4f},\n", ms);
+	printf("  \"stages\": [\n");
+	for (i = 0; i < n; i++) {
+		struct Stage *s = &stages[i];
+		double seconds = s->stats.mean * 1e-3;
+
+		printf("    {\"index\": %u, \"name\": \"%s\", \"type\": \"%s\", ", s->index, s->info.name,
+		       type_name(s->info.type, type, sizeof(type)));
+		print_shape("input", &s->info.input);
+		print_shape("taps", &s->info.taps);
+		print_shape("output", &s->info.output);
+		printf("\n     \"mflops\": %.4f, \"mbytes\": %.4f, ", s->ops * 1e-6, s->bytes * 1e-6);
+		printf("\"ms\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f, \"p50\": %.4f, \"p99\": %.4f}, ",
+		       s->stats.mean, s->stats.min, s->stats.max, s->p50, s->p99);
+		printf("\"share\": %.4f, \"mbps\": %.2f, \"gflops\": %.3f}%s\n",
+		       total ? s->stats.mean / total : 0, seconds ? s->bytes * 1e-6 / seconds : 0,
+		       seconds ? s->ops * 1e-9 / seconds : 0, i + 1 < n ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	char name[MVNC_MAX_NAME_SIZE] = "";
+	unsigned count = 100, warmup = 5, graph_length, i;
+	int c, sort = 0, json = 0, on = 1;
+	void *graph_file, *device, *graph, *input;
+	mvncGraphFileInfo info;
+	mvncStats stats;
+	struct Stage *stages;
+	unsigned length;
+	float total = 0;
+	mvncStatus rc;
+
+	while ((c = getopt(argc, argv, "d:n:w:sj")) != -1) {
+		switch (c) {
+		case 'd':
+			strncpy(name, optarg, sizeof(name) - 1);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 's':
+			sort = 1;
+			break;
+		case 'j':
+			json = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || !count)
+		usage();
+
+	graph_file = load_file(argv[optind], &graph_length);
+	if (!graph_file) {
+		perror(argv[optind]);
+		return 1;
+	}
+	rc = mvncGetGraphFileInfo(graph_file, graph_length, &info);
+	if (rc) {
+		fprintf(stderr, "%s: invalid graph file: %d\n", argv[optind], rc);
+		return 1;
+	}
+	stages = calloc(info.stageCount, sizeof(*stages));
+	input = calloc(1, info.inputLength);
+	if (!stages || !input) {
+		perror("stages");
+		return 1;
+	}
+	for (i = 0; i < info.stageCount; i++) {
+		stages[i].index = i;
+		mvncGetGraphFileStage(graph_file, graph_length, i, &stages[i].info);
+		estimate(&stages[i]);
+	}
+
+	if (!*name && mvncGetDeviceName(0, name, sizeof(name))) {
+		fprintf(stderr, "No devices found\n");
+		return 1;
+	}
+	rc = mvncOpenDevice(name, &device);
+	if (!rc)
+		rc = mvncAllocateGraph(device, &graph, graph_file, graph_length);
+	if (rc) {
+		fprintf(stderr, "Cannot use device %s: %d\n", name, rc);
+		return 1;
+	}
+
+	// Stage times and graph counters start after the warmup
+	if (run(graph, input, info.inputLength, warmup))
+		return 1;
+	rc = mvncSetGraphOption(graph, MVNC_STAGE_STATS, &on, sizeof(on));
+	if (!rc)
+		rc = mvncSetGraphOption(graph, MVNC_GRAPH_STATS, &on, sizeof(on));
+	if (rc) {
+		fprintf(stderr, "Cannot enable the stage times: %d\n", rc);
+		return 1;
+	}
+	if (run(graph, input, info.inputLength, count))
+		return 1;
+	length = sizeof(stats);
+	rc = mvncGetGraphOption(graph, MVNC_GRAPH_STATS, &stats, &length);
+	for (i = 0; !rc && i < info.stageCount; i++) {
+		struct Stage *s = &stages[i];
+		rc = mvncGetStageStats(graph, i, &s->stats);
+		if (!rc) {
+			mvncHistogramPercentile(s->stats.time, 50, &s->p50);
+			mvncHistogramPercentile(s->stats.time, 99, &s->p99);
+			total += s->stats.mean;
+		}
+	}
+	if (rc) {
+		fprintf(stderr, "Cannot read the stage times: %d\n", rc);
+		return 1;
+	}
+	mvncDeallocateGraph(graph);
+	mvncCloseDevice(device);
+
+	if (sort)
+		qsort(stages, info.stageCount, sizeof(*stages), by_time);
+	if (json)
+		print_json(argv[optind], stages, info.stageCount, total, &stats);
+	else
+		print_table(argv[optind], stages, info.stageCount, total, &stats);
+	free(stages);
+	free(input);
+	free(graph_file);
+	return 0;
+}
@@ -22,12 +22,9 @@
 #include "stb_image_resize.h"
 
 #include "fp16.h"
-#include <mvnc.h>
+#include <mvnc.hpp>
 
 
-// somewhat arbitrary buffer size for the device name
-#define NAME_SIZE 100
-
 // from current director to examples base director
 // #define APP_BASE_DIR "../"
 
@@ -44,7 +41,7 @@
 
 // 16 bits.  will use this to store half precision floats since C++ has no 
 // built in support for it.
-typedef unsigned short half;
+typedef mvnc::half half;
 
 // GoogleNet image dimensions, network mean values for each channel in BGR order.
 const int networkDimGoogleNet = 224;
@@ -53,44 +50,9 @@ float networkMeanGoogleNet[] = {0.40787054*255.0, 0.45752458*255.0, 0.48109378*2
 float networkMeanSqueezeNet[] = {0.40787054*255.0, 0.45752458*255.0, 0.48109378*255.0};
 
 // Prototypes
-void *LoadGraphFile(const char *path, unsigned int *length);
 half *LoadImage(const char *path, int reqsize, float *mean);
 // end prototypes
 
-// Reads a graph file from the file system and copies it to a buffer
-// that is allocated internally via malloc.
-// Param path is a pointer to a null terminate string that must be set to the path to the 
-//            graph file on disk before calling
-// Param length must must point to an integer that will get set to the number of bytes 
-//              allocated for the buffer
-// Returns pointer to the buffer allcoated. 
-// Note: The caller must free the buffer returned.
-void *LoadGraphFile(const char *path, unsigned int *length)
-{
-	FILE *fp;
-	char *buf;
-
-	fp = fopen(path, "rb");
-	if(fp == NULL)
-		return 0;
-	fseek(fp, 0, SEEK_END);
-	*length = ftell(fp);
-	rewind(fp);
-	if(!(buf = (char*) malloc(*length)))
-	{
-		fclose(fp);
-		return 0;
-	}
-	if(fread(buf, 1, *length, fp) != *length)
-	{
-		fclose(fp);
-		free(buf);
-		return 0;
-	}
-	fclose(fp);
-	return buf;
-}
-
 // Reads an image file from disk (8 bit per channel RGB .jpg or .png or other formats 
 // supported by stbi_load.)  Resizes it, subtracts the mean from each channel, and then 
 // converts to an array of half precision floats that is suitable to pass to mvncLoadTensor.  
@@ -166,128 +128,48 @@ half *LoadImage(const char *path, int reqSize, float *mean)
 }
 
 
-// Opens one NCS device.
-// Param deviceIndex is the zero-based index of the device to open
-// Param deviceHandle is the address of a device handle that will be set 
-//                    if opening is successful
-// Returns true if works or false if doesn't.
-bool OpenOneNCS(int deviceIndex, void** deviceHandle)
-{
-    mvncStatus retCode;
-    char devName[NAME_SIZE];
-    retCode = mvncGetDeviceName(deviceIndex, devName, NAME_SIZE);
-    if (retCode != MVNC_OK)
-    {   // failed to get this device's name, maybe none plugged in.
-        printf("Error - NCS device at index %d not found\n", deviceIndex);
-        return false;
-    }
-    
-    // Try to open the NCS device via the device name
-    retCode = mvncOpenDevice(devName, deviceHandle);
-    if (retCode != MVNC_OK)
-    {   // failed to open the device.  
-        printf("Error - Could not open NCS device at index %d\n", deviceIndex);
-        return false;
-    }
-    
-    // deviceHandle is ready to use now.  
-    // Pass it to other NC API calls as needed and close it when finished.
-    printf("Successfully opened NCS device at index %d!\n", deviceIndex);
-    return true;
-}
-
-
-// Loads a compiled network graph onto the NCS device.
-// Param deviceHandle is the open device handle for the device that will allocate the graph
-// Param graphFilename is the name of the compiled network graph file to load on the NCS
-// Param graphHandle is the address of the graph handle that will be created internally.
-//                   the caller must call mvncDeallocateGraph when done with the handle.
-// Returns true if works or false if doesn't.
-bool LoadGraphToNCS(void* deviceHandle, const char* graphFilename, void** graphHandle)
-{
-    mvncStatus retCode;
-
-    // Read in a graph file
-    unsigned int graphFileLen;
-    void* graphFileBuf = LoadGraphFile(graphFilename, &graphFileLen);
-
-    // allocate the graph
-    retCode = mvncAllocateGraph(deviceHandle, graphHandle, graphFileBuf, graphFileLen);
-    free(graphFileBuf);
-    if (retCode != MVNC_OK)
-    {   // error allocating graph
-        printf("Could not allocate graph for file: %s\n", graphFilename); 
-        printf("Error from mvncAllocateGraph is: %d\n", retCode);
-        return false;
-    }
-
-    // successfully allocated graph.  Now graphHandle is ready to go.  
-    // use graphHandle for other API calls and call mvncDeallocateGraph
-    // when done with it.
-    printf("Successfully allocated graph for %s\n", graphFilename);
-
-    return true;
-}
-
-
 // Runs an inference and outputs result to console
-// Param graphHandle is the graphHandle from mvncAllocateGraph for the network that 
-//                   will be used for the inference
+// Param graph is the graph allocated on the device for the network that
+//             will be used for the inference
 // Param imageFileName is the name of the image file that will be used as input for
 //                     the neural network for the inference
 // Param networkDim is the height and width (assumed to be the same) for images that the
 //                     network expects. The image will be resized to this prior to inference.
 // Param networkMean is pointer to array of 3 floats that are the mean values for the network
 //                   for each color channel, blue, green, and red in that order.
-// Returns tru if works or false if doesn't
-bool DoInferenceOnImageFile(void* graphHandle, const char* imageFileName, int networkDim, float* networkMean)
+// Returns true if works or false if doesn't
+bool DoInferenceOnImageFile(mvnc::Graph &graph, const char* imageFileName, int networkDim, float* networkMean)
 {
-    mvncStatus retCode;
-
     // LoadImage will read image from disk, convert channels to floats
     // subtract network mean for each value in each channel.  Then, convert 
     // floats to half precision floats and return pointer to the buffer 
     // of half precision floats (Fp16s)
     half* imageBufFp16 = LoadImage(imageFileName, networkDim, networkMean);
-
-    // calculate the length of the buffer that contains the half precision floats. 
-    // 3 channels * width * height * sizeof a 16bit float 
-    unsigned int lenBufFp16 = 3*networkDim*networkDim*sizeof(*imageBufFp16);
-
-    // start the inference with mvncLoadTensor()
-    retCode = mvncLoadTensor(graphHandle, imageBufFp16, lenBufFp16, NULL);
-    free(imageBufFp16);
-    if (retCode != MVNC_OK)
-    {   // error loading tensor
-        printf("Error - Could not load tensor\n");
-        printf("    mvncStatus from mvncLoadTensor is: %d\n", retCode);
+    if (!imageBufFp16)
         return false;
-    }
 
-    // the inference has been started, now call mvncGetResult() for the
-    // inference result 
-    printf("Successfully loaded the tensor for image %s\n", imageFileName);
-    
-    void* resultData16;
-    void* userParam;
-    unsigned int lenResultData;
-    retCode = mvncGetResult(graphHandle, &resultData16, &lenResultData, &userParam);
-    if (retCode != MVNC_OK)
+    // run the inference, the result is read directly into resultData16
+    std::vector<half> resultData16(graph.outputSize());
+    try
+    {
+        graph.infer(mvnc::Span<const half>(imageBufFp16, 3*networkDim*networkDim), resultData16).get();
+    }
+    catch (mvnc::Error &e)
     {
-        printf("Error - Could not get result for image %s\n", imageFileName);
-        printf("    mvncStatus from mvncGetResult is: %d\n", retCode);
+        free(imageBufFp16);
+        printf("Error - Could not run the inference for image %s\n", imageFileName);
+        printf("    mvncStatus is: %d\n", e.status());
         return false;
     }
+    free(imageBufFp16);
 
-    // Successfully got the result.  The inference result is in the buffer pointed to by resultData
+    // Successfully got the result.  The inference result is in resultData16
     printf("Successfully got the inference result for image %s\n", imageFileName);
-    //printf("resultData is %d bytes which is %d 16-bit floats.\n", lenResultData, lenResultData/(int)sizeof(half));
 
     // convert half precision floats to full floats
-    int numResults = lenResultData / sizeof(half);
-    float* resultData32;
-    resultData32 = (float*)malloc(numResults * sizeof(*resultData32));
-    fp16tofloat(resultData32, (unsigned char*)resultData16, numResults);
+    int numResults = resultData16.size();
+    std::vector<float> resultData32(numResults);
+    fp16tofloat(resultData32.data(), (unsigned char*)resultData16.data(), numResults);
 
     float maxResult = 0.0;
     int maxIndex = -1;
@@ -302,59 +184,41 @@ bool DoInferenceOnImageFile(void* graphHandle, const char* imageFileName, int ne
     }
     printf("Index of top result is: %d\n", maxIndex);
     printf("Probability of top result is: %f\n", resultData32[maxIndex]);
+    return true;
 }
 
 // Main entry point for the program
 int main(int argc, char** argv)
 {
-    mvncStatus retCode;
-    void* devHandle1;
-    void* devHandle2;
-    void* graphHandleGoogleNet; 
-    void* graphHandleSqueezeNet;
-
-    if (!OpenOneNCS(0, &devHandle1)) 
-    {	// couldn't open first NCS device
-        exit(-1);
-    }
-    if (!OpenOneNCS(1, &devHandle2)) 
-    {   // couldn't open second NCS device
-        exit(-1);
+    try
+    {
+        // The devices and graphs are released by their destructors when leaving
+        // this block, also when an error is thrown
+        mvnc::Device device1(0);
+        mvnc::Device device2(1);
+        printf("Successfully opened NCS devices %s and %s\n", device1.name().c_str(), device2.name().c_str());
+
+        mvnc::Graph graphGoogleNet(device1, mvnc::loadGraphFile(GOOGLENET_GRAPH_FILE_NAME));
+        mvnc::Graph graphSqueezeNet(device2, mvnc::loadGraphFile(SQUEEZENET_GRAPH_FILE_NAME));
+        printf("Successfully allocated graphs\n");
+
+        printf("\n--- NCS 1 inference ---\n");
+        DoInferenceOnImageFile(graphGoogleNet, GOOGLENET_IMAGE_FILE_NAME, networkDimGoogleNet, networkMeanGoogleNet);
+        printf("-----------------------\n");
+
+        printf("\n--- NCS 2 inference ---\n");
+        DoInferenceOnImageFile(graphSqueezeNet, SQUEEZENET_IMAGE_FILE_NAME, networkDimSqueezeNet, networkMeanSqueezeNet);
+        printf("-----------------------\n");
     }
-
-    void* deviceHandle = devHandle1;
-
-    if (!LoadGraphToNCS(devHandle1, GOOGLENET_GRAPH_FILE_NAME, &graphHandleGoogleNet))
+    catch (mvnc::Error &e)
     {
-        mvncCloseDevice(devHandle1);
-        mvncCloseDevice(devHandle2);
-        exit(-2);
+        printf("Error - mvncStatus %d, are two NCS devices plugged in?\n", e.status());
+        return -1;
     }
-    if (!LoadGraphToNCS(devHandle2, SQUEEZENET_GRAPH_FILE_NAME, &graphHandleSqueezeNet))
+    catch (std::exception &e)
     {
-        mvncDeallocateGraph(graphHandleGoogleNet);
-        graphHandleGoogleNet = NULL;
-        mvncCloseDevice(devHandle1);
-        mvncCloseDevice(devHandle2);
-        exit(-2);
+        printf("Error - %s\n", e.what());
+        return -2;
     }
-
-    printf("\n--- NCS 1 inference ---\n");
-    DoInferenceOnImageFile(graphHandleGoogleNet, GOOGLENET_IMAGE_FILE_NAME, networkDimGoogleNet, networkMeanGoogleNet);
-    printf("-----------------------\n");
-
-    printf("\n--- NCS 2 inference ---\n");
-    DoInferenceOnImageFile(graphHandleSqueezeNet, SQUEEZENET_IMAGE_FILE_NAME, networkDimSqueezeNet, networkMeanSqueezeNet);
-    printf("-----------------------\n");
-
-    retCode = mvncDeallocateGraph(graphHandleSqueezeNet);
-    graphHandleSqueezeNet = NULL;
-    retCode = mvncDeallocateGraph(graphHandleGoogleNet);
-    graphHandleGoogleNet = NULL;
-  
-    retCode = mvncCloseDevice(devHandle1);
-    devHandle1 = NULL;
-
-    retCode = mvncCloseDevice(devHandle2);
-    devHandle2 = NULL;
+    return 0;
 }
@@ -41,9 +41,12 @@ cd /opt/movidius/NCSDK
 sudo cp /tmp/ncsdk.conf .
 
 sudo cp ${DIR}/api/include/mvnc.h .
+sudo cp ${DIR}/api/include/mvnc.hpp .
+sudo cp ${DIR}/api/include/mvnc_coro.hpp .
 sudo cp ${DIR}/api/include/mvnc_deprecated.h .
 sudo cp ${DIR}/api/python/mvnc/mvncapi.py .
 sudo cp ${DIR}/api/python/mvnc/__init__.py .
+sudo cp ${DIR}/api/python/mvnc/aio.py .
 ./install-ncsdk.sh
 
 # leave the uninstall script on the target